@@ -21,42 +21,93 @@
 #include "chain_arr.h"
 #include "common.h"
 
+/* nested tables created by deserialize_chunked_table_fn() on this thread */
+static __thread struct pw_arena *t_des_arena;
+
+static void *
+table_calloc(struct pw_arena *arena, size_t size)
+{
+	if (arena) {
+		return pw_arena_alloc(arena, size);
+	}
+
+	return calloc(1, size);
+}
+
 int
-pw_chain_table_init(struct pw_chain_table *table, const char *name, struct serializer *serializer, size_t el_size, size_t count)
+pw_chain_table_init(struct pw_chain_table *table, const char *name, struct serializer *serializer,
+		size_t el_size, size_t count, struct pw_arena *arena)
 {
 	table->name = name;
 	table->serializer = serializer;
 	table->el_size = el_size;
+	table->arena = arena;
 
-	table->chain = table->chain_last = calloc(1, sizeof(*table->chain) + el_size * count);
+	table->chain = table->chain_last = table_calloc(arena, sizeof(*table->chain) + el_size * count);
 	if (!table->chain) {
 		return -ENOMEM;
 	}
 
 	table->chain->capacity = count;
+	table->chains[0] = table->chain;
+	table->chains_cnt = 1;
 	return 0;
 }
 
 struct pw_chain_table *
-pw_chain_table_alloc(const char *name, struct serializer *serializer, size_t el_size, size_t count)
+pw_chain_table_alloc(const char *name, struct serializer *serializer, size_t el_size,
+		size_t count, struct pw_arena *arena)
 {
 	struct pw_chain_table *table;
 	int rc;
 
-	table = calloc(1, sizeof(*table));
+	table = table_calloc(arena, sizeof(*table));
 	if (!table) {
 		return NULL;
 	}
 
-	rc = pw_chain_table_init(table, name, serializer, el_size, count);
+	rc = pw_chain_table_init(table, name, serializer, el_size, count, arena);
 	if (rc) {
-		free(table);
+		if (!arena) {
+			free(table);
+		}
 		return NULL;
 	}
 
 	return table;
 }
 
+void
+pw_chain_table_set_des_arena(struct pw_arena *arena)
+{
+	t_des_arena = arena;
+}
+
+/* index of the first element in the given chain */
+static size_t
+chain_first_idx(struct pw_chain_table *table, unsigned chain_idx)
+{
+	if (chain_idx == 0) {
+		return 0;
+	}
+
+	return table->chain->capacity + PW_CHAIN_TABLE_GROW_MIN * ((1ULL << (chain_idx - 1)) - 1);
+}
+
+/* chain containing the element at given index, even if it's not allocated yet */
+static unsigned
+chain_idx_of(struct pw_chain_table *table, size_t idx)
+{
+	size_t cap0 = table->chain->capacity;
+
+	if (idx < cap0) {
+		return 0;
+	}
+
+	/* chain n >= 1 starts at cap0 + GROW_MIN * (2^(n-1) - 1) */
+	return 64 - __builtin_clzll((idx - cap0) / PW_CHAIN_TABLE_GROW_MIN + 1);
+}
+
 void *
 pw_chain_table_new_el(struct pw_chain_table *table)
 {
@@ -66,8 +117,14 @@ pw_chain_table_new_el(struct pw_chain_table *table)
 	if (chain->count < chain->capacity) {
 		 el = &chain->data[chain->count++ * table->el_size];
 	} else {
-		size_t table_count = 16;
-		chain->next = table->chain_last = calloc(1, sizeof(struct pw_chain_el) + table_count * table->el_size);
+		size_t table_count;
+
+		if (table->chains_cnt == PW_CHAIN_TABLE_MAX_CHAINS) {
+			return NULL;
+		}
+
+		table_count = (size_t)PW_CHAIN_TABLE_GROW_MIN << (table->chains_cnt - 1);
+		chain->next = table->chain_last = table_calloc(table->arena, sizeof(struct pw_chain_el) + table_count * table->el_size);
 		if (!chain->next) {
 			return NULL;
 		}
@@ -75,6 +132,7 @@ pw_chain_table_new_el(struct pw_chain_table *table)
 		chain = table->chain_last;
 		chain->capacity = table_count;
 		chain->count = 1;
+		table->chains[table->chains_cnt++] = chain;
 
 		el = chain->data;
 	}
@@ -86,25 +144,72 @@ pw_chain_table_new_el(struct pw_chain_table *table)
 	return el;
 }
 
+void *
+pw_chain_table_get(struct pw_chain_table *table, size_t idx)
+{
+	unsigned chain_idx = chain_idx_of(table, idx);
+	struct pw_chain_el *chain;
+
+	if (chain_idx >= table->chains_cnt) {
+		return NULL;
+	}
+
+	chain = table->chains[chain_idx];
+	idx -= chain_first_idx(table, chain_idx);
+	if (idx >= chain->count) {
+		return NULL;
+	}
+
+	return chain->data + idx * table->el_size;
+}
+
+size_t
+pw_chain_table_fread_els(struct pw_chain_table *table, FILE *fp, size_t el_count, size_t rec_size, size_t gap_off)
+{
+	struct pw_chain_el *chain = table->chain;
+	size_t el_size = table->el_size;
+	size_t gap_len = el_size - rec_size;
+	size_t i, rc;
+
+	assert(chain->count == 0 && chain->capacity >= el_count);
+	assert(rec_size <= el_size && gap_off <= rec_size);
+
+	rc = fread(chain->data, rec_size, el_count, fp);
+	chain->count = el_count;
+
+	if (gap_len == 0) {
+		return rc;
+	}
+
+	/* spread the records out, last to first so nothing is overwritten early */
+	i = el_count;
+	while (i-- > 0) {
+		char *src = chain->data + i * rec_size;
+		char *dst = chain->data + i * el_size;
+
+		memmove(dst + gap_off + gap_len, src + gap_off, rec_size - gap_off);
+		memmove(dst, src, gap_off);
+		memset(dst + gap_off, 0, gap_len);
+	}
+
+	return rc;
+}
+
 struct pw_chain_table *
-pw_chain_table_fread(FILE *fp, const char *name, size_t el_count, struct serializer *el_serializer)
+pw_chain_table_fread(FILE *fp, const char *name, size_t el_count, struct serializer *el_serializer,
+		struct pw_arena *arena)
 {
 	struct pw_chain_table *tbl;
 	uint32_t el_size = serializer_get_size(el_serializer);
-	size_t i;
 
 	uint32_t el_cap = MAX(8, el_count);
-	tbl = pw_chain_table_alloc(name, el_serializer, el_size, el_cap);
+	tbl = pw_chain_table_alloc(name, el_serializer, el_size, el_cap, arena);
 	if (!tbl) {
 		PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed\n");
 		return NULL;
 	}
 
-	for (i = 0; i < el_count; i++) {
-		void *el = pw_chain_table_new_el(tbl);
-		fread(el, el_size, 1, fp);
-	}
-
+	pw_chain_table_fread_els(tbl, fp, el_count, el_size, el_size);
 	return tbl;
 }
 
@@ -115,92 +220,264 @@ free_chain(struct pw_chain_el *chain)
 
 	while (chain) {
 		tmp = chain->next;
+		free(chain->removed);
 		free(chain);
 		chain = tmp;
 	}
 }
 
 uint32_t
-pw_chain_table_count(struct pw_chain_table *table)
+pw_chain_table_size(struct pw_chain_table *table)
 {
-	struct pw_chain_el *chain = table->chain;
-	uint32_t count = 0;
+	/* all chains but the last one are full */
+	return chain_first_idx(table, table->chains_cnt - 1) + table->chain_last->count;
+}
 
-	while (chain) {
-		count += chain->count;
-		chain = chain->next;
+/* first index in [from, to) with the removed bit equal to 'set', or to */
+static size_t
+removed_bits_find(const uint64_t *bits, size_t from, size_t to, bool set)
+{
+	size_t w = from / 64;
+	uint64_t word;
+
+	if (from >= to) {
+		return to;
+	}
+
+	word = (set ? bits[w] : ~bits[w]) & (~0ULL << (from % 64));
+	while (!word) {
+		if (++w * 64 >= to) {
+			return to;
+		}
+		word = set ? bits[w] : ~bits[w];
+	}
+
+	return MIN(w * 64 + __builtin_ctzll(word), to);
+}
+
+/* clear the removed bits in [from, to) and return how many were set */
+static size_t
+chain_unremove(struct pw_chain_el *chain, size_t from, size_t to)
+{
+	size_t cnt = 0;
+
+	if (!chain->removed) {
+		return 0;
 	}
 
-	return count;
+	for (size_t i = removed_bits_find(chain->removed, from, to, true); i < to;
+			i = removed_bits_find(chain->removed, i + 1, to, true)) {
+		chain->removed[i / 64] &= ~(1ULL << (i % 64));
+		cnt++;
+	}
+
+	return cnt;
 }
 
 void
 pw_chain_table_truncate(struct pw_chain_table *table, uint32_t size)
 {
+	unsigned chain_idx;
 	struct pw_chain_el *chain;
-	uint32_t traversed_size = 0;
+	uint32_t oldcount;
 
-	chain = table->chain;
-	while (chain) {
-		if (chain->count + traversed_size > size) {
-			uint32_t oldcount = chain->count;
-
-			chain->count = size - traversed_size;
-			/* TODO reset that memory in a better way -> the following
-			 * memset might clear nested chain tables and cause a memory
-			 * leak */
-			memset(chain->data + chain->count * table->el_size, 0,
-					(oldcount - chain->count) * table->el_size);
-			free_chain(chain->next);
-			chain->next = NULL;
-			return;
+	if (size >= pw_chain_table_size(table)) {
+		return;
+	}
+
+	chain_idx = chain_idx_of(table, size);
+	chain = table->chains[chain_idx];
+	oldcount = chain->count;
+	chain->count = size - chain_first_idx(table, chain_idx);
+	table->removed_cnt -= chain_unremove(chain, chain->count, oldcount);
+	for (unsigned c = chain_idx + 1; c < table->chains_cnt; c++) {
+		table->removed_cnt -= chain_unremove(table->chains[c], 0, table->chains[c]->count);
+	}
+	/* nested tables of the dropped elements are reclaimed only when their
+	 * arena is freed along with the file, otherwise they leak */
+	memset(chain->data + chain->count * table->el_size, 0,
+			(oldcount - chain->count) * table->el_size);
+	if (!table->arena) {
+		free_chain(chain->next);
+	}
+	chain->next = NULL;
+	table->chain_last = chain;
+	table->chains_cnt = chain_idx + 1;
+}
+
+int
+pw_chain_table_set_removed(struct pw_chain_table *table, void *el, bool removed)
+{
+	for (unsigned c = 0; c < table->chains_cnt; c++) {
+		struct pw_chain_el *chain = table->chains[c];
+		size_t idx;
+		uint64_t mask;
+
+		if ((char *)el < chain->data || (char *)el >= chain->data + chain->count * table->el_size) {
+			continue;
 		}
 
-		traversed_size += chain->count;
-		chain = chain->next;
+		idx = ((char *)el - chain->data) / table->el_size;
+		mask = 1ULL << (idx % 64);
+		if (!chain->removed) {
+			if (!removed) {
+				return 0;
+			}
+
+			chain->removed = table_calloc(table->arena, (chain->capacity + 63) / 64 * sizeof(uint64_t));
+			if (!chain->removed) {
+				return -ENOMEM;
+			}
+		}
+
+		if (removed && !(chain->removed[idx / 64] & mask)) {
+			chain->removed[idx / 64] |= mask;
+			table->removed_cnt++;
+		} else if (!removed && (chain->removed[idx / 64] & mask)) {
+			chain->removed[idx / 64] &= ~mask;
+			table->removed_cnt--;
+		}
+		return 0;
 	}
+
+	return -ENOENT;
 }
 
-size_t
-serialize_chunked_table_fn(FILE *fp, struct serializer *f, void *data)
+bool
+pw_chain_table_next_live_run(struct pw_chain_table *table, struct pw_chain_run *run)
 {
-	struct pw_chain_table *table = *(void **)data;
-	struct serializer *slzr;
+	if (!table) {
+		return false;
+	}
+
+	while (run->chain < table->chains_cnt) {
+		struct pw_chain_el *chain = table->chains[run->chain];
+
+		if (!chain->removed) {
+			run->start = run->end;
+			run->end = chain->count;
+		} else {
+			run->start = removed_bits_find(chain->removed, run->end, chain->count, false);
+			run->end = removed_bits_find(chain->removed, run->start, chain->count, true);
+		}
+
+		if (run->start < run->end) {
+			return true;
+		}
+
+		run->chain++;
+		run->start = run->end = 0;
+	}
+
+	return false;
+}
+
+void
+pw_chain_table_get_stats(struct pw_chain_table *table, struct pw_chain_table_stats *stats)
+{
+	struct pw_chain_run run = {};
+
+	memset(stats, 0, sizeof(*stats));
+	stats->size = pw_chain_table_size(table);
+	stats->removed = table->removed_cnt;
+	stats->live = stats->size - stats->removed;
+	stats->chains = table->chains_cnt;
+	for (unsigned c = 0; c < table->chains_cnt; c++) {
+		stats->capacity += table->chains[c]->capacity;
+	}
+
+	while (pw_chain_table_next_live_run(table, &run)) {
+		stats->live_runs++;
+	}
+}
+
+struct chain_parallel_ctx {
+	struct pw_chain_table *table;
+	chain_arr_el_fn fn;
+	void *ctx;
+	/* index of the first range in each chain, the total count at [chains_cnt] */
+	size_t first_range[PW_CHAIN_TABLE_MAX_CHAINS + 1];
+};
+
+static void
+chain_parallel_range_fn(void *arg, size_t range_idx)
+{
+	struct chain_parallel_ctx *pc = arg;
+	struct pw_chain_table *table = pc->table;
 	struct pw_chain_el *chain;
+	unsigned c = 0;
+	size_t i, start, end;
+	char *el;
+
+	while (pc->first_range[c + 1] <= range_idx) {
+		c++;
+	}
+
+	chain = table->chains[c];
+	start = (range_idx - pc->first_range[c]) * PW_CHAIN_TABLE_PARALLEL_CHUNK;
+	end = MIN(start + PW_CHAIN_TABLE_PARALLEL_CHUNK, chain->count);
+	el = chain->data + start * table->el_size;
+	for (i = start; i < end; i++) {
+		pc->fn(pc->ctx, el);
+		el += table->el_size;
+	}
+}
+
+void
+pw_chain_table_parallel_foreach(struct pw_chain_table *table, chain_arr_el_fn fn, void *ctx)
+{
+	struct chain_parallel_ctx pc = { .table = table, .fn = fn, .ctx = ctx };
 
 	if (!table) {
-		return PW_POINTER_BUF_SIZE;
+		return;
 	}
-	slzr = table->serializer;
-	chain = table->chain;
 
-	size_t ftell_begin = ftell(fp);
-	fprintf(fp, "\"%s\":[", f->name);
-	bool obj_printed = false;
-	while (chain) {
-		size_t i;
+	for (unsigned c = 0; c < table->chains_cnt; c++) {
+		size_t cnt = table->chains[c]->count;
 
-		for (i = 0; i < chain->count; i++) {
-			void *el = chain->data + i * table->el_size;
-			struct serializer *tmp_slzr = slzr;
-			size_t pos_begin = ftell(fp);
+		pc.first_range[c + 1] = pc.first_range[c] +
+				(cnt + PW_CHAIN_TABLE_PARALLEL_CHUNK - 1) / PW_CHAIN_TABLE_PARALLEL_CHUNK;
+	}
 
-			_serialize(fp, &tmp_slzr, &el, 1, true, false, true);
-			if (ftell(fp) > pos_begin) {
-				fprintf(fp, ",");
-				obj_printed = true;
-			}
-		}
+	pw_parallel_for(pc.first_range[table->chains_cnt], chain_parallel_range_fn, &pc);
+}
+
+void
+pw_chain_table_serialize_objs(struct pw_buf *buf, struct pw_chain_table *table,
+		bool newlines, const char *sep, size_t min_len)
+{
+	struct serialize_range ranges[PW_CHAIN_TABLE_MAX_CHAINS];
+	unsigned c;
+
+	for (c = 0; c < table->chains_cnt; c++) {
+		ranges[c].data = table->chains[c]->data;
+		ranges[c].cnt = table->chains[c]->count;
+	}
+
+	serialize_objs(buf, table->serializer, ranges, table->chains_cnt, true, newlines, sep, min_len);
+}
+
+size_t
+serialize_chunked_table_fn(struct pw_buf *buf, struct serializer *f, void *data)
+{
+	struct pw_chain_table *table = *(void **)data;
+	size_t pos_table_begin, pos_els_begin;
 
-		chain = chain->next;
+	if (!table) {
+		return PW_POINTER_BUF_SIZE;
 	}
 
-	if (!obj_printed) {
-		fseek(fp, ftell_begin, SEEK_SET);
+	pos_table_begin = pw_buf_mark(buf);
+	pw_buf_printf(buf, "\"%s\":[", f->name);
+	pos_els_begin = pw_buf_mark(buf);
+	pw_chain_table_serialize_objs(buf, table, false, ",", 0);
+
+	if (pw_buf_mark(buf) == pos_els_begin) {
+		pw_buf_rollback(buf, pos_table_begin);
 	} else {
 		/* override last comma */
-		fseek(fp, -1, SEEK_CUR);
-		fprintf(fp, "],");
+		pw_buf_rollback(buf, pw_buf_mark(buf) - 1);
+		pw_buf_write(buf, "],", 2);
 	}
 
 	return PW_POINTER_BUF_SIZE;
@@ -232,7 +509,7 @@ deserialize_chunked_table_fn(struct cjson *f, struct serializer *_slzr, void *da
 
 	if (!table) {
 		size_t el_size = serializer_get_size(slzr);
-		table = *(void **)data = pw_chain_table_alloc("", slzr, el_size, 8);
+		table = *(void **)data = pw_chain_table_alloc("", slzr, el_size, 8, t_des_arena);
 		fprintf(stderr, "allocated tbl at %p\n", table);
 		/* FIXME set new_el_fn in here */
 		if (!table) {
@@ -264,30 +541,14 @@ deserialize_chunked_table_fn(struct cjson *f, struct serializer *_slzr, void *da
 			assert(null_indices_start == -1);
 		}
 
-		void *el = NULL;
-		struct pw_chain_el *chain = table->chain;
-		unsigned remaining_idx = idx;
-
-		while (chain) {
-			if (remaining_idx < chain->count) {
-				/* the obj exists */
-				el = chain->data + remaining_idx * table->el_size;
-				break;
-			}
-
-			if (remaining_idx < chain->capacity) {
-				remaining_idx -= chain->count;
-				/* the obj doesn't exist, but memory for it is already allocated */
-				break;
-			}
-			assert(remaining_idx >= chain->count); /* technically possible if chain->cap == 0 */
-			remaining_idx -= chain->count;
-			chain = chain->next;
-		}
+		void *el = pw_chain_table_get(table, idx);
 
 		if (!el) {
+			unsigned remaining_idx = idx - pw_chain_table_size(table);
+
 			if (remaining_idx > 8) {
 				/* sane limit - the hole is too big */
+				json_el = json_el->next;
 				continue;
 			}
 
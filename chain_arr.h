@@ -14,14 +14,24 @@
 #include "serializer.h"
 #include "cjson.h"
 
+#define PW_CHAIN_TABLE_GROW_MIN 16
+#define PW_CHAIN_TABLE_MAX_CHAINS 32
+/* elements per pw_chain_table_parallel_foreach() job */
+#define PW_CHAIN_TABLE_PARALLEL_CHUNK 256
+
+struct pw_arena;
+
 struct pw_chain_el {
 	struct pw_chain_el *next;
 	size_t capacity;
 	size_t count;
+	/* bit per element, set if it's removed. NULL until anything is */
+	uint64_t *removed;
 	char data[0];
 };
 
 typedef void (*chain_arr_new_el_fn)(void *el, void *ctx);
+typedef void (*chain_arr_el_fn)(void *ctx, void *el);
 
 struct pw_chain_table {
 	/* just an associated string */
@@ -38,21 +48,98 @@ struct pw_chain_table {
 	/* first chain */
 	struct pw_chain_el *chain;
 	struct pw_chain_el *chain_last;
+	/* all chains in order. The first one has the initial capacity, the
+	 * following ones double in size starting at PW_CHAIN_TABLE_GROW_MIN.
+	 * All but the last are always full, so elements can be found by index */
+	struct pw_chain_el *chains[PW_CHAIN_TABLE_MAX_CHAINS];
+	unsigned chains_cnt;
+	/* where the chains come from, NULL for malloc */
+	struct pw_arena *arena;
+	/* elements marked with pw_chain_table_set_removed() */
+	size_t removed_cnt;
+};
+
+/* a range of live elements [start, end) in the chain at chains[chain] */
+struct pw_chain_run {
+	unsigned chain;
+	size_t start;
+	size_t end;
 };
 
-#define _CHAIN_TABLE _CUSTOM, serialize_chunked_table_fn, deserialize_chunked_table_fn
+struct pw_chain_table_stats {
+	size_t size;
+	size_t live;
+	size_t removed;
+	/* contiguous ranges of live elements, one per chain if nothing is removed */
+	size_t live_runs;
+	size_t capacity;
+	unsigned chains;
+};
+
+#define _CHAIN_TABLE _CUSTOM(PW_POINTER_BUF_SIZE), serialize_chunked_table_fn, deserialize_chunked_table_fn
 #define PW_CHAIN_TABLE_FOREACH(_var, _table) \
 	for (struct { struct pw_chain_el *chain; uint32_t i; } _pw_chain_internal = { (_table) ? (_table)->chain : NULL, 0 }; _pw_chain_internal.chain; _pw_chain_internal.chain = _pw_chain_internal.chain->next, _pw_chain_internal.i = 0) \
 	for ((_var) = (void *)_pw_chain_internal.chain->data; _pw_chain_internal.i < _pw_chain_internal.chain->count; (_var) += (_table)->el_size, _pw_chain_internal.i++)
+/* same as above, but skips the removed elements */
+#define PW_CHAIN_TABLE_FOREACH_LIVE(_var, _table) \
+	for (struct pw_chain_run _pw_run = {}; pw_chain_table_next_live_run((_table), &_pw_run); _pw_run.start = _pw_run.end) \
+	for ((_var) = (void *)((_table)->chains[_pw_run.chain]->data + _pw_run.start * (_table)->el_size); _pw_run.start < _pw_run.end; (_var) += (_table)->el_size, _pw_run.start++)
 
-int pw_chain_table_init(struct pw_chain_table *table, const char *name, struct serializer *serializer, size_t el_size, size_t count);
-struct pw_chain_table *pw_chain_table_alloc(const char *name, struct serializer *serializer, size_t el_size, size_t count);
-struct pw_chain_table *pw_chain_table_fread(FILE *fp, const char *name, size_t el_count, struct serializer *el_serializer);
+/**
+ * The arena is optional. If set, the table and all its chains are allocated
+ * from it and they're only freed together with the arena.
+ */
+int pw_chain_table_init(struct pw_chain_table *table, const char *name, struct serializer *serializer,
+		size_t el_size, size_t count, struct pw_arena *arena);
+struct pw_chain_table *pw_chain_table_alloc(const char *name, struct serializer *serializer, size_t el_size,
+		size_t count, struct pw_arena *arena);
+struct pw_chain_table *pw_chain_table_fread(FILE *fp, const char *name, size_t el_count, struct serializer *el_serializer,
+		struct pw_arena *arena);
+/**
+ * Read el_count elements into the empty first chain of the table with a
+ * single fread(). On disk each element takes rec_size bytes, which is el_size
+ * without a gap at gap_off. The gaps are zeroed. Returns the number of
+ * elements read in full.
+ */
+size_t pw_chain_table_fread_els(struct pw_chain_table *table, FILE *fp, size_t el_count, size_t rec_size, size_t gap_off);
 void *pw_chain_table_new_el(struct pw_chain_table *table);
+/* element at the given index or NULL, O(1) */
+void *pw_chain_table_get(struct pw_chain_table *table, size_t idx);
 uint32_t pw_chain_table_size(struct pw_chain_table *table);
 void pw_chain_table_truncate(struct pw_chain_table *table, uint32_t size);
 
-size_t serialize_chunked_table_fn(FILE *fp, struct serializer *f, void *data);
+/**
+ * Mark the element as removed or bring it back. The elements stay in place,
+ * but the removed ones can be skipped in bulk with pw_chain_table_next_live_run().
+ * Returns -ENOENT if the element isn't in the table.
+ */
+int pw_chain_table_set_removed(struct pw_chain_table *table, void *el, bool removed);
+/**
+ * Find the next run of live elements, starting at run->end in run->chain.
+ * A zero-initialized run starts at the beginning of the table. Returns false
+ * once there are no more.
+ */
+bool pw_chain_table_next_live_run(struct pw_chain_table *table, struct pw_chain_run *run);
+void pw_chain_table_get_stats(struct pw_chain_table *table, struct pw_chain_table_stats *stats);
+/**
+ * Call fn(ctx, el) for every element, same as PW_CHAIN_TABLE_FOREACH, but on
+ * pw_parallel_for() threads. Each chain is split into ranges of
+ * PW_CHAIN_TABLE_PARALLEL_CHUNK elements, so the split depends only on the
+ * table and not on the number of threads. fn must not add or remove elements.
+ */
+void pw_chain_table_parallel_foreach(struct pw_chain_table *table, chain_arr_el_fn fn, void *ctx);
+
+/**
+ * serialize_objs() over all elements of the table, skipping empty ones. Big
+ * tables are serialized in parallel.
+ */
+void pw_chain_table_serialize_objs(struct pw_buf *buf, struct pw_chain_table *table,
+		bool newlines, const char *sep, size_t min_len);
+
+/* arena for the nested tables that deserialize() creates on this thread, NULL for malloc */
+void pw_chain_table_set_des_arena(struct pw_arena *arena);
+
+size_t serialize_chunked_table_fn(struct pw_buf *buf, struct serializer *f, void *data);
 size_t deserialize_chunked_table_fn(struct cjson *f, struct serializer *_slzr, void *data);
 
 #endif /* PW_CHAIN_ARR_H */
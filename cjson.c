@@ -4,8 +4,10 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include "cjson_ext.h"
+#include "cjson_pow5.h"
 #include "common.h"
 
 static struct cjson g_null_json = {};
@@ -17,647 +19,2022 @@ struct cjson_mempool {
 	struct cjson obj[0];
 };
 
-static struct cjson *
-new_obj(struct cjson_mempool **mem_p)
-{
-	struct cjson_mempool *mem = *mem_p;
-	size_t num_items = mem->capacity * 2;
+struct cjson_arena {
+	struct cjson_mempool *head;
+	/* pages after this one are unused since the last reset */
+	struct cjson_mempool *cur;
+	/* created internally, to be freed together with the root object */
+	bool owned_by_root;
+	struct cjson_arena_stats stats;
+};
 
-	if (mem->count < mem->capacity) {
-		return &mem->obj[mem->count++];
-	}
+static struct cjson_mempool *
+new_pool(struct cjson_arena *arena, unsigned capacity)
+{
+	struct cjson_mempool *mem;
 
-	mem = calloc(1, sizeof(*mem) + num_items * sizeof(struct cjson));
+	/* objects are zeroed on allocation, not here */
+	mem = malloc(sizeof(*mem) + capacity * sizeof(struct cjson));
 	if (!mem) {
-		assert(false);
 		return NULL;
 	}
 
-	mem->capacity = num_items;
-	mem->count = 1;
+	mem->next = NULL;
+	mem->count = 0;
+	mem->capacity = capacity;
 
-	(*mem_p)->next = mem;
-	*mem_p = mem;
-	return &mem->obj[0];
+	arena->stats.pages++;
+	arena->stats.capacity += capacity * sizeof(struct cjson);
+	return mem;
 }
 
-static void
-cjson_clean_mem(struct cjson *json)
+struct cjson_arena *
+cjson_arena_init(size_t size)
 {
-	struct cjson_mempool *mem = json->mem;
-	json->a = NULL;
+	struct cjson_arena *arena;
+	unsigned capacity = (size + sizeof(struct cjson) - 1) / sizeof(struct cjson);
 
-	while (mem) {
-		mem->count = 0;
-		memset(mem->obj, 0, mem->capacity * sizeof(*mem->obj));
-		mem = mem->next;
+	arena = calloc(1, sizeof(*arena));
+	if (!arena) {
+		return NULL;
+	}
+
+	arena->head = arena->cur = new_pool(arena, MAX(capacity, CJSON_MIN_POOLSIZE));
+	if (!arena->head) {
+		free(arena);
+		return NULL;
 	}
+
+	return arena;
 }
 
 void
-cjson_free(struct cjson *json)
+cjson_arena_reset(struct cjson_arena *arena)
+{
+	arena->cur = arena->head;
+	arena->cur->count = 0;
+	arena->stats.used = 0;
+	arena->stats.resets++;
+}
+
+void
+cjson_arena_free(struct cjson_arena *arena)
 {
-	struct cjson_mempool *mem = json->mem;
+	struct cjson_mempool *mem = arena->head;
 
 	while (mem) {
-		struct cjson_mempool *next = mem;
+		struct cjson_mempool *next = mem->next;
 
-		next = mem->next;
 		free(mem);
 		mem = next;
 	}
+
+	free(arena);
+}
+
+void
+cjson_arena_get_stats(struct cjson_arena *arena, struct cjson_arena_stats *stats)
+{
+	*stats = arena->stats;
+}
+
+static struct cjson_arena *
+new_root_arena(void)
+{
+	struct cjson_arena *arena = cjson_arena_init(0);
+
+	if (!arena) {
+		assert(false);
+		return NULL;
+	}
+
+	arena->owned_by_root = true;
+	return arena;
+}
+
+/* allocate cnt consecutive zeroed objects */
+static struct cjson *
+new_objs(struct cjson_arena *arena, unsigned cnt)
+{
+	struct cjson_mempool *mem = arena->cur;
+	struct cjson *obj;
+
+	while (mem->count + cnt > mem->capacity && mem->next) {
+		mem = arena->cur = mem->next;
+		mem->count = 0;
+	}
+
+	if (mem->count + cnt > mem->capacity) {
+		mem->next = new_pool(arena, MAX(mem->capacity * 2, cnt));
+		if (!mem->next) {
+			assert(false);
+			return NULL;
+		}
+		mem = arena->cur = mem->next;
+	}
+
+	obj = &mem->obj[mem->count];
+	mem->count += cnt;
+	memset(obj, 0, cnt * sizeof(*obj));
+
+	arena->stats.allocs++;
+	arena->stats.used += cnt * sizeof(*obj);
+	arena->stats.high_water = MAX(arena->stats.high_water, arena->stats.used);
+	return obj;
+}
+
+static struct cjson *
+new_obj(struct cjson_arena *arena)
+{
+	return new_objs(arena, 1);
+}
+
+static void
+cjson_clean_mem(struct cjson *json)
+{
+	json->a = NULL;
+	json->a_last = NULL;
+	json->a_vec = NULL;
+	json->count = 0;
+	cjson_arena_reset(json->arena);
+}
+
+void
+cjson_free(struct cjson *json)
+{
+	if (json->arena && json->arena->owned_by_root) {
+		cjson_arena_free(json->arena);
+	}
 }
 
 int
 cjson_add_child(struct cjson *parent, struct cjson *child)
 {
-	struct cjson *last = parent->a;
-
 	if (!parent || (parent->type != CJSON_TYPE_OBJECT && parent->type != CJSON_TYPE_ARRAY)) {
 		assert(false);
 		return -EINVAL;
 	}
 
-	if (!last) {
+	assert(child->next == NULL);
+	child->next = NULL;
+	if (!parent->a) {
 		parent->a = child;
-		parent->count++;
-		assert(child->next == NULL);
-		child->next = NULL;
-		return 0;
+	} else {
+		parent->a_last->next = child;
 	}
 
-	while (last->next) last = last->next;
-	last->next = child;
-	assert(child->next == NULL);
-	child->next = NULL;
+	parent->a_last = child;
+	/* will be rebuilt on the next indexed access */
+	parent->a_vec = NULL;
 	parent->count++;
 	return 0;
 }
 
-struct cjson *
-cjson_parse(char *str)
+/* allocate memory from the same arena as the given json */
+static void *
+pool_alloc(struct cjson *json, size_t size)
 {
-	struct cjson_mempool *mem;
-	struct cjson *top_obj; 
-	struct cjson *cur_obj;
-	char *cur_key = NULL;
-	char *b = str;
-	bool need_comma = false;
+	struct cjson *root = json;
 
-	if (*b != '{' && *b != '[') {
-		return NULL;
+	while (root->parent) {
+		root = root->parent;
 	}
 
-	mem = calloc(1, sizeof(*mem) + CJSON_MIN_POOLSIZE * sizeof(struct cjson));
-	if (!mem) {
-		assert(false);
+	if (!root->arena) {
 		return NULL;
 	}
-	mem->capacity = CJSON_MIN_POOLSIZE;
 
-	top_obj = cur_obj = new_obj(&mem);
-	cur_obj->parent = NULL;
-	cur_obj->key = "";
-	cur_obj->type = *b == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
-	cur_obj->mem = mem;
-
-	/* we handled the root object/array separately, go on */
-	b++;
+	return new_objs(root->arena, (size + sizeof(struct cjson) - 1) / sizeof(struct cjson));
+}
 
-	while (*b) {
-		switch(*b) {
-			case '[':
-			case '{': {
-				struct cjson *obj;
+/* fill json->a_vec with pointers to all its children */
+static int
+build_child_vec(struct cjson *json)
+{
+	struct cjson *entry;
+	struct cjson **vec;
+	unsigned i = 0;
 
-				need_comma = false;
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	vec = pool_alloc(json, json->count * sizeof(*vec));
+	if (!vec) {
+		return -ENOMEM;
+	}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = *b == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
-				cur_obj = obj;
-				cur_key = NULL;
-				break;
-			}
-			case ']':
-			case '}': {
-				need_comma = true;
-				if (cur_key || (*b == ']' && cur_obj->type == CJSON_TYPE_OBJECT) ||
-				    (*b == '}' && cur_obj->type == CJSON_TYPE_ARRAY)) {
-					assert(false);
-					goto err;
-				}
+	entry = json->a;
+	while (entry) {
+		vec[i++] = entry;
+		entry = entry->next;
+	}
 
-				cur_obj = cur_obj->parent;
-				if (!cur_obj) {
-					return top_obj;
-				}
-				break;
-			}
-			case '"': {
-				char *start = ++b;
+	json->a_vec = vec;
+	return 0;
+}
 
-				while (*b && (*(b - 1) == '\\' || *b != '"')) b++;
-				if (*b == 0 || *(b + 1) == 0) {
-					goto err;
-				}
-				*b = 0;
+struct cjson_key_ent {
+	uint32_t hash;
+	struct cjson *obj;
+};
 
-				if (cur_key || cur_obj->type == CJSON_TYPE_ARRAY) {
-					struct cjson *obj = new_obj(&mem);
+static unsigned
+get_key_index_cap(unsigned count)
+{
+	unsigned cap = 16;
 
-					if (!obj) {
-						assert(false);
-						goto err;
-					}
-					obj->parent = cur_obj;
-					obj->key = cur_key;
-					obj->type = CJSON_TYPE_STRING;
-					obj->s = start;
-					if (cjson_add_child(cur_obj, obj) != 0) {
-						assert(false);
-						goto err;
-					}
+	while (cap < count * 2) {
+		cap <<= 1;
+	}
 
-					cur_key = NULL;
-					need_comma = true;
-				} else {
-					if (need_comma) {
-						assert(false);
-						goto err;
-					}
+	return cap;
+}
 
-					if (cur_obj->type != CJSON_TYPE_OBJECT) {
-						assert(false);
-						goto err;
-					}
+uint32_t
+cjson_key_hash(const char *key)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
 
-					cur_key = start;
-				}
-				break;
-			}
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-			case '-':
-			case '.':
-			{
-				struct cjson *obj;
-				char *end;
-
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
 
+	/* 0 is reserved for "not computed yet" */
+	return hash ? hash : 1;
+}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-
-				errno = 0;
-				obj->i = strtoll(b, &end, 0);
-				if (end == b || errno == ERANGE) {
-					assert(false);
-					goto err;
-				}
+/* fill json->a_keys with an open-addressing hash table of all its children.
+ * The entries are inserted in order, so a lookup finds the first one of
+ * duplicated keys, same as a linear search. */
+static int
+build_key_index(struct cjson *json)
+{
+	unsigned cap = get_key_index_cap(json->count);
+	struct cjson_key_ent *ents;
+	struct cjson *entry;
 
-				if (*end == '.' || *end == 'e' || *end == 'E') {
-					obj->d = strtod(b, &end);
-					if (end == b || errno == ERANGE) {
-						assert(false);
-						goto err;
-					}
-					obj->type = CJSON_TYPE_FLOAT;
-				} else {
-					obj->type = CJSON_TYPE_INTEGER;
-				}
+	ents = pool_alloc(json, cap * sizeof(*ents));
+	if (!ents) {
+		return -ENOMEM;
+	}
 
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+	entry = json->a;
+	while (entry) {
+		uint32_t hash = cjson_key_hash(entry->key);
+		unsigned i = hash & (cap - 1);
 
-				b = end - 1; /* will be incremented */
-				cur_key = NULL;
-				break;
-			}
-			case 't':
-			case 'f':
-			{
-				struct cjson *obj;
-				bool val;
-
-				/* truexyz will still match as true -> don't care */
-				if (strncmp(b, "true", 4) == 0) {
-					val = true;
-				} else if (strncmp(b, "false", 5) == 0) {
-					val = false;
-				} else {
-					break;
-				}
+		while (ents[i].obj) {
+			i = (i + 1) & (cap - 1);
+		}
+		ents[i].hash = hash;
+		ents[i].obj = entry;
+		entry = entry->next;
+	}
 
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	json->a_keys = ents;
+	return 0;
+}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->i = val;
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = CJSON_TYPE_BOOLEAN;
-
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+struct cjson_parser {
+	struct cjson_arena *arena;
+	struct cjson *top_obj;
+	struct cjson *cur_obj;
+	char *cur_key;
+	bool need_comma;
+	/* set only in the stream mode */
+	cjson_parse_arr_stream_cb obj_cb;
+	void *cb_ctx;
+	/* set only in the SAX mode, see cjson_sax_parse() */
+	const struct cjson_sax_ops *sax;
+	void *sax_ctx;
+	bool sax_stop;
+	unsigned sax_depth;
+	/* all containers handled by SAX, with their keys still null-terminated */
+	struct cjson sax_lvl[CJSON_SAX_MAX_DEPTH];
+	char *sax_lvl_key_end[CJSON_SAX_MAX_DEPTH];
+	/* the current scalar value and its key */
+	struct cjson sax_val;
+	char *sax_key_end;
+};
 
-				b += val ? 3 : 4; /* will be incremented */
-				cur_key = NULL;
-				break;
-			}
-			case 'n':
-			{
-				struct cjson *obj;
+/* we're in SAX mode and not inside a DOM subtree (which is then p->top_obj) */
+static inline bool
+parser_sax_level(struct cjson_parser *p)
+{
+	return p->sax && !p->top_obj;
+}
 
-				/* nullxyz will still match as true -> don't care */
-				if (strncmp(b, "null", 4) != 0) {
-					break;
-				}
+static struct cjson *
+parser_new_child(struct cjson_parser *p, uint32_t type)
+{
+	struct cjson *obj;
 
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	if (!p->cur_key && p->cur_obj->type != CJSON_TYPE_ARRAY) {
+		assert(false);
+		return NULL;
+	}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->i = 0;
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = CJSON_TYPE_NULL;
-
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+	if (parser_sax_level(p)) {
+		/* just a temporary object, see parser_sax_value() */
+		obj = &p->sax_val;
+		memset(obj, 0, sizeof(*obj));
+		obj->parent = p->cur_obj;
+		obj->key = p->cur_key;
+		obj->type = type;
+		p->cur_key = NULL;
+		return obj;
+	}
 
-				b += 3; /* will be incremented */
-				cur_key = NULL;
-				break;
-			}
-			case ',':
-				need_comma = false;
-				break;
-			case ':':
-			case ' ':
-			default:
-				break;
-		}
-		b++;
+	obj = new_obj(p->arena);
+	if (!obj) {
+		assert(false);
+		return NULL;
+	}
+	obj->parent = p->cur_obj;
+	obj->key = p->cur_key;
+	obj->type = type;
+	if (cjson_add_child(p->cur_obj, obj) != 0) {
+		assert(false);
+		return NULL;
 	}
 
-	return top_obj;
-err:
-	cjson_free(top_obj);
-	return NULL;
+	p->cur_key = NULL;
+	return obj;
 }
 
-int
-cjson_parse_arr_stream(char *str, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+/* restore the key's closing quote, it was overwritten with a null-terminator */
+static inline void
+parser_sax_restore_key(char **key_end)
 {
-	struct cjson_mempool *mem;
-	struct cjson top_obj = {0};
-	struct cjson *cur_obj;
-	char *cur_key = NULL;
-	char *b = str;
-	bool need_comma = false;
+	if (*key_end) {
+		**key_end = '"';
+		*key_end = NULL;
+	}
+}
 
-	if (*b == 0) {
+/**
+ * Pass a scalar value from parser_new_child() to the SAX callbacks, if that's
+ * where it came from. Returns 1 if the callback asked to stop parsing.
+ */
+static int
+parser_sax_value(struct cjson_parser *p, struct cjson *obj, char *str_end)
+{
+	int rc = 0;
+
+	if (obj != &p->sax_val) {
 		return 0;
 	}
 
-	if (*b != '[') {
-		return -EINVAL;
+	if (p->sax->value) {
+		rc = p->sax->value(p->sax_ctx, obj);
 	}
 
-	mem = calloc(1, sizeof(*mem) + CJSON_MIN_POOLSIZE * sizeof(struct cjson));
-	if (!mem) {
-		assert(false);
-		return -ENOMEM;
+	parser_sax_restore_key(&p->sax_key_end);
+	if (str_end) {
+		*str_end = '"';
 	}
-	mem->capacity = CJSON_MIN_POOLSIZE;
 
-	cur_obj = &top_obj;
-	cur_obj->parent = NULL;
-	cur_obj->key = "";
-	cur_obj->type = CJSON_TYPE_ARRAY;
-	cur_obj->mem = mem;
+	if (rc == CJSON_SAX_STOP) {
+		p->sax_stop = true;
+		return 1;
+	}
 
-	/* we handled the root object/array separately, go on */
-	b++;
+	return rc < 0 ? rc : 0;
+}
 
-	while (*b) {
-		switch(*b) {
-			case '[':
-			case '{': {
-				struct cjson *obj;
+static int
+parser_sax_open(struct cjson_parser *p, char c)
+{
+	struct cjson *lvl, *obj;
+	int rc = 0;
 
-				need_comma = false;
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	if (!p->cur_key && p->cur_obj->type != CJSON_TYPE_ARRAY) {
+		assert(false);
+		return -EFAULT;
+	}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = *b == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
-				cur_obj = obj;
-				cur_key = NULL;
-				break;
-			}
-			case ']':
-			case '}': {
-				need_comma = true;
-				if (cur_key || (*b == ']' && cur_obj->type == CJSON_TYPE_OBJECT) ||
-				    (*b == '}' && cur_obj->type == CJSON_TYPE_ARRAY)) {
-					assert(false);
-					goto err;
-				}
+	if (p->sax_depth == CJSON_SAX_MAX_DEPTH) {
+		assert(false);
+		return -E2BIG;
+	}
 
-				if (cur_obj->parent == &top_obj) {
-					obj_cb(cb_ctx, cur_obj);
-					cjson_clean_mem(&top_obj);
-					cur_obj = &top_obj;
-				} else {
-					cur_obj = cur_obj->parent;
-					if (!cur_obj) {
-						goto end;
-					}
-				}
-				break;
-			}
-			case '"': {
-				char *start = ++b;
+	lvl = &p->sax_lvl[p->sax_depth];
+	lvl->parent = p->cur_obj;
+	lvl->key = p->cur_key;
+	lvl->type = c == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
+	p->cur_key = NULL;
 
-				while (*b && (*(b - 1) == '\\' || *b != '"')) b++;
-				if (*b == 0 || *(b + 1) == 0) {
-					goto err;
-				}
-				*b = 0;
+	if (p->sax->open) {
+		rc = p->sax->open(p->sax_ctx, lvl);
+	}
 
-				if (cur_key || cur_obj->type == CJSON_TYPE_ARRAY) {
-					struct cjson *obj = new_obj(&mem);
+	if (rc == CJSON_SAX_DOM) {
+		if (!p->arena) {
+			p->arena = cjson_arena_init(0);
+			if (!p->arena) {
+				return -ENOMEM;
+			}
+			p->sax_lvl[0].arena = p->arena;
+		}
 
-					if (!obj) {
-						assert(false);
-						goto err;
-					}
-					obj->parent = cur_obj;
-					obj->key = cur_key;
-					obj->type = CJSON_TYPE_STRING;
-					obj->s = start;
-					if (cjson_add_child(cur_obj, obj) != 0) {
-						assert(false);
-						goto err;
-					}
+		/* the parent chain leads to sax_lvl[0], so pool_alloc() still works */
+		obj = new_obj(p->arena);
+		if (!obj) {
+			return -ENOMEM;
+		}
+		obj->parent = p->cur_obj;
+		obj->key = lvl->key;
+		obj->type = lvl->type;
+		p->top_obj = p->cur_obj = obj;
+		/* the key is restored once the subtree is closed */
+		p->sax_lvl_key_end[p->sax_depth] = p->sax_key_end;
+		p->sax_key_end = NULL;
+		return 0;
+	} else if (rc == CJSON_SAX_STOP) {
+		p->sax_stop = true;
+		return 1;
+	} else if (rc < 0) {
+		return rc;
+	}
 
-					cur_key = NULL;
-					need_comma = true;
-				} else {
-					if (need_comma) {
-						assert(false);
-						goto err;
-					}
+	p->sax_lvl_key_end[p->sax_depth] = p->sax_key_end;
+	p->sax_key_end = NULL;
+	p->sax_depth++;
+	p->cur_obj = lvl;
+	return 0;
+}
 
-					if (cur_obj->type != CJSON_TYPE_OBJECT) {
-						assert(false);
-						goto err;
-					}
+static int
+parser_sax_close(struct cjson_parser *p)
+{
+	struct cjson *cur_obj = p->cur_obj;
+	int rc = 0;
 
-					cur_key = start;
-				}
-				break;
-			}
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-			case '-':
-			case '.':
-			{
-				struct cjson *obj;
-				char *end;
-
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	if (cur_obj == p->top_obj) {
+		/* a DOM subtree was closed */
+		if (p->sax->value) {
+			rc = p->sax->value(p->sax_ctx, cur_obj);
+		}
+		parser_sax_restore_key(&p->sax_lvl_key_end[p->sax_depth]);
+		cjson_arena_reset(p->arena);
+		p->top_obj = NULL;
+	} else {
+		p->sax_depth--;
+		if (p->sax->close) {
+			rc = p->sax->close(p->sax_ctx, cur_obj);
+		}
+		parser_sax_restore_key(&p->sax_lvl_key_end[p->sax_depth]);
+	}
 
+	p->cur_obj = cur_obj->parent;
+	if (rc == CJSON_SAX_STOP) {
+		p->sax_stop = true;
+		return 1;
+	} else if (rc < 0) {
+		return rc;
+	}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-
-				errno = 0;
-				obj->i = strtoll(b, &end, 0);
-				if (end == b || errno == ERANGE) {
-					assert(false);
-					goto err;
-				}
+	return p->sax_depth == 0 ? 1 : 0;
+}
 
-				if (*end == '.' || *end == 'e' || *end == 'E') {
-					obj->d = strtod(b, &end);
-					if (end == b || errno == ERANGE) {
-						assert(false);
-						goto err;
-					}
-					obj->type = CJSON_TYPE_FLOAT;
-				} else {
-					obj->type = CJSON_TYPE_INTEGER;
-				}
+static int
+parser_open(struct cjson_parser *p, char c)
+{
+	struct cjson *obj;
 
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+	p->need_comma = false;
+	if (parser_sax_level(p)) {
+		return parser_sax_open(p, c);
+	}
 
-				b = end - 1; /* will be incremented */
-				cur_key = NULL;
-				break;
+	obj = parser_new_child(p, c == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY);
+	if (!obj) {
+		return -EFAULT;
+	}
+
+	p->cur_obj = obj;
+	return 0;
+}
+
+/* returns 1 when the top-level object was closed */
+static int
+parser_close(struct cjson_parser *p, char c)
+{
+	struct cjson *cur_obj = p->cur_obj;
+
+	p->need_comma = true;
+	if (p->cur_key || (c == ']' && cur_obj->type == CJSON_TYPE_OBJECT) ||
+	    (c == '}' && cur_obj->type == CJSON_TYPE_ARRAY)) {
+		assert(false);
+		return -EFAULT;
+	}
+
+	if (p->sax && (!p->top_obj || cur_obj == p->top_obj)) {
+		return parser_sax_close(p);
+	}
+
+	if (p->obj_cb && cur_obj->parent == p->top_obj) {
+		p->obj_cb(p->cb_ctx, cur_obj);
+		cjson_clean_mem(p->top_obj);
+		p->cur_obj = p->top_obj;
+		return 0;
+	}
+
+	p->cur_obj = cur_obj->parent;
+	return p->cur_obj ? 0 : 1;
+}
+
+/* start is already null-terminated */
+static int
+parser_string(struct cjson_parser *p, char *start, size_t len)
+{
+	if (p->cur_key || p->cur_obj->type == CJSON_TYPE_ARRAY) {
+		struct cjson *obj = parser_new_child(p, CJSON_TYPE_STRING);
+
+		if (!obj) {
+			return -EFAULT;
+		}
+		obj->s = start;
+		obj->s_len = len;
+		/* anything normalize_json_string() would change */
+		if (memchr(start, '\\', len) || memchr(start, 0xc2, len)) {
+			obj->flags |= CJSON_FLAG_RAW_STR;
+		}
+		p->need_comma = true;
+		return parser_sax_value(p, obj, start + len);
+	}
+
+	if (p->need_comma) {
+		assert(false);
+		return -EFAULT;
+	}
+
+	if (p->cur_obj->type != CJSON_TYPE_OBJECT) {
+		assert(false);
+		return -EFAULT;
+	}
+
+	p->cur_key = start;
+	if (parser_sax_level(p)) {
+		p->sax_key_end = start + len;
+	}
+	return 0;
+}
+
+#define IS_DIGIT(c) ((unsigned)((c) - '0') < 10)
+
+/**
+ * Eisel-Lemire: compute the correctly rounded double closest to w * 10^q,
+ * or return false if it can't be done exactly with 128-bit precision.
+ * See "Number Parsing at a Gigabyte per Second" by Daniel Lemire.
+ */
+static bool
+eisel_lemire(uint64_t w, int64_t q, double *out)
+{
+	const uint64_t *pow5;
+	unsigned __int128 prod;
+	uint64_t hi, lo, mantissa, bits;
+	int64_t power2;
+	int lz, upperbit;
+
+	if (w == 0) {
+		*out = 0;
+		return true;
+	}
+
+	/* let strtod() report the range error */
+	if (q < CJSON_POW5_MIN_Q || q > CJSON_POW5_MAX_Q) {
+		return false;
+	}
+
+	lz = __builtin_clzll(w);
+	w <<= lz;
+	pow5 = g_cjson_pow5[q - CJSON_POW5_MIN_Q];
+
+	/* we need 55 bits of precision: 52 explicit + 1 implicit + 2 for rounding */
+	prod = (unsigned __int128)w * pow5[0];
+	hi = prod >> 64;
+	lo = (uint64_t)prod;
+	if ((hi & 0x1FF) == 0x1FF) {
+		uint64_t hi2 = ((unsigned __int128)w * pow5[1]) >> 64;
+
+		lo += hi2;
+		if (hi2 > lo) {
+			hi++;
+		}
+	}
+
+	if (lo == UINT64_MAX && (q < -27 || q > 55)) {
+		return false;
+	}
+
+	upperbit = hi >> 63;
+	mantissa = hi >> (upperbit + 9);
+	/* floor(log2(10^q)) + 63 */
+	power2 = ((((152170 + 65536) * q) >> 16) + 63) + upperbit - lz + 1023;
+	if (power2 <= 0) {
+		/* subnormal, leave it to strtod() */
+		return false;
+	}
+
+	/* exactly halfway between two doubles, round to even */
+	if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+	    (mantissa << (upperbit + 9)) == hi) {
+		mantissa &= ~1ULL;
+	}
+
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >= (2ULL << 52)) {
+		mantissa = 1ULL << 52;
+		power2++;
+	}
+
+	mantissa &= ~(1ULL << 52);
+	if (power2 >= 0x7FF) {
+		return false;
+	}
+
+	bits = mantissa | ((uint64_t)power2 << 52);
+	memcpy(out, &bits, sizeof(*out));
+	return true;
+}
+
+static const double g_exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Parse a JSON number into obj->i or obj->d (setting CJSON_TYPE_FLOAT).
+ * Plain digit runs and most floats are handled without libc, anything
+ * unusual (hex, octal, too many digits, subnormals) goes through strtoll()
+ * and strtod() just like before. Returns the first unconsumed character
+ * or NULL on error.
+ */
+static char *
+parse_number(char *b, struct cjson *obj)
+{
+	char *p = b, *digits, *end;
+	bool neg = false;
+	uint64_t w = 0;
+	int sig_digits = 0;
+	int64_t exp = 0, frac_digits = 0;
+	double d;
+
+	if (*p == '-') {
+		neg = true;
+		p++;
+	}
+
+	/* a single zero is fine, but not a leading one (octal / hex) */
+	if (!IS_DIGIT(*p) || (*p == '0' && (IS_DIGIT(p[1]) || p[1] == 'x' || p[1] == 'X'))) {
+		goto slow;
+	}
+
+	digits = p;
+	while (IS_DIGIT(*p)) {
+		w = w * 10 + (*p - '0');
+		p++;
+	}
+
+	if (p - digits > 18) {
+		goto slow;
+	}
+
+	if (*p != '.' && *p != 'e' && *p != 'E') {
+		obj->i = neg ? -(int64_t)w : (int64_t)w;
+		return p;
+	}
+
+	/* leading zeros aren't significant */
+	sig_digits = w ? p - digits : 0;
+	if (*p == '.') {
+		p++;
+		digits = p;
+		while (IS_DIGIT(*p)) {
+			if (w || *p != '0') {
+				sig_digits++;
+			}
+			w = w * 10 + (*p - '0');
+			p++;
+		}
+
+		frac_digits = p - digits;
+		if (frac_digits == 0 || sig_digits > 19) {
+			goto slow;
+		}
+	}
+
+	if (*p == 'e' || *p == 'E') {
+		bool exp_neg = false;
+
+		p++;
+		if (*p == '-' || *p == '+') {
+			exp_neg = *p == '-';
+			p++;
+		}
+
+		if (!IS_DIGIT(*p)) {
+			goto slow;
+		}
+
+		while (IS_DIGIT(*p)) {
+			if (exp < 100000) {
+				exp = exp * 10 + (*p - '0');
+			}
+			p++;
+		}
+
+		if (exp_neg) {
+			exp = -exp;
+		}
+	}
+
+	exp -= frac_digits;
+	if (w <= (1ULL << 53) && exp >= -22 && exp <= 22) {
+		/* both w and 10^exp are exact doubles, so is the result */
+		d = exp < 0 ? w / g_exact_pow10[-exp] : w * g_exact_pow10[exp];
+	} else if (!eisel_lemire(w, exp, &d)) {
+		goto slow;
+	}
+
+	obj->d = neg ? -d : d;
+	obj->type = CJSON_TYPE_FLOAT;
+	return p;
+
+slow:
+	errno = 0;
+	obj->i = strtoll(b, &end, 0);
+	if (end == b || errno == ERANGE) {
+		return NULL;
+	}
+
+	if (*end == '.' || *end == 'e' || *end == 'E') {
+		obj->d = strtod(b, &end);
+		if (end == b || errno == ERANGE) {
+			return NULL;
+		}
+		obj->type = CJSON_TYPE_FLOAT;
+	}
+
+	return end;
+}
+
+/* returns the last character consumed or NULL on error (or when SAX callbacks asked to stop) */
+static char *
+parser_scalar(struct cjson_parser *p, char *b)
+{
+	struct cjson *obj;
+
+	switch (*b) {
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case '-':
+		case '.':
+		{
+			char *end;
+
+			obj = parser_new_child(p, CJSON_TYPE_INTEGER);
+			if (!obj) {
+				return NULL;
+			}
+
+			end = parse_number(b, obj);
+			if (!end) {
+				assert(false);
+				return NULL;
+			}
+
+			if (parser_sax_value(p, obj, NULL) != 0) {
+				return NULL;
+			}
+
+			return end - 1;
+		}
+		case 't':
+		case 'f':
+		{
+			bool val;
+
+			/* truexyz will still match as true -> don't care */
+			if (strncmp(b, "true", 4) == 0) {
+				val = true;
+			} else if (strncmp(b, "false", 5) == 0) {
+				val = false;
+			} else {
+				return b;
+			}
+
+			obj = parser_new_child(p, CJSON_TYPE_BOOLEAN);
+			if (!obj) {
+				return NULL;
+			}
+			obj->i = val;
+			if (parser_sax_value(p, obj, NULL) != 0) {
+				return NULL;
+			}
+			return b + (val ? 3 : 4);
+		}
+		case 'n':
+		{
+			/* nullxyz will still match as true -> don't care */
+			if (strncmp(b, "null", 4) != 0) {
+				return b;
+			}
+
+			obj = parser_new_child(p, CJSON_TYPE_NULL);
+			if (!obj) {
+				return NULL;
+			}
+			obj->i = 0;
+			if (parser_sax_value(p, obj, NULL) != 0) {
+				return NULL;
 			}
-			case 't':
-			case 'f':
-			{
-				struct cjson *obj;
-				bool val;
-
-				/* truexyz will still match as true -> don't care */
-				if (strncmp(b, "true", 4) == 0) {
-					val = true;
-				} else if (strncmp(b, "false", 5) == 0) {
-					val = false;
-				} else {
+			return b + 3;
+		}
+		default:
+			return b;
+	}
+}
+
+/**
+ * The original byte-by-byte parser. Returns 1 if the top-level object was
+ * closed, 0 if the string ended before that, or a negative errno.
+ * *b_p is set to the last processed character.
+ */
+static int
+parse_scalar_loop(struct cjson_parser *p, char **b_p)
+{
+	char *b = *b_p;
+	int rc = 0;
+
+	while (*b) {
+		switch(*b) {
+			case '[':
+			case '{':
+				rc = parser_open(p, *b);
+				break;
+			case ']':
+			case '}':
+				rc = parser_close(p, *b);
+				break;
+			case '"': {
+				char *start = ++b;
+
+				/* skip escaped characters, so \\ doesn't escape the quote */
+				while (*b && *b != '"') {
+					if (*b == '\\' && *(b + 1)) {
+						b++;
+					}
+					b++;
+				}
+				if (*b == 0 || *(b + 1) == 0) {
+					rc = -EFAULT;
+					break;
+				}
+				*b = 0;
+
+				rc = parser_string(p, start, b - start);
+				break;
+			}
+			case ',':
+				p->need_comma = false;
+				break;
+			case ':':
+			case ' ':
+				break;
+			default: {
+				char *end = parser_scalar(p, b);
+
+				if (!end) {
+					rc = p->sax_stop ? 1 : -EFAULT;
 					break;
 				}
+				b = end;
+				break;
+			}
+		}
+
+		if (rc != 0) {
+			break;
+		}
+		b++;
+	}
+
+	*b_p = b;
+	return rc;
+}
+
+/**
+ * Two-stage parsing. The first stage classifies the input 64 bytes at a time
+ * (with SSE2/AVX2 when available) and produces an index of all structural
+ * characters, unescaped quotes, and the first characters of scalar values
+ * outside of strings. The second stage walks that index instead of every
+ * single byte. The index is filled lazily in CJSON_INDEX_BLOCK chunks, so
+ * the input length doesn't need to be known upfront.
+ */
+#define CJSON_INDEX_BLOCK 16384
+
+struct cjson_chunk_masks {
+	uint64_t quote;
+	uint64_t bslash;
+	uint64_t op;
+	uint64_t ws;
+};
+
+typedef void (*cjson_classify_fn)(const char *in, struct cjson_chunk_masks *m);
+
+struct cjson_index {
+	const char *base;
+	size_t scanned;
+	bool eof;
+	uint64_t prev_escaped;
+	uint64_t prev_in_string;
+	uint64_t prev_scalar;
+	cjson_classify_fn classify;
+	uint32_t count;
+	uint32_t cur;
+	uint32_t pos[CJSON_INDEX_BLOCK];
+};
+
+static void
+classify_chunk_generic(const char *in, struct cjson_chunk_masks *m)
+{
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < 64; i++) {
+		uint64_t bit = 1ULL << i;
+
+		switch (in[i]) {
+			case '"':
+				m->quote |= bit;
+				break;
+			case '\\':
+				m->bslash |= bit;
+				break;
+			case '{':
+			case '}':
+			case '[':
+			case ']':
+			case ':':
+			case ',':
+				m->op |= bit;
+				break;
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+				m->ws |= bit;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void
+classify_chunk_sse2(const char *in, struct cjson_chunk_masks *m)
+{
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < 4; i++) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i * 16));
+		/* '[' | 0x20 == '{', ']' | 0x20 == '}' */
+		__m128i v_lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i op, ws;
+
+		op = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v_lower, _mm_set1_epi8('{')),
+				     _mm_cmpeq_epi8(v_lower, _mm_set1_epi8('}'))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+		ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+		m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << (i * 16);
+		m->bslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << (i * 16);
+		m->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << (i * 16);
+		m->ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << (i * 16);
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+classify_chunk_avx2(const char *in, struct cjson_chunk_masks *m)
+{
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < 2; i++) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i * 32));
+		__m256i v_lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i op, ws;
+
+		op = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v_lower, _mm256_set1_epi8('{')),
+					_mm256_cmpeq_epi8(v_lower, _mm256_set1_epi8('}'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+		ws = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+
+		m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << (i * 32);
+		m->bslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << (i * 32);
+		m->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << (i * 32);
+		m->ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (i * 32);
+	}
+}
+#endif
+
+static int g_parse_mode = CJSON_PARSE_AUTO;
+
+void
+cjson_set_parse_mode(int mode)
+{
+	g_parse_mode = mode;
+}
+
+static cjson_classify_fn
+get_classify_fn(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	switch (g_parse_mode) {
+		case CJSON_PARSE_SCALAR:
+			return NULL;
+		case CJSON_PARSE_SSE2:
+			return __builtin_cpu_supports("sse2") ? classify_chunk_sse2 : classify_chunk_generic;
+		case CJSON_PARSE_AVX2:
+			return __builtin_cpu_supports("avx2") ? classify_chunk_avx2 : classify_chunk_generic;
+		default:
+			if (__builtin_cpu_supports("avx2")) {
+				return classify_chunk_avx2;
+			} else if (__builtin_cpu_supports("sse2")) {
+				return classify_chunk_sse2;
+			}
+			return classify_chunk_generic;
+	}
+#else
+	return g_parse_mode == CJSON_PARSE_SCALAR ? NULL : classify_chunk_generic;
+#endif
+}
+
+/* returns a mask of characters escaped by a preceding odd-length sequence
+ * of backslashes; the state is carried between chunks in *prev_escaped */
+static inline uint64_t
+find_escaped(uint64_t bslash, uint64_t *prev_escaped)
+{
+	const uint64_t even_bits = 0x5555555555555555ULL;
+	uint64_t follows_escape, odd_seq_starts, seq_on_even, invert_mask;
+
+	bslash &= ~*prev_escaped;
+	follows_escape = bslash << 1 | *prev_escaped;
+	odd_seq_starts = bslash & ~even_bits & ~follows_escape;
+	*prev_escaped = __builtin_add_overflow(odd_seq_starts, bslash, &seq_on_even);
+	invert_mask = seq_on_even << 1;
+	return (even_bits ^ invert_mask) & follows_escape;
+}
+
+static inline uint64_t
+prefix_xor(uint64_t m)
+{
+	m ^= m << 1;
+	m ^= m << 2;
+	m ^= m << 4;
+	m ^= m << 8;
+	m ^= m << 16;
+	m ^= m << 32;
+	return m;
+}
+
+static void
+index_chunk(struct cjson_index *idx, const char *in, uint32_t off)
+{
+	struct cjson_chunk_masks m;
+	uint64_t quote, in_string, scalar, bits;
+
+	idx->classify(in, &m);
+
+	quote = m.quote & ~find_escaped(m.bslash, &idx->prev_escaped);
+	/* covers the opening quote and the string contents, but not the closing quote */
+	in_string = prefix_xor(quote) ^ idx->prev_in_string;
+	idx->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+	scalar = ~(m.op | m.ws | quote | in_string);
+	bits = (m.op & ~in_string) | quote | (scalar & ~(scalar << 1 | idx->prev_scalar));
+	idx->prev_scalar = scalar >> 63;
+
+	while (bits) {
+		idx->pos[idx->count++] = off + __builtin_ctzll(bits);
+		bits &= bits - 1;
+	}
+}
+
+static void
+index_fill(struct cjson_index *idx)
+{
+	const char *in = idx->base + idx->scanned;
+	size_t len = strnlen(in, CJSON_INDEX_BLOCK);
+	size_t off;
+
+	idx->count = idx->cur = 0;
+	for (off = 0; off + 64 <= len; off += 64) {
+		index_chunk(idx, in + off, idx->scanned + off);
+	}
+
+	if (off < len) {
+		char tmp[64];
+
+		/* pad with whitespace, which never gets indexed */
+		memset(tmp, ' ', sizeof(tmp));
+		memcpy(tmp, in + off, len - off);
+		index_chunk(idx, tmp, idx->scanned + off);
+	}
+
+	idx->scanned += len;
+	if (len < CJSON_INDEX_BLOCK) {
+		idx->eof = true;
+	}
+}
+
+static bool
+index_next(struct cjson_index *idx, uint32_t *pos)
+{
+	while (idx->cur == idx->count) {
+		if (idx->eof) {
+			return false;
+		}
+		index_fill(idx);
+	}
+
+	*pos = idx->pos[idx->cur++];
+	return true;
+}
+
+static void
+index_init(struct cjson_index *idx, const char *str, cjson_classify_fn classify)
+{
+	idx->base = str;
+	idx->scanned = 0;
+	idx->eof = false;
+	idx->prev_escaped = idx->prev_in_string = idx->prev_scalar = 0;
+	idx->classify = classify;
+	idx->count = idx->cur = 0;
+}
+
+/**
+ * Same semantics as parse_scalar_loop(), but driven by the structural index.
+ * Strings are delimited by the next indexed quote, so they're never scanned
+ * byte by byte.
+ */
+static int
+parse_indexed_loop(struct cjson_parser *p, struct cjson_index *idx, char *str, char **b_p)
+{
+	uint32_t pos, end_pos;
+	char *b = *b_p;
+	int rc = 0;
+
+	while (index_next(idx, &pos)) {
+		b = str + pos;
+		switch(*b) {
+			case '[':
+			case '{':
+				rc = parser_open(p, *b);
+				break;
+			case ']':
+			case '}':
+				rc = parser_close(p, *b);
+				break;
+			case '"':
+				if (!index_next(idx, &end_pos) || str[end_pos + 1] == 0) {
+					rc = -EFAULT;
+					break;
+				}
+				str[end_pos] = 0;
+
+				rc = parser_string(p, b + 1, end_pos - pos - 1);
+				break;
+			case ',':
+				p->need_comma = false;
+				break;
+			case ':':
+				break;
+			default:
+				if (!parser_scalar(p, b)) {
+					rc = p->sax_stop ? 1 : -EFAULT;
+				}
+				break;
+		}
+
+		if (rc != 0) {
+			*b_p = b;
+			return rc;
+		}
+	}
+
+	*b_p = str + idx->scanned;
+	return 0;
+}
+
+/* idx may be NULL, then the byte-by-byte parser is used */
+static int
+parse_with_index(struct cjson_parser *p, struct cjson_index *idx, char *str, char **b_p)
+{
+	if (!idx) {
+		return parse_scalar_loop(p, b_p);
+	}
+
+	index_init(idx, str, idx->classify);
+	/* the caller might have already handled some characters */
+	idx->scanned = *b_p - str;
+	return parse_indexed_loop(p, idx, str, b_p);
+}
+
+static struct cjson_index *
+index_alloc(void)
+{
+	cjson_classify_fn classify = get_classify_fn();
+	struct cjson_index *idx;
+
+	if (!classify) {
+		return NULL;
+	}
+
+	idx = malloc(sizeof(*idx));
+	if (!idx) {
+		return NULL;
+	}
+
+	idx->classify = classify;
+	return idx;
+}
+
+static int
+parse(struct cjson_parser *p, char *str, char **b_p)
+{
+	struct cjson_index *idx = index_alloc();
+	int rc;
+
+	rc = parse_with_index(p, idx, str, b_p);
+	free(idx);
+	return rc;
+}
+
+struct cjson *
+cjson_parse(char *str)
+{
+	struct cjson_arena *arena;
+	struct cjson_parser p = {};
+	char *b = str;
+	int rc;
+
+	if (*b != '{' && *b != '[') {
+		return NULL;
+	}
+
+	arena = new_root_arena();
+	if (!arena) {
+		return NULL;
+	}
+
+	p.arena = arena;
+	p.top_obj = p.cur_obj = new_obj(arena);
+	p.top_obj->parent = NULL;
+	p.top_obj->key = "";
+	p.top_obj->type = *b == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
+	p.top_obj->arena = arena;
+
+	/* we handled the root object/array separately, go on */
+	b++;
+
+	rc = parse(&p, str, &b);
+	if (rc < 0) {
+		cjson_free(p.top_obj);
+		return NULL;
+	}
+
+	return p.top_obj;
+}
+
+struct cjson_index *
+cjson_index_alloc(void)
+{
+	return index_alloc();
+}
+
+void
+cjson_index_free(struct cjson_index *idx)
+{
+	free(idx);
+}
+
+int
+cjson_sax_parse(char *str, struct cjson_arena *arena, const struct cjson_sax_ops *ops, void *ctx,
+		struct cjson_index *idx)
+{
+	struct cjson_parser p = {};
+	struct cjson *root;
+	char *b = str;
+	unsigned i;
+	int rc;
+
+	if (*b != '{' && *b != '[') {
+		return -EINVAL;
+	}
+
+	p.arena = arena;
+	p.sax = ops;
+	p.sax_ctx = ctx;
+
+	root = &p.sax_lvl[0];
+	root->parent = NULL;
+	root->key = NULL;
+	root->type = *b == '{' ? CJSON_TYPE_OBJECT : CJSON_TYPE_ARRAY;
+	root->arena = arena;
+
+	rc = ops->open ? ops->open(ctx, root) : 0;
+	if (rc == CJSON_SAX_DOM) {
+		/* use cjson_parse() instead */
+		rc = -EINVAL;
+	}
+
+	if (rc == 0) {
+		p.sax_depth = 1;
+		p.cur_obj = root;
+		b++;
+		rc = idx ? parse_with_index(&p, idx, str, &b) : parse(&p, str, &b);
+		if (rc == 0) {
+			/* the input ended too early */
+			rc = -EFAULT;
+		}
+	}
+
+	/* put back the quotes if we didn't get to the end */
+	for (i = 0; i <= p.sax_depth && i < CJSON_SAX_MAX_DEPTH; i++) {
+		parser_sax_restore_key(&p.sax_lvl_key_end[i]);
+	}
+	parser_sax_restore_key(&p.sax_key_end);
+
+	if (p.arena && p.arena != arena) {
+		cjson_arena_free(p.arena);
+	}
+	return rc < 0 ? rc : 0;
+}
+
+int
+cjson_parse_arr_stream_arena(char *str, struct cjson_arena *arena,
+		cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson top_obj = {0};
+	struct cjson_parser p = {};
+	char *b = str;
+	int rc;
+
+	if (*b == 0) {
+		return 0;
+	}
+
+	if (*b != '[') {
+		return -EINVAL;
+	}
+
+	cjson_arena_reset(arena);
+
+	top_obj.parent = NULL;
+	top_obj.key = "";
+	top_obj.type = CJSON_TYPE_ARRAY;
+	top_obj.arena = arena;
+
+	p.arena = arena;
+	p.top_obj = p.cur_obj = &top_obj;
+	p.obj_cb = obj_cb;
+	p.cb_ctx = cb_ctx;
+
+	/* we handled the root object/array separately, go on */
+	b++;
+
+	rc = parse(&p, str, &b);
+	if (rc < 0) {
+		return -EFAULT;
+	}
+
+	return (int)(b - str + 1);
+}
+
+int
+cjson_parse_arr_stream(char *str, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson_arena *arena;
+	int rc;
+
+	if (*str == 0) {
+		return 0;
+	}
+
+	arena = cjson_arena_init(0);
+	if (!arena) {
+		assert(false);
+		return -ENOMEM;
+	}
+
+	rc = cjson_parse_arr_stream_arena(str, arena, obj_cb, cb_ctx);
+	cjson_arena_free(arena);
+	return rc;
+}
+
+/* finds where the top-level array elements start and end */
+struct cjson_arr_scanner {
+	size_t el_start;
+	unsigned depth;
+	bool in_string;
+	bool escaped;
+};
+
+/**
+ * Process the next input character c at position pos. Anything outside of
+ * the top-level arrays is skipped. Returns 1 if c closed a top-level array
+ * element starting at s->el_start, 0 otherwise, or -EINVAL on invalid input.
+ */
+static inline int
+arr_scan_char(struct cjson_arr_scanner *s, char c, size_t pos)
+{
+	if (s->in_string) {
+		if (s->escaped) {
+			s->escaped = false;
+		} else if (c == '\\') {
+			s->escaped = true;
+		} else if (c == '"') {
+			s->in_string = false;
+		}
+		return 0;
+	}
+
+	if (s->depth == 0) {
+		if (c == '[') {
+			s->depth++;
+		} else if (c == '{') {
+			return -EINVAL;
+		}
+		return 0;
+	}
+
+	switch (c) {
+		case '"':
+			s->in_string = true;
+			break;
+		case '[':
+		case '{':
+			if (s->depth == 1) {
+				s->el_start = pos;
+			}
+			s->depth++;
+			break;
+		case ']':
+		case '}':
+			s->depth--;
+			if (s->depth == 1) {
+				return 1;
+			}
+			break;
+		default:
+			break;
+	}
+
+	return 0;
+}
+
+/**
+ * The feed parser buffers just the currently incomplete top-level array
+ * element. Incoming bytes are scanned only for nesting depth and string
+ * boundaries, and each element is parsed in-place once its closing bracket
+ * arrives, then discarded together with its cjson objects.
+ */
+#define CJSON_FEED_CHUNK 65536
+
+struct cjson_feed {
+	struct cjson_parser p;
+	struct cjson top_obj;
+	struct cjson_index *idx;
+	char *buf;
+	size_t len;
+	size_t cap;
+	/* bytes already checked by the scanner */
+	size_t scanned;
+	struct cjson_arr_scanner scan;
+	cjson_feed_el_cb el_cb;
+	void *el_ctx;
+	int err;
+};
+
+struct cjson_feed *
+cjson_feed_init(struct cjson_arena *arena, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson_feed *f;
+
+	f = calloc(1, sizeof(*f));
+	if (!f) {
+		return NULL;
+	}
+
+	if (!arena) {
+		arena = new_root_arena();
+		if (!arena) {
+			free(f);
+			return NULL;
+		}
+	}
+
+	cjson_arena_reset(arena);
+
+	f->top_obj.parent = NULL;
+	f->top_obj.key = "";
+	f->top_obj.type = CJSON_TYPE_ARRAY;
+	f->top_obj.arena = arena;
+
+	f->p.arena = arena;
+	f->p.top_obj = f->p.cur_obj = &f->top_obj;
+	f->p.obj_cb = obj_cb;
+	f->p.cb_ctx = cb_ctx;
+
+	/* might be NULL, then we'll use the scalar parser */
+	f->idx = index_alloc();
+	return f;
+}
+
+void
+cjson_feed_set_el_cb(struct cjson_feed *f, cjson_feed_el_cb el_cb, void *el_ctx)
+{
+	f->el_cb = el_cb;
+	f->el_ctx = el_ctx;
+}
+
+void
+cjson_feed_free(struct cjson_feed *f)
+{
+	cjson_free(&f->top_obj);
+	free(f->idx);
+	free(f->buf);
+	free(f);
+}
+
+/* parse a single top-level array element at buf[start..end] */
+static int
+feed_parse_el(struct cjson_feed *f, size_t start, size_t end)
+{
+	char *str = f->buf + start;
+	char *b = str;
+	char saved;
+	int rc;
+
+	/* there's always room for one more byte */
+	saved = f->buf[end + 1];
+	f->buf[end + 1] = 0;
+
+	if (f->el_cb) {
+		rc = f->el_cb(f->el_ctx, str, end + 1 - start);
+		if (rc <= 0) {
+			f->buf[end + 1] = saved;
+			return rc;
+		}
+	}
+
+	f->p.cur_obj = &f->top_obj;
+	f->p.cur_key = NULL;
+	f->p.need_comma = false;
+	rc = parse_with_index(&f->p, f->idx, str, &b);
+
+	f->buf[end + 1] = saved;
+	if (rc < 0 || f->p.cur_obj != &f->top_obj) {
+		assert(false);
+		return -EFAULT;
+	}
 
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	return 0;
+}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->i = val;
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = CJSON_TYPE_BOOLEAN;
-
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+static int
+feed_scan(struct cjson_feed *f)
+{
+	int rc;
 
-				b += val ? 3 : 4; /* will be incremented */
-				cur_key = NULL;
-				break;
-			}
-			case 'n':
-			{
-				struct cjson *obj;
+	for (; f->scanned < f->len; f->scanned++) {
+		rc = arr_scan_char(&f->scan, f->buf[f->scanned], f->scanned);
+		if (rc == 1) {
+			rc = feed_parse_el(f, f->scan.el_start, f->scanned);
+		}
 
-				/* nullxyz will still match as true -> don't care */
-				if (strncmp(b, "null", 4) != 0) {
-					break;
-				}
+		if (rc != 0) {
+			return rc;
+		}
+	}
 
-				if (!cur_key && cur_obj->type != CJSON_TYPE_ARRAY) {
-					assert(false);
-					goto err;
-				}
+	return 0;
+}
 
-				obj = new_obj(&mem);
-				if (!obj) {
-					assert(false);
-					goto err;
-				}
-				obj->i = 0;
-				obj->parent = cur_obj;
-				obj->key = cur_key;
-				obj->type = CJSON_TYPE_NULL;
-
-				if (cjson_add_child(cur_obj, obj) != 0) {
-					assert(false);
-					goto err;
-				}
+int
+cjson_feed(struct cjson_feed *f, const char *data, size_t len)
+{
+	size_t keep_from;
 
-				b += 3; /* will be incremented */
-				cur_key = NULL;
-				break;
+	if (f->err) {
+		return f->err;
+	}
+
+	/* drop everything that was already parsed */
+	keep_from = f->scan.depth > 1 ? f->scan.el_start : f->scanned;
+	if (keep_from > 0) {
+		memmove(f->buf, f->buf + keep_from, f->len - keep_from);
+		f->len -= keep_from;
+		f->scanned -= keep_from;
+		f->scan.el_start -= MIN(f->scan.el_start, keep_from);
+	}
+
+	if (f->len + len + 1 > f->cap) {
+		size_t cap = MAX(f->cap * 2, f->len + len + 1);
+		char *buf = realloc(f->buf, cap);
+
+		if (!buf) {
+			f->err = -ENOMEM;
+			return f->err;
+		}
+		f->buf = buf;
+		f->cap = cap;
+	}
+
+	memcpy(f->buf + f->len, data, len);
+	f->len += len;
+
+	f->err = feed_scan(f);
+	return f->err;
+}
+
+int
+cjson_feed_finish(struct cjson_feed *f)
+{
+	if (f->err) {
+		return f->err;
+	}
+
+	if (f->scan.depth != 0 || f->scan.in_string) {
+		PWLOG(LOG_ERROR, "truncated input\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+int
+cjson_feed_file(struct cjson_feed *f, FILE *fp)
+{
+	char *buf;
+	size_t len;
+	int rc = 0;
+
+	buf = malloc(CJSON_FEED_CHUNK);
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	while ((len = fread(buf, 1, CJSON_FEED_CHUNK, fp)) > 0) {
+		rc = cjson_feed(f, buf, len);
+		if (rc != 0) {
+			break;
+		}
+	}
+
+	if (rc == 0 && ferror(fp)) {
+		rc = -EIO;
+	}
+
+	if (rc == 0) {
+		rc = cjson_feed_finish(f);
+	}
+
+	free(buf);
+	return rc;
+}
+
+int
+cjson_feed_fp(FILE *fp, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson_feed *f;
+	int rc;
+
+	f = cjson_feed_init(NULL, obj_cb, cb_ctx);
+	if (!f) {
+		return -ENOMEM;
+	}
+
+	rc = cjson_feed_file(f, fp);
+	cjson_feed_free(f);
+	return rc;
+}
+
+int
+cjson_feed_fd(int fd, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson_feed *f;
+	char *buf;
+	ssize_t len;
+	int rc = 0;
+
+	f = cjson_feed_init(NULL, obj_cb, cb_ctx);
+	buf = malloc(CJSON_FEED_CHUNK);
+	if (!f || !buf) {
+		if (f) {
+			cjson_feed_free(f);
+		}
+		free(buf);
+		return -ENOMEM;
+	}
+
+	while ((len = read(fd, buf, CJSON_FEED_CHUNK)) != 0) {
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
 			}
-			case ',':
-				need_comma = false;
-				break;
-			case ':':
-			case ' ':
-			default:
-				break;
+			rc = -errno;
+			break;
+		}
+
+		rc = cjson_feed(f, buf, len);
+		if (rc != 0) {
+			break;
 		}
-		b++;
 	}
 
-end:
-	cjson_free(&top_obj);
-	return (int)(b - str + 1);
-err:
-	cjson_free(&top_obj);
-	return -EFAULT;
+	if (rc == 0) {
+		rc = cjson_feed_finish(f);
+	}
+
+	free(buf);
+	cjson_feed_free(f);
+	return rc;
 }
 
-struct cjson *
-cjson_obj(struct cjson *json, const char *key)
+/**
+ * Parallel version of the stream parser. Element boundaries are found with
+ * the feed scanner first, then batches of elements are parsed into separate
+ * DOMs on pw_parallel_for() workers. The callback is still called on the
+ * calling thread, strictly in the input order.
+ */
+#define CJSON_PAR_BATCH 256
+
+struct cjson_par_el {
+	char *str;
+	size_t len;
+	char saved;
+	struct cjson_arena *arena;
+	/* fake parent array, same as in the stream parser */
+	struct cjson *top;
+	int rc;
+};
+
+static void
+parse_par_el(void *ctx, size_t i)
 {
-	struct cjson *entry = json->a;
+	struct cjson_par_el *el = (struct cjson_par_el *)ctx + i;
+	struct cjson_parser p = {};
+	char *b = el->str;
+
+	el->arena = cjson_arena_init(el->len);
+	if (!el->arena) {
+		el->rc = -ENOMEM;
+		return;
+	}
 
-	if (json->type == CJSON_TYPE_ARRAY) {
-		char *end;
-		uint64_t i;
+	el->top = new_obj(el->arena);
+	if (!el->top) {
+		el->rc = -ENOMEM;
+		return;
+	}
+	el->top->key = "";
+	el->top->type = CJSON_TYPE_ARRAY;
+	el->top->arena = el->arena;
+
+	p.arena = el->arena;
+	p.top_obj = p.cur_obj = el->top;
+	el->rc = parse(&p, el->str, &b);
+	if (el->rc == 0 && (p.cur_obj != el->top || el->top->count != 1)) {
+		el->rc = -EFAULT;
+	}
+}
 
-		/* this can't be an address */
-		if ((uintptr_t)key < 65536) {
-			i = (uintptr_t)key;
-		} else {
-			errno = 0;
-			i = strtoll(key, &end, 0);
-			if (end == key || errno == ERANGE) {
-				return &g_null_json;
+static int
+parse_par_batch(struct cjson_par_el *els, size_t cnt,
+		cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	size_t i;
+	int rc = 0;
+
+	for (i = 0; i < cnt; i++) {
+		els[i].saved = els[i].str[els[i].len];
+		els[i].str[els[i].len] = 0;
+	}
+
+	pw_parallel_for(cnt, parse_par_el, els);
+
+	for (i = 0; i < cnt; i++) {
+		struct cjson_par_el *el = &els[i];
+
+		el->str[el->len] = el->saved;
+		if (el->rc != 0 && rc == 0) {
+			PWLOG(LOG_ERROR, "failed to parse array element at %p: %d\n", el->str, el->rc);
+			rc = -EFAULT;
+		}
+
+		/* stop at the first error, but keep freeing */
+		if (rc == 0) {
+			obj_cb(cb_ctx, el->top->a);
+		}
+
+		if (el->arena) {
+			cjson_arena_free(el->arena);
+		}
+		memset(el, 0, sizeof(*el));
+	}
+
+	return rc;
+}
+
+struct cjson_arr_splitter {
+	char *str;
+	/* NULL if we're scanning byte by byte */
+	struct cjson_index *idx;
+	size_t pos;
+	struct cjson_arr_scanner scan;
+};
+
+/**
+ * Find the next top-level array element. With the structural index only
+ * brackets and quotes are visited, so the string contents are skipped.
+ * Returns 1 if an element was found, 0 at the end of input, or a negative
+ * errno.
+ */
+static int
+split_next_el(struct cjson_arr_splitter *sp, size_t *start, size_t *len)
+{
+	uint32_t pos;
+	int rc;
+
+	if (!sp->idx) {
+		for (; sp->str[sp->pos]; sp->pos++) {
+			rc = arr_scan_char(&sp->scan, sp->str[sp->pos], sp->pos);
+			if (rc == 1) {
+				*start = sp->scan.el_start;
+				*len = sp->pos - *start + 1;
+				sp->pos++;
+				return 1;
+			}
+
+			if (rc < 0) {
+				return rc;
+			}
+		}
+
+		return 0;
+	}
+
+	while (index_next(sp->idx, &pos)) {
+		char c = sp->str[pos];
+
+		if (c == '"') {
+			/* the next entry is the closing quote */
+			if (!index_next(sp->idx, &pos)) {
+				sp->scan.in_string = true;
+				return 0;
 			}
+			continue;
+		}
+
+		rc = arr_scan_char(&sp->scan, c, pos);
+		if (rc == 1) {
+			*start = sp->scan.el_start;
+			*len = pos - *start + 1;
+			return 1;
 		}
 
-		while (entry) {
-			if (i-- == 0) {
-				return entry;
+		if (rc < 0) {
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+int
+cjson_parse_arr_parallel(char *str, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx)
+{
+	struct cjson_arr_splitter sp = { .str = str };
+	struct cjson_par_el *els;
+	size_t start, len, cnt = 0;
+	int rc = 0;
+
+	els = calloc(CJSON_PAR_BATCH, sizeof(*els));
+	if (!els) {
+		return -ENOMEM;
+	}
+
+	sp.idx = index_alloc();
+	if (sp.idx) {
+		index_init(sp.idx, str, sp.idx->classify);
+	}
+
+	while ((rc = split_next_el(&sp, &start, &len)) == 1) {
+		els[cnt].str = str + start;
+		els[cnt].len = len;
+		cnt++;
+
+		if (cnt == CJSON_PAR_BATCH) {
+			rc = parse_par_batch(els, cnt, obj_cb, cb_ctx);
+			cnt = 0;
+			if (rc != 0) {
+				break;
 			}
-			entry = entry->next;
 		}
+	}
+
+	if (rc == 0 && cnt > 0) {
+		rc = parse_par_batch(els, cnt, obj_cb, cb_ctx);
+	}
+
+	if (rc == 0 && (sp.scan.depth != 0 || sp.scan.in_string)) {
+		PWLOG(LOG_ERROR, "truncated input\n");
+		rc = -EFAULT;
+	}
+
+	free(sp.idx);
+	free(els);
+	return rc;
+}
+
+static struct cjson *
+arr_idx(struct cjson *json, uint64_t i)
+{
+	struct cjson *entry = json->a;
 
+	if (i >= json->count) {
 		return &g_null_json;
 	}
 
+	if (i >= CJSON_MIN_VEC_IDX && (json->a_vec || build_child_vec(json) == 0)) {
+		return json->a_vec[i];
+	}
+
+	while (entry) {
+		if (i-- == 0) {
+			return entry;
+		}
+		entry = entry->next;
+	}
+
+	return &g_null_json;
+}
+
+static struct cjson *
+arr_get(struct cjson *json, const char *key)
+{
+	char *end;
+	uint64_t i;
+
+	/* this can't be an address */
+	if ((uintptr_t)key < 65536) {
+		i = (uintptr_t)key;
+	} else {
+		errno = 0;
+		i = strtoll(key, &end, 0);
+		if (end == key || errno == ERANGE) {
+			return &g_null_json;
+		}
+	}
+
+	return arr_idx(json, i);
+}
+
+static struct cjson *
+obj_find(struct cjson *json, const char *key)
+{
+	struct cjson *entry = json->a;
+
 	while (entry) {
 		if (strcmp(entry->key, key) == 0) {
 			return entry;
@@ -668,6 +2045,59 @@ cjson_obj(struct cjson *json, const char *key)
 	return &g_null_json;
 }
 
+struct cjson *
+cjson_obj(struct cjson *json, const char *key)
+{
+	if (json->type == CJSON_TYPE_ARRAY) {
+		return arr_get(json, key);
+	}
+
+	if (json->type != CJSON_TYPE_OBJECT) {
+		return &g_null_json;
+	}
+
+	if (json->count >= CJSON_MIN_HASH_CNT) {
+		return cjson_obj_h(json, key, cjson_key_hash(key));
+	}
+
+	return obj_find(json, key);
+}
+
+struct cjson *
+cjson_obj_h(struct cjson *json, const char *key, uint32_t hash)
+{
+	struct cjson_key_ent *ents;
+	unsigned cap, i;
+
+	if (json->type == CJSON_TYPE_ARRAY) {
+		return arr_get(json, key);
+	}
+
+	if (json->type != CJSON_TYPE_OBJECT) {
+		return &g_null_json;
+	}
+
+	if (json->count < CJSON_MIN_HASH_CNT) {
+		return obj_find(json, key);
+	}
+
+	if (!json->a_keys && build_key_index(json) != 0) {
+		return obj_find(json, key);
+	}
+
+	ents = json->a_keys;
+	cap = get_key_index_cap(json->count);
+	i = hash & (cap - 1);
+	while (ents[i].obj) {
+		if (ents[i].hash == hash && strcmp(ents[i].obj->key, key) == 0) {
+			return ents[i].obj;
+		}
+		i = (i + 1) & (cap - 1);
+	}
+
+	return &g_null_json;
+}
+
 struct cjson *
 cjson_js_ext(size_t argc, ...)
 {
@@ -687,12 +2117,121 @@ cjson_js_ext(size_t argc, ...)
 	return obj;
 }
 
+int
+cjson_path_compile(struct cjson_path *path, const char *str)
+{
+	size_t len = strlen(str);
+	unsigned depth = 0;
+	char *b, *dot;
+
+	if (len >= sizeof(path->buf)) {
+		return -ENAMETOOLONG;
+	}
+
+	memcpy(path->buf, str, len + 1);
+	b = path->buf;
+	while (true) {
+		struct cjson_path_el *el;
+		char *end;
+
+		if (depth == CJSON_PATH_MAX_DEPTH) {
+			return -EINVAL;
+		}
+
+		el = &path->el[depth++];
+		dot = strchr(b, '.');
+		if (dot) {
+			*dot = 0;
+		}
+
+		el->key_off = b - path->buf;
+		el->hash = cjson_key_hash(b);
+		el->idx = strtoul(b, &end, 10);
+		if (end == b || *end != 0) {
+			el->idx = UINT32_MAX;
+		}
+
+		if (!dot) {
+			break;
+		}
+		b = dot + 1;
+	}
+
+	path->str = str;
+	path->depth = depth;
+	path->compiled = 1;
+	return 0;
+}
+
+struct cjson *
+cjson_path_get(struct cjson *json, struct cjson_path *path)
+{
+	unsigned i;
+
+	if (!path->compiled && cjson_path_compile(path, path->str) != 0) {
+		assert(false);
+		return &g_null_json;
+	}
+
+	for (i = 0; i < path->depth; i++) {
+		struct cjson_path_el *el = &path->el[i];
+
+		if (json->type == CJSON_TYPE_ARRAY) {
+			json = el->idx != UINT32_MAX ? arr_idx(json, el->idx) : &g_null_json;
+		} else {
+			json = cjson_obj_h(json, path->buf + el->key_off, el->hash);
+		}
+	}
+
+	return json;
+}
+
+size_t
+cjson_str_normalize(struct cjson *json, int use_crlf)
+{
+	if (json->type != CJSON_TYPE_STRING) {
+		return 0;
+	}
+
+	if (json->flags & CJSON_FLAG_RAW_STR) {
+		normalize_json_string(json->s, use_crlf);
+		json->s_len = strlen(json->s);
+		json->flags &= ~CJSON_FLAG_RAW_STR;
+	}
+
+	return json->s_len;
+}
+
+/* atoi() equivalent, but 64-bit */
+static int64_t
+str_to_int(const char *s)
+{
+	bool neg = false;
+	uint64_t val = 0;
+
+	while (*s == ' ' || (*s >= '\t' && *s <= '\r')) {
+		s++;
+	}
+
+	if (*s == '-' || *s == '+') {
+		neg = *s == '-';
+		s++;
+	}
+
+	while (IS_DIGIT(*s)) {
+		val = val * 10 + (*s - '0');
+		s++;
+	}
+
+	return neg ? -(int64_t)val : (int64_t)val;
+}
+
 int64_t
 cjson_int(struct cjson *c)
 {
 	switch (c->type) {
 		case 2:
-			return atoi(c->s);
+			return str_to_int(c->s);
 		case 5:
 			return c->d;
 		case 3:
@@ -5,10 +5,15 @@
 #ifndef CJSON_H
 #define CJSON_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
 
 #define CJSON_MIN_POOLSIZE 8
+/* smaller array indices are just looked up by walking the list */
+#define CJSON_MIN_VEC_IDX 8
+/* smaller objects are just searched linearly */
+#define CJSON_MIN_HASH_CNT 8
 
 enum {
 	CJSON_TYPE_NONE = 0,
@@ -21,34 +26,175 @@ enum {
 	CJSON_TYPE_OBJECT,
 };
 
-struct cjson_mempool;
+/* string needs normalize_json_string(), see cjson_str_normalize() */
+#define CJSON_FLAG_RAW_STR 0x1
+
+struct cjson_arena;
+struct cjson_key_ent;
+struct cjson_feed;
+struct cjson_index;
 
 struct cjson {
 	struct cjson *parent;
 	union {
 		struct cjson *next;
-		struct cjson_mempool *mem;
+		/* root only */
+		struct cjson_arena *arena;
 	};
 	char *key;
-	uint32_t type;
+	uint16_t type;
+	uint16_t flags; /**< CJSON_FLAG_* */
 	uint32_t count; /**< children count */
 	union {
-		char *s;
+		struct {
+			char *s;
+			/* set by the parser, might be outdated if s is modified */
+			size_t s_len;
+		};
 		int64_t i;
 		double d;
-		struct cjson *a;
+		struct {
+			/* first and last child */
+			struct cjson *a;
+			struct cjson *a_last;
+			union {
+				/* arrays: all children, built on the first indexed access */
+				struct cjson **a_vec;
+				/* objects: key hash table, built on the first lookup */
+				struct cjson_key_ent *a_keys;
+			};
+		};
 	};
 };
 
+/* parser implementations, see cjson_set_parse_mode() */
+enum {
+	/* pick the fastest one available on this CPU */
+	CJSON_PARSE_AUTO = 0,
+	/* original byte-by-byte parser */
+	CJSON_PARSE_SCALAR,
+	/* structural index built with SSE2 / AVX2 */
+	CJSON_PARSE_SSE2,
+	CJSON_PARSE_AVX2,
+};
+
+/**
+ * Memory for parsed objects. It's a list of pages that are kept across
+ * resets, so a caller-owned arena can be reused for many consecutive parses
+ * without any allocations once it has grown big enough.
+ */
+struct cjson_arena_stats {
+	/* bytes currently allocated from the arena */
+	size_t used;
+	/* the most bytes used at once between any two resets */
+	size_t high_water;
+	/* total size of all pages */
+	size_t capacity;
+	unsigned pages;
+	uint64_t allocs;
+	uint64_t resets;
+};
+
+/* size is just the initial capacity in bytes, the arena grows as needed */
+struct cjson_arena *cjson_arena_init(size_t size);
+/* invalidates all objects allocated so far, O(1) */
+void cjson_arena_reset(struct cjson_arena *arena);
+void cjson_arena_free(struct cjson_arena *arena);
+void cjson_arena_get_stats(struct cjson_arena *arena, struct cjson_arena_stats *stats);
+
 typedef void (*cjson_parse_arr_stream_cb)(void *ctx, struct cjson *obj);
+void cjson_set_parse_mode(int mode);
 struct cjson *cjson_parse(char *str);
 int cjson_parse_arr_stream(char *str, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
+/* same as above, but with caller-owned memory that's reset between objects */
+int cjson_parse_arr_stream_arena(char *str, struct cjson_arena *arena,
+		cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
+
+/**
+ * Incremental version of cjson_parse_arr_stream(). Accepts the input in
+ * arbitrary chunks, buffering only the currently incomplete array element,
+ * so memory use is bounded by the biggest element rather than the input size.
+ * The input may contain multiple consecutive top-level arrays. The object
+ * passed to obj_cb, including its strings, is valid only during the callback.
+ */
+/* arena is optional, NULL means a private one */
+struct cjson_feed *cjson_feed_init(struct cjson_arena *arena, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
+int cjson_feed(struct cjson_feed *f, const char *data, size_t len);
+/* returns -EFAULT if the input ended in the middle of an array */
+int cjson_feed_finish(struct cjson_feed *f);
+void cjson_feed_free(struct cjson_feed *f);
+/* read the whole file in fixed-size chunks */
+int cjson_feed_fp(FILE *fp, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
+int cjson_feed_fd(int fd, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
+
+/**
+ * Optional hook called with each complete top-level array element, as a
+ * null-terminated string, before it's parsed. It may return 0 if it already
+ * handled the element, 1 to have it parsed and passed to obj_cb as usual,
+ * or a negative errno to stop.
+ */
+typedef int (*cjson_feed_el_cb)(void *ctx, char *str, size_t len);
+void cjson_feed_set_el_cb(struct cjson_feed *f, cjson_feed_el_cb el_cb, void *el_ctx);
+/* feed the whole file and call cjson_feed_finish() */
+int cjson_feed_file(struct cjson_feed *f, FILE *fp);
+
+/**
+ * Event-based parsing, without building any cjson tree. open() and close()
+ * are called for each object or array, and value() for each scalar. The
+ * objects passed to callbacks are valid only during the call, but their
+ * parent chain leads up to the root, so the keys of all enclosing containers
+ * are available too. Array elements have NULL keys. open() may return
+ * CJSON_SAX_DOM to have the entire container parsed into a regular cjson
+ * tree instead, which is then passed to value(). Any callback can return
+ * CJSON_SAX_STOP to finish early, or a negative errno to abort. Callbacks
+ * may be NULL.
+ *
+ * Strings are null-terminated only during the callbacks, so unlike with
+ * cjson_parse() the input stays intact, unless a callback modifies it or
+ * a DOM subtree is requested.
+ */
+#define CJSON_SAX_MAX_DEPTH 32
+#define CJSON_SAX_DOM 1
+#define CJSON_SAX_STOP 2
+
+struct cjson_sax_ops {
+	int (*open)(void *ctx, struct cjson *obj);
+	int (*close)(void *ctx, struct cjson *obj);
+	int (*value)(void *ctx, struct cjson *val);
+};
+
+/**
+ * str must start with an object or array. arena is optional, used only for
+ * DOM subtrees. idx is optional too, without it a temporary one is allocated
+ * for each call.
+ */
+int cjson_sax_parse(char *str, struct cjson_arena *arena, const struct cjson_sax_ops *ops, void *ctx,
+		struct cjson_index *idx);
+/* structural index for repeated cjson_sax_parse() calls. NULL if the scalar parser is used */
+struct cjson_index *cjson_index_alloc(void);
+void cjson_index_free(struct cjson_index *idx);
+
+/**
+ * Parse the array elements in str (possibly in multiple consecutive top-level
+ * arrays) on pw_get_num_threads() threads, then call obj_cb for each of them
+ * on the calling thread, in order. Returns 0 or a negative errno.
+ */
+int cjson_parse_arr_parallel(char *str, cjson_parse_arr_stream_cb obj_cb, void *cb_ctx);
 struct cjson *cjson_obj(struct cjson *json, const char *key);
+/* same as cjson_obj(), but with a precomputed cjson_key_hash(key) */
+struct cjson *cjson_obj_h(struct cjson *json, const char *key, uint32_t hash);
+uint32_t cjson_key_hash(const char *key);
 int cjson_add_child(struct cjson *parent, struct cjson *child);
 void cjson_free(struct cjson *json);
 
 int64_t cjson_int(struct cjson *json);
 double cjson_float(struct cjson *json);
 char *cjson_str(struct cjson *json);
+/**
+ * Run normalize_json_string() on a string value, unless it's known not to
+ * contain anything that needs normalizing. It's done at most once per value.
+ * Returns the new string length.
+ */
+size_t cjson_str_normalize(struct cjson *json, int use_crlf);
 
 #endif /* CJSON_H */
@@ -0,0 +1,931 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright(c) 2022 Darek Stojaczyk for pwmirage.com
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifndef NO_ICONV
+#include <iconv.h>
+#endif
+
+#include "common.h"
+#include "cjson.h"
+#include "serializer.h"
+#include "chain_arr.h"
+#include "pw_elements.h"
+#include "pw_tasks.h"
+
+static const struct {
+	int mode;
+	const char *name;
+} g_modes[] = {
+	{ CJSON_PARSE_SCALAR, "scalar" },
+	{ CJSON_PARSE_SSE2, "sse2" },
+	{ CJSON_PARSE_AVX2, "avx2" },
+	{ CJSON_PARSE_AUTO, "auto" },
+};
+
+static void
+count_obj_cb(void *ctx, struct cjson *obj)
+{
+	(*(size_t *)ctx)++;
+}
+
+static double
+get_time_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct str_stats {
+	size_t count;
+	size_t bytes;
+	size_t plain_count;
+	size_t plain_bytes;
+};
+
+static void
+count_strings(struct cjson *obj, struct str_stats *stats)
+{
+	for (; obj; obj = obj->next) {
+		if (obj->type == CJSON_TYPE_STRING) {
+			stats->count++;
+			stats->bytes += obj->s_len;
+			if (!(obj->flags & CJSON_FLAG_RAW_STR)) {
+				stats->plain_count++;
+				stats->plain_bytes += obj->s_len;
+			}
+		} else if (obj->type == CJSON_TYPE_OBJECT || obj->type == CJSON_TYPE_ARRAY) {
+			count_strings(obj->a, stats);
+		}
+	}
+}
+
+static void
+count_strings_cb(void *ctx, struct cjson *obj)
+{
+	count_strings(obj->a, ctx);
+}
+
+static int
+sax_count_open(void *ctx, struct cjson *obj)
+{
+	/* each patch object is parsed separately */
+	if (!obj->parent) {
+		(*(size_t *)ctx)++;
+	}
+	return 0;
+}
+
+static const struct cjson_sax_ops g_count_sax_ops = {
+	.open = sax_count_open,
+};
+
+/* go through the element without building a cjson tree */
+static int
+sax_count_el_cb(void *ctx, char *str, size_t len)
+{
+	return cjson_sax_parse(str, NULL, &g_count_sax_ops, ctx, NULL);
+}
+
+/* feed the whole buffer at once, with either DOM or SAX parsing of each element */
+static int
+feed_patch(char *buf, size_t len, bool sax, size_t *obj_cnt)
+{
+	struct cjson_feed *f;
+	int rc;
+
+	f = cjson_feed_init(NULL, count_obj_cb, obj_cnt);
+	if (!f) {
+		return -ENOMEM;
+	}
+
+	if (sax) {
+		cjson_feed_set_el_cb(f, sax_count_el_cb, obj_cnt);
+	}
+
+	rc = cjson_feed(f, buf, len);
+	if (rc == 0) {
+		rc = cjson_feed_finish(f);
+	}
+
+	cjson_feed_free(f);
+	return rc;
+}
+
+/* parse the concatenated arrays just like srv_patcher does */
+static int
+parse_patch(char *buf, struct cjson_arena *arena, size_t *obj_cnt)
+{
+	char *b = buf;
+	int rc;
+
+	do {
+		rc = cjson_parse_arr_stream_arena(b, arena, count_obj_cb, obj_cnt);
+		b += rc;
+		while (*b && *b != '[') b++;
+	} while (rc > 0);
+
+	return rc;
+}
+
+static char *
+gen_array(size_t el_count, bool objects)
+{
+	size_t len = el_count * 32 + 3;
+	char *buf = malloc(len);
+	char *b = buf;
+	size_t i;
+
+	if (!buf) {
+		return NULL;
+	}
+
+	*b++ = '[';
+	for (i = 0; i < el_count; i++) {
+		if (objects) {
+			b += sprintf(b, "%s{\"id\":%zu,\"x\":1.5}", i ? "," : "", i);
+		} else {
+			b += sprintf(b, "%s%zu", i ? "," : "", i);
+		}
+	}
+	*b++ = ']';
+	*b = 0;
+	return buf;
+}
+
+/* parse big arrays and access each element by index; both should scale linearly */
+static int
+bench_scaling(void)
+{
+	static const size_t counts[] = { 10000, 100000, 1000000 };
+	char key[32];
+	int i, o;
+
+	for (o = 0; o < 2; o++) {
+		for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+			size_t cnt = counts[i];
+			char *buf = gen_array(cnt, o);
+			struct cjson *arr;
+			double start, parse_t, idx_t;
+			int64_t sum = 0;
+			size_t j;
+
+			if (!buf) {
+				fprintf(stderr, "malloc() failed\n");
+				return 1;
+			}
+
+			start = get_time_sec();
+			arr = cjson_parse(buf);
+			parse_t = get_time_sec() - start;
+			if (!arr || arr->count != cnt) {
+				fprintf(stderr, "parsing failed\n");
+				return 1;
+			}
+
+			start = get_time_sec();
+			for (j = 0; j < cnt; j++) {
+				struct cjson *el;
+
+				snprintf(key, sizeof(key), "%zu", j);
+				el = cjson_obj(arr, key);
+				sum += o ? cjson_int(cjson_obj(el, "id")) : cjson_int(el);
+			}
+			idx_t = get_time_sec() - start;
+
+			printf("%-7s x %7zu: parse %8.2f ms (%6.1f ns/el), index %8.2f ms (%6.1f ns/el)\n",
+					o ? "objects" : "ints", cnt, parse_t * 1e3, parse_t * 1e9 / cnt,
+					idx_t * 1e3, idx_t * 1e9 / cnt);
+			if (sum != (int64_t)cnt * (cnt - 1) / 2) {
+				fprintf(stderr, "invalid sum\n");
+				return 1;
+			}
+
+			cjson_free(arr);
+			free(buf);
+		}
+	}
+
+	return 0;
+}
+
+/* patch-like objects made mostly of numbers, e.g. npc or item stats */
+static char *
+gen_numeric_patch(size_t obj_count, size_t *len_p)
+{
+	size_t len = obj_count * 512 + 3;
+	char *buf = malloc(len);
+	char *b = buf;
+	size_t i;
+	int j;
+
+	if (!buf) {
+		return NULL;
+	}
+
+	srand(1);
+	*b++ = '[';
+	for (i = 0; i < obj_count; i++) {
+		b += sprintf(b, "%s{\"_db\":{\"type\":\"monsters\"},\"id\":%zu,\"lid\":\"#%d:%d\"",
+				i ? "," : "", 100000 + i, rand() % 8, rand() % 100000);
+		for (j = 0; j < 8; j++) {
+			b += sprintf(b, ",\"i%d\":%d", j, rand() % 100000);
+		}
+		for (j = 0; j < 8; j++) {
+			float f = (float)rand() / RAND_MAX * 1000;
+
+			/* float32 values printed as doubles, like in our patches */
+			b += sprintf(b, ",\"f%d\":%.17g", j, (double)f);
+		}
+		*b++ = '}';
+	}
+	*b++ = ']';
+	*b = 0;
+	*len_p = b - buf;
+	return buf;
+}
+
+static void
+sum_numbers_cb(void *ctx, struct cjson *obj)
+{
+	double *sum = ctx;
+	struct cjson *c;
+
+	for (c = obj->a; c; c = c->next) {
+		*sum += c->type == CJSON_TYPE_FLOAT ? c->d : cjson_int(c);
+	}
+}
+
+/* parse numeric-heavy objects, compared with just calling strtod() on every number */
+static int
+bench_numbers(void)
+{
+	size_t len, cnt = 0;
+	char *buf, *tmp, *b;
+	double start, parse_t, libc_t, sum = 0;
+	int i, iterations = 10;
+
+	buf = gen_numeric_patch(20000, &len);
+	tmp = malloc(len + 1);
+	if (!buf || !tmp) {
+		fprintf(stderr, "malloc() failed\n");
+		return 1;
+	}
+
+	parse_t = 0;
+	for (i = 0; i < iterations; i++) {
+		memcpy(tmp, buf, len + 1);
+		start = get_time_sec();
+		if (cjson_parse_arr_stream(tmp, sum_numbers_cb, &sum) < 0) {
+			fprintf(stderr, "parsing failed\n");
+			return 1;
+		}
+		parse_t += get_time_sec() - start;
+	}
+
+	libc_t = 0;
+	for (i = 0; i < iterations; i++) {
+		start = get_time_sec();
+		for (b = buf; *b; b++) {
+			if ((*b == ':' && b[1] != '{' && b[1] != '"')) {
+				sum += strtod(b + 1, &b);
+				cnt++;
+			}
+		}
+		libc_t += get_time_sec() - start;
+	}
+
+	printf("numeric patch, %zu bytes: parse %.2f MB/s, strtod() alone over the same %zu numbers %.2f MB/s (%g)\n",
+			len, len * iterations / parse_t / 1e6, cnt / iterations,
+			len * iterations / libc_t / 1e6, sum);
+	free(tmp);
+	free(buf);
+	return 0;
+}
+
+struct foreach_el {
+	uint32_t id;
+	uint32_t exp;
+	uint32_t sp;
+	uint32_t money;
+	char pad[112];
+};
+
+static void
+scale_el_fn(void *ctx, void *el)
+{
+	struct foreach_el *e = el;
+	double rate = *(double *)ctx;
+
+	e->exp *= rate;
+	e->sp *= rate;
+	e->money = e->money * rate + e->id % 7;
+}
+
+static uint64_t
+foreach_checksum(struct pw_chain_table *table)
+{
+	uint64_t sum = 0;
+	void *el;
+
+	PW_CHAIN_TABLE_FOREACH(el, table) {
+		struct foreach_el *e = el;
+
+		sum = sum * 31 + e->exp + e->sp + e->money;
+	}
+
+	return sum;
+}
+
+/* adjust_rates()-like pass over a big table with an increasing number of threads */
+static int
+bench_foreach(void)
+{
+	static const unsigned threads[] = { 1, 2, 4, 8, 16 };
+	unsigned max_threads = pw_get_num_threads();
+	size_t cnt = 1000000;
+	struct pw_chain_table *table;
+	uint64_t serial_sum = 0;
+	double rate = 1.0001;
+	double start, t, base_t = 0;
+	int i, j, iterations = 10;
+
+	/* start small, so the table spans all its chains */
+	table = pw_chain_table_alloc("foreach", NULL, sizeof(struct foreach_el), 1024, NULL);
+	if (!table) {
+		fprintf(stderr, "malloc() failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		struct foreach_el *e = pw_chain_table_new_el(table);
+
+		if (!e) {
+			fprintf(stderr, "malloc() failed\n");
+			return 1;
+		}
+		e->id = i;
+		e->exp = e->sp = e->money = i % 100000;
+	}
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		if (threads[i] > max_threads && i > 0) {
+			break;
+		}
+
+		/* every run starts from the same data */
+		for (j = 0; j < cnt; j++) {
+			struct foreach_el *e = pw_chain_table_get(table, j);
+
+			e->exp = e->sp = e->money = j % 100000;
+		}
+
+		pw_set_num_threads(threads[i]);
+		start = get_time_sec();
+		for (j = 0; j < iterations; j++) {
+			pw_chain_table_parallel_foreach(table, scale_el_fn, &rate);
+		}
+		t = get_time_sec() - start;
+		if (i == 0) {
+			base_t = t;
+			serial_sum = foreach_checksum(table);
+		} else if (foreach_checksum(table) != serial_sum) {
+			fprintf(stderr, "%u threads: results differ\n", threads[i]);
+			return 1;
+		}
+
+		printf("%2u threads x %zu elements: %8.2f ms per pass (%5.2fx)\n",
+				threads[i], cnt, t * 1e3 / iterations, base_t / t);
+	}
+
+	pw_set_num_threads(max_threads);
+	return 0;
+}
+
+/* serialize every element on its own, then deserialize it back from that json */
+static int
+bench_table(struct pw_chain_table *table, int iterations)
+{
+	struct pw_buf buf = {};
+	double start, ser_t, des_t = 0;
+	size_t cnt = 0;
+	struct cjson_index *idx;
+	char *tmp_buf, *str;
+	void *el, *tmp;
+	int i;
+
+	start = get_time_sec();
+	for (i = 0; i < iterations; i++) {
+		PW_CHAIN_TABLE_FOREACH(el, table) {
+			struct serializer *slzr = table->serializer;
+			void *data = el;
+
+			pw_buf_rollback(&buf, 0);
+			_serialize(&buf, &slzr, &data, 1, true, false, true);
+			cnt++;
+		}
+	}
+	ser_t = get_time_sec() - start;
+
+	/* all elements one after another, each null-terminated */
+	pw_buf_rollback(&buf, 0);
+	PW_CHAIN_TABLE_FOREACH(el, table) {
+		struct serializer *slzr = table->serializer;
+		void *data = el;
+
+		_serialize(&buf, &slzr, &data, 1, false, false, true);
+		pw_buf_putc(&buf, 0);
+	}
+
+	tmp = calloc(1, table->el_size);
+	tmp_buf = malloc(buf.len);
+	idx = cjson_index_alloc();
+	if (buf.oom || !tmp || !tmp_buf) {
+		fprintf(stderr, "malloc() failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		/* strings are unescaped in place, so start with a fresh copy */
+		memcpy(tmp_buf, buf.data, buf.len);
+		start = get_time_sec();
+		for (str = tmp_buf; str < tmp_buf + buf.len; str += strlen(str) + 1) {
+			if (deserialize_sax(str, table->serializer, tmp, idx) != 0) {
+				fprintf(stderr, "%s: deserialize failed\n", table->name);
+				return 1;
+			}
+		}
+		des_t += get_time_sec() - start;
+	}
+
+	printf("%-12s %6zu elements, %5zu bytes each: serialize %8.1f ns/el, deserialize %8.1f ns/el\n",
+			table->name, cnt / iterations, table->el_size,
+			ser_t * 1e9 / cnt, des_t * 1e9 / cnt);
+
+	pw_buf_free(&buf);
+	cjson_index_free(idx);
+	free(tmp_buf);
+	free(tmp);
+	return 0;
+}
+
+static int
+bench_serializer(const char *elements_path, const char *tasks_path)
+{
+	static const char *table_names[] = { "monsters", "npcs" };
+	struct pw_elements *elements;
+	struct pw_task_file taskf;
+	int iterations = 20;
+	int i, j, rc;
+
+	/* deserialize() logs every field it sets */
+	g_pwlog_level = LOG_ERROR;
+
+	elements = calloc(1, sizeof(*elements));
+	if (!elements) {
+		fprintf(stderr, "calloc() failed\n");
+		return 1;
+	}
+
+	rc = pw_elements_load(elements, elements_path, NULL);
+	if (rc) {
+		fprintf(stderr, "Can\'t load %s: %d\n", elements_path, rc);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(table_names) / sizeof(table_names[0]); i++) {
+		for (j = 0; j < elements->tables_count; j++) {
+			struct pw_chain_table *table = elements->tables[j];
+
+			if (table && strcmp(table->name, table_names[i]) == 0) {
+				rc = bench_table(table, iterations);
+				if (rc) {
+					return rc;
+				}
+				break;
+			}
+		}
+	}
+
+	if (!tasks_path) {
+		return 0;
+	}
+
+	rc = pw_tasks_load(&taskf, tasks_path, NULL);
+	if (rc) {
+		fprintf(stderr, "Can\'t load %s: %d\n", tasks_path, rc);
+		return 1;
+	}
+
+	return bench_table(taskf.tasks, iterations);
+}
+
+struct float_check {
+	uint64_t checked;
+	uint64_t failed;
+	uint64_t ftoa_bytes;
+	uint64_t printf_bytes;
+	double ftoa_t;
+	double printf_t;
+};
+
+/* print the floats, parse them back with cjson and compare the bits */
+static int
+check_floats(const uint32_t *vals, size_t cnt, struct float_check *chk)
+{
+	char *buf, *b, tmp[64];
+	struct cjson *json, *c;
+	double start;
+	size_t i;
+
+	buf = malloc(cnt * PW_FTOA_BUF_SIZE + 3);
+	if (!buf) {
+		fprintf(stderr, "malloc() failed\n");
+		return 1;
+	}
+
+	b = buf;
+	*b++ = '[';
+	start = get_time_sec();
+	for (i = 0; i < cnt; i++) {
+		b += pw_ftoa(*(float *)&vals[i], b);
+		*b++ = ',';
+	}
+	chk->ftoa_t += get_time_sec() - start;
+	chk->ftoa_bytes += b - buf - 1 - cnt;
+	b[-1] = ']';
+	*b = 0;
+
+	start = get_time_sec();
+	for (i = 0; i < cnt; i++) {
+		chk->printf_bytes += snprintf(tmp, sizeof(tmp), "%.8f", *(float *)&vals[i]);
+	}
+	chk->printf_t += get_time_sec() - start;
+
+	json = cjson_parse(buf);
+	if (!json) {
+		fprintf(stderr, "parsing failed\n");
+		free(buf);
+		return 1;
+	}
+
+	for (c = json->a, i = 0; c && i < cnt; c = c->next, i++) {
+		float f = cjson_float(c);
+
+		if (memcmp(&f, &vals[i], sizeof(f)) != 0) {
+			if (chk->failed++ < 10) {
+				pw_ftoa(*(float *)&vals[i], tmp);
+				fprintf(stderr, "0x%08x printed as %s parsed back as %.9g\n", vals[i], tmp, f);
+			}
+		}
+		chk->checked++;
+	}
+
+	if (i != cnt) {
+		fprintf(stderr, "parsed %zu numbers out of %zu\n", i, cnt);
+		chk->failed += cnt - i;
+	}
+
+	cjson_free(json);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Round-trip every 4 bytes of the file (at any alignment) that look like a
+ * finite float, so every float field is covered. Without a file, go
+ * through all 2^32 bit patterns instead.
+ */
+static int
+bench_floats(const char *path)
+{
+	struct float_check chk = {};
+	uint32_t vals[4096];
+	size_t len = 0, cnt = 0;
+	uint64_t i, end;
+	char *file = NULL;
+	int rc;
+
+	if (path) {
+		rc = readfile(path, &file, &len);
+		if (rc) {
+			fprintf(stderr, "Can\'t open %s\n", path);
+			return 1;
+		}
+		end = len >= 4 ? len - 3 : 0;
+	} else {
+		end = 1ULL << 32;
+	}
+
+	for (i = 0; i < end; i++) {
+		uint32_t u = i;
+
+		if (file) {
+			memcpy(&u, file + i, sizeof(u));
+		}
+
+		if (((u >> 23) & 0xff) == 0xff) {
+			continue;
+		}
+
+		vals[cnt++] = u;
+		if (cnt == sizeof(vals) / sizeof(vals[0])) {
+			if (check_floats(vals, cnt, &chk) != 0) {
+				return 1;
+			}
+			cnt = 0;
+		}
+	}
+
+	if (cnt > 0 && check_floats(vals, cnt, &chk) != 0) {
+		return 1;
+	}
+
+	printf("%"PRIu64" floats, %"PRIu64" didn\'t round-trip\n", chk.checked, chk.failed);
+	printf("pw_ftoa(): %.2f bytes/float, %.1f ns/float\n",
+			(double)chk.ftoa_bytes / chk.checked, chk.ftoa_t * 1e9 / chk.checked);
+	printf("\"%%.8f\":   %.2f bytes/float, %.1f ns/float\n",
+			(double)chk.printf_bytes / chk.checked, chk.printf_t * 1e9 / chk.checked);
+	free(file);
+	return chk.failed ? 1 : 0;
+}
+
+#ifndef NO_ICONV
+/* the old change_charset(), with a new iconv handle for every call */
+static int
+iconv_uncached(const char *src_charset, const char *dst_charset, const char *src,
+		size_t srclen, char *dst, size_t dstlen)
+{
+	iconv_t cd = iconv_open(dst_charset, src_charset);
+	int rc;
+
+	if (cd == (iconv_t)-1) {
+		return -1;
+	}
+
+	rc = iconv(cd, (char **)&src, &srclen, &dst, &dstlen);
+	iconv_close(cd);
+	return rc;
+}
+
+static int
+bench_charset_pair(const char *src_charset, const char *dst_charset,
+		const char *strs, size_t str_size, size_t cnt)
+{
+	static char out[2][1024];
+	double start, fast_t, uncached_t, cached_t;
+	iconv_t cd;
+	size_t i, mismatches = 0;
+
+	/* build the GBK tables, if any */
+	change_charset(src_charset, dst_charset, strs, str_size, out[0], sizeof(out[0]));
+
+	start = get_time_sec();
+	for (i = 0; i < cnt; i++) {
+		change_charset(src_charset, dst_charset, strs + i * str_size, str_size, out[0], sizeof(out[0]));
+	}
+	fast_t = get_time_sec() - start;
+
+	start = get_time_sec();
+	for (i = 0; i < cnt; i++) {
+		iconv_uncached(src_charset, dst_charset, strs + i * str_size, str_size, out[1], sizeof(out[1]));
+	}
+	uncached_t = get_time_sec() - start;
+
+	cd = iconv_open(dst_charset, src_charset);
+	start = get_time_sec();
+	for (i = 0; i < cnt; i++) {
+		char *in_p = (char *)strs + i * str_size, *out_p = out[1];
+		size_t in_len = str_size, out_len = sizeof(out[1]);
+
+		iconv(cd, NULL, NULL, NULL, NULL);
+		iconv(cd, &in_p, &in_len, &out_p, &out_len);
+	}
+	cached_t = get_time_sec() - start;
+	iconv_close(cd);
+
+	for (i = 0; i < cnt; i++) {
+		memset(out, 0, sizeof(out));
+		change_charset(src_charset, dst_charset, strs + i * str_size, str_size, out[0], sizeof(out[0]));
+		iconv_uncached(src_charset, dst_charset, strs + i * str_size, str_size, out[1], sizeof(out[1]));
+		mismatches += memcmp(out[0], out[1], sizeof(out[0])) != 0;
+	}
+
+	printf("%8s -> %-8s %4zu bytes: change_charset() %7.1f ns, iconv %7.1f ns, iconv w/o iconv_open() %7.1f ns, %zu mismatches\n",
+			src_charset, dst_charset, str_size, fast_t * 1e9 / cnt, uncached_t * 1e9 / cnt,
+			cached_t * 1e9 / cnt, mismatches);
+	return mismatches ? 1 : 0;
+}
+
+/* 32 and 256-char strings like element names and task descriptions */
+static int
+bench_charset(void)
+{
+	static const size_t lens[] = { 32, 256 };
+	size_t cnt = 20000, i, j, l;
+	uint16_t *wstrs;
+	char *utf8, *gbk;
+	int rc = 0;
+
+	for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		size_t len = lens[l];
+
+		wstrs = calloc(cnt, len * 2);
+		utf8 = calloc(cnt, len * 3);
+		gbk = calloc(cnt, len * 2);
+		if (!wstrs || !utf8 || !gbk) {
+			fprintf(stderr, "calloc() failed\n");
+			return 1;
+		}
+
+		for (i = 0; i < cnt; i++) {
+			uint16_t *w = wstrs + i * len;
+
+			/* half ascii, half chinese, then null-padded */
+			for (j = 0; j < len * 3 / 4; j++) {
+				w[j] = rand() % 2 ? 'a' + rand() % 26 : 0x4e00 + rand() % 0x1000;
+			}
+			change_charset("UTF-16LE", "UTF-8", (char *)w, len * 2, utf8 + i * len * 3, len * 3);
+			change_charset("UTF-16LE", "GBK", (char *)w, len * 2, gbk + i * len * 2, len * 2);
+		}
+
+		rc |= bench_charset_pair("UTF-16LE", "UTF-8", (char *)wstrs, len * 2, cnt);
+		rc |= bench_charset_pair("UTF-8", "UTF-16LE", utf8, len * 3, cnt);
+		rc |= bench_charset_pair("GBK", "UTF-8", gbk, len * 2, cnt);
+		rc |= bench_charset_pair("UTF-8", "GBK", utf8, len * 3, cnt);
+		rc |= bench_charset_pair("GB2312", "UTF-8", gbk, len * 2, cnt);
+		free(wstrs);
+		free(utf8);
+		free(gbk);
+	}
+
+	return rc;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+	struct cjson_arena_stats stats;
+	struct str_stats str_stats = {};
+	struct cjson_arena *arena;
+	char *buf, *tmp, *b;
+	size_t len;
+	int iterations = 10;
+	int i, m, rc;
+
+	if (argc < 2) {
+		fprintf(stderr, "%s patch.json [iterations]\n", argv[0]);
+		fprintf(stderr, "%s scaling\n", argv[0]);
+		fprintf(stderr, "%s numbers\n", argv[0]);
+		fprintf(stderr, "%s foreach\n", argv[0]);
+		fprintf(stderr, "%s serializer elements.data [tasks.data]\n", argv[0]);
+		fprintf(stderr, "%s floats [elements.data]\n", argv[0]);
+		fprintf(stderr, "%s charset\n", argv[0]);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "scaling") == 0) {
+		return bench_scaling();
+	}
+
+	if (strcmp(argv[1], "numbers") == 0) {
+		return bench_numbers();
+	}
+
+	if (strcmp(argv[1], "foreach") == 0) {
+		return bench_foreach();
+	}
+
+	if (strcmp(argv[1], "serializer") == 0 && argc > 2) {
+		return bench_serializer(argv[2], argc > 3 ? argv[3] : NULL);
+	}
+
+	if (strcmp(argv[1], "floats") == 0) {
+		return bench_floats(argc > 2 ? argv[2] : NULL);
+	}
+
+#ifndef NO_ICONV
+	if (strcmp(argv[1], "charset") == 0) {
+		return bench_charset();
+	}
+#endif
+
+	if (argc > 2) {
+		iterations = atoi(argv[2]);
+	}
+
+	rc = readfile(argv[1], &buf, &len);
+	if (rc) {
+		fprintf(stderr, "Can\'t open %s\n", argv[1]);
+		return 1;
+	}
+
+	/* the parser modifies the input in place, so parse a fresh copy each time */
+	tmp = malloc(len + 1);
+	arena = cjson_arena_init(0);
+	if (!tmp || !arena) {
+		fprintf(stderr, "malloc() failed\n");
+		return 1;
+	}
+
+	for (m = 0; m < sizeof(g_modes) / sizeof(g_modes[0]); m++) {
+		double total = 0;
+		size_t obj_cnt = 0;
+
+		cjson_set_parse_mode(g_modes[m].mode);
+		for (i = 0; i < iterations; i++) {
+			double start;
+
+			memcpy(tmp, buf, len + 1);
+			obj_cnt = 0;
+			start = get_time_sec();
+			rc = parse_patch(tmp, arena, &obj_cnt);
+			total += get_time_sec() - start;
+			if (rc < 0) {
+				fprintf(stderr, "%s: parsing failed: %d\n", g_modes[m].name, rc);
+				return 1;
+			}
+		}
+
+		printf("%-8s %10.2f MB/s (%zu objects, %zu bytes, %d iterations)\n",
+				g_modes[m].name, len * iterations / total / 1e6,
+				obj_cnt, len, iterations);
+	}
+
+	{
+		double total = 0;
+		size_t obj_cnt = 0;
+
+		cjson_set_parse_mode(CJSON_PARSE_AUTO);
+		for (i = 0; i < iterations; i++) {
+			double start;
+
+			memcpy(tmp, buf, len + 1);
+			obj_cnt = 0;
+			start = get_time_sec();
+			rc = cjson_parse_arr_parallel(tmp, count_obj_cb, &obj_cnt);
+			total += get_time_sec() - start;
+			if (rc < 0) {
+				fprintf(stderr, "parallel: parsing failed: %d\n", rc);
+				return 1;
+			}
+		}
+
+		printf("parallel %10.2f MB/s (%zu objects, %u threads)\n",
+				len * iterations / total / 1e6, obj_cnt, pw_get_num_threads());
+	}
+
+	for (m = 0; m < 2; m++) {
+		double total = 0;
+		size_t obj_cnt = 0;
+
+		for (i = 0; i < iterations; i++) {
+			double start;
+
+			obj_cnt = 0;
+			start = get_time_sec();
+			rc = feed_patch(buf, len, m, &obj_cnt);
+			total += get_time_sec() - start;
+			if (rc < 0) {
+				fprintf(stderr, "feed: parsing failed: %d\n", rc);
+				return 1;
+			}
+		}
+
+		printf("feed %-4s %9.2f MB/s (%zu objects)\n", m ? "sax" : "dom",
+				len * iterations / total / 1e6, obj_cnt);
+	}
+
+	/* strings without escapes don't need normalize_json_string() when deserialized */
+	memcpy(tmp, buf, len + 1);
+	b = tmp;
+	do {
+		rc = cjson_parse_arr_stream_arena(b, arena, count_strings_cb, &str_stats);
+		b += rc;
+		while (*b && *b != '[') b++;
+	} while (rc > 0);
+
+	printf("strings: %zu of %zu are plain, %zu of %zu bytes don't need normalizing\n",
+			str_stats.plain_count, str_stats.count, str_stats.plain_bytes, str_stats.bytes);
+
+	cjson_arena_get_stats(arena, &stats);
+	printf("arena: %zu bytes high-water, %zu bytes in %u pages, %"PRIu64" allocs, %"PRIu64" resets\n",
+			stats.high_water, stats.capacity, stats.pages, stats.allocs, stats.resets);
+
+	cjson_arena_free(arena);
+	free(tmp);
+	free(buf);
+	return 0;
+}
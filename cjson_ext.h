@@ -28,4 +28,41 @@ struct cjson *cjson_js_ext(size_t argc, ...);
 #define JSf(...) cjson_float(JS(__VA_ARGS__))
 #define JSs(...) cjson_str(JS(__VA_ARGS__))
 
+/**
+ * Precompiled version of JS(). The path is a dot-separated list of keys or
+ * array indices, e.g. "_db.type" or "groups.0.type". It's split and hashed
+ * just once - either with cjson_path_compile() or on the first lookup - so
+ * it's meant to be kept in a static variable:
+ *
+ *   static struct cjson_path path = CJSON_PATH("_db.type");
+ *   const char *type = JPs(obj, &path);
+ */
+#define CJSON_PATH_MAX_DEPTH 8
+
+struct cjson_path_el {
+	uint32_t hash;
+	/* numeric value of the key or UINT32_MAX */
+	uint32_t idx;
+	uint8_t key_off;
+};
+
+struct cjson_path {
+	const char *str;
+	unsigned depth;
+	unsigned compiled;
+	struct cjson_path_el el[CJSON_PATH_MAX_DEPTH];
+	/* all keys, null-terminated */
+	char buf[128];
+};
+
+#define CJSON_PATH(_str) { .str = (_str) }
+
+int cjson_path_compile(struct cjson_path *path, const char *str);
+struct cjson *cjson_path_get(struct cjson *json, struct cjson_path *path);
+
+#define JP(json, path) cjson_path_get((json), (path))
+#define JPi(json, path) cjson_int(JP(json, path))
+#define JPf(json, path) cjson_float(JP(json, path))
+#define JPs(json, path) cjson_str(JP(json, path))
+
 #endif /* CJSON_EXT_H */
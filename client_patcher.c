@@ -192,6 +192,8 @@ import_stream_cb(void *ctx, struct cjson *obj)
 static int
 apply_patch(const char *url)
 {
+	const char *parallel = getenv("PW_UPDATER_PARALLEL_PARSE");
+	struct cjson_arena *arena;
 	char *buf, *b;
 	size_t num_bytes = 1;
 	int rc;
@@ -202,13 +204,32 @@ apply_patch(const char *url)
 		return rc;
 	}
 
+	/* same switch as in srv_patcher. objects are still applied one by one, in order */
+	if (parallel && strlen(parallel) > 0) {
+		rc = cjson_parse_arr_parallel(buf, import_stream_cb, NULL);
+		free(buf);
+		if (rc < 0) {
+			PWLOG(LOG_ERROR, "cjson_parse_arr_parallel() failed: %s, rc=%d\n", url, rc);
+			return rc;
+		}
+
+		return 0;
+	}
+
+	arena = cjson_arena_init(0);
+	if (!arena) {
+		free(buf);
+		return -ENOMEM;
+	}
+
 	b = buf;
 	do {
-		rc = cjson_parse_arr_stream(b, import_stream_cb, NULL);
+		rc = cjson_parse_arr_stream_arena(b, arena, import_stream_cb, NULL);
 		/* skip comma and newline */
 		b += rc;
 		while (*b && *b != '[') b++;
 	} while (rc > 0);
+	cjson_arena_free(arena);
 	free(buf);
 	if (rc < 0) {
 		PWLOG(LOG_ERROR, "cjson_parse_arr_stream() failed: %s, rc=%d\n", url, rc);
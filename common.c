@@ -17,12 +17,20 @@
 #include <sys/stat.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
+
+#ifndef NO_ICONV
+#include <iconv.h>
+#endif
+
+#ifdef __MINGW32__
+#include <windows.h>
+#endif
 
 #include "common.h"
 #include "cjson.h"
 
 int g_pwlog_level = 99;
-FILE *g_nullfile;
 const char g_zeroes[4096];
 int g_idmap_can_set;
 
@@ -61,25 +69,19 @@ get_extension(const char *in)
 }
 
 static int
-download_wininet(const char *url, const char *filename)
+download_cb_wininet(const char *url, download_data_cb cb, void *ctx)
 {
 	HINTERNET hInternetSession;
 	HINTERNET hURL;
-	BOOL success;
+	BOOL success = TRUE;
 	DWORD num_bytes = 1;
-	FILE *fp;
 	DWORD flags;
+	int rc = 0;
 
 	DeleteUrlCacheEntry(url);
 
-	fp = fopen(filename, "wb");
-	if (!fp) {
-		return -errno;
-	}
-
 	hInternetSession = InternetOpen("Mirage Patcher", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
 	if (!hInternetSession) {
-		fclose(fp);
 		return -1;
 	}
 
@@ -87,7 +89,6 @@ download_wininet(const char *url, const char *filename)
 	hURL = InternetOpenUrl(hInternetSession, url, NULL, 0, flags, 0);
 	if (!hURL) {
 		InternetCloseHandle(hInternetSession);
-		fclose(fp);
 		return -1;
 	}
 
@@ -98,17 +99,47 @@ download_wininet(const char *url, const char *filename)
 		if (!success) {
 			break;
 		}
-		fwrite(buf, 1, (size_t)num_bytes, fp);
+
+		if (num_bytes > 0) {
+			rc = cb(ctx, buf, (size_t)num_bytes);
+			if (rc) {
+				break;
+			}
+		}
 	}
 
 	// Close down connections.
 	InternetCloseHandle(hURL);
 	InternetCloseHandle(hInternetSession);
 
-	fclose(fp);
+	if (rc) {
+		return rc;
+	}
 	return success ? 0 : -1;
 }
 
+static int
+download_fwrite_cb(void *ctx, const char *data, size_t len)
+{
+	return fwrite(data, 1, len, ctx) == len ? 0 : -EIO;
+}
+
+static int
+download_wininet(const char *url, const char *filename)
+{
+	FILE *fp;
+	int rc;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		return -errno;
+	}
+
+	rc = download_cb_wininet(url, download_fwrite_cb, fp);
+	fclose(fp);
+	return rc;
+}
+
 #else
 
 static int
@@ -125,6 +156,36 @@ download_wget(const char *url, const char *filename)
 
 	return 0;
 }
+
+static int
+download_cb_wget(const char *url, download_data_cb cb, void *ctx)
+{
+	char buf[2048];
+	FILE *fp;
+	size_t len;
+	int rc = 0, status;
+
+	snprintf(buf, sizeof(buf), "wget -q --no-check-certificate --no-cache --no-cookies \"%s\" -O -", url);
+	fp = popen(buf, "r");
+	if (!fp) {
+		return -errno;
+	}
+
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		rc = cb(ctx, buf, len);
+		if (rc) {
+			break;
+		}
+	}
+
+	/* if we stopped early wget gets a SIGPIPE, that's fine */
+	status = pclose(fp);
+	if (rc) {
+		return rc;
+	}
+
+	return status;
+}
 #endif
 #endif
 
@@ -145,6 +206,23 @@ download(const char *url, const char *filename)
 #endif
 }
 
+int
+download_cb(const char *url, download_data_cb cb, void *ctx)
+{
+#ifdef NO_NETWORKING
+	return -ENOSYS;
+#else
+	PWLOG(LOG_DEBUG_1, "Fetching \"%s\" ...\n", url);
+
+#ifdef __MINGW32__
+	return download_cb_wininet(url, cb, ctx);
+#else
+	return download_cb_wget(url, cb, ctx);
+#endif
+
+#endif
+}
+
 int
 readfile(const char *path, char **buf, size_t *len)
 {
@@ -171,20 +249,35 @@ readfile(const char *path, char **buf, size_t *len)
 	return 0;
 }
 
+static int
+download_mem_cb(void *ctx, const char *data, size_t len)
+{
+	struct pw_buf *buf = ctx;
+
+	pw_buf_write(buf, data, len);
+	return buf->oom ? -ENOMEM : 0;
+}
+
 int
 download_mem(const char *url, char **buf, size_t *len)
 {
+	struct pw_buf mem = {};
 	int rc;
-	char *tmp_filename = "patcher/tmp";
 
-	rc = download((char *)url, tmp_filename);
+	rc = download_cb(url, download_mem_cb, &mem);
+	if (rc == 0 && pw_buf_reserve(&mem, 1) != 0) {
+		rc = -ENOMEM;
+	}
+
 	if (rc) {
+		pw_buf_free(&mem);
 		return rc;
 	}
 
-	rc = readfile(tmp_filename, buf, len);
-	unlink(tmp_filename);
-	return rc;
+	mem.data[mem.len] = 0;
+	*buf = mem.data;
+	*len = mem.len;
+	return 0;
 }
 
 void
@@ -248,157 +341,1317 @@ normalize_json_string(char *str, bool use_crlf)
 	*write_b = 0;
 }
 
-void
-fwsprint(FILE *fp, const uint16_t *buf, int maxlen)
+/*
+ * Hand-written converters for the charsets used all over the game files.
+ * They behave just like iconv(): convert as much as possible, then return -1
+ * at the first invalid or truncated character, or when the output is full.
+ */
+static size_t
+utf8_encode(uint32_t c, uint8_t *dst, const uint8_t *dst_end)
 {
-	char out[4096] = {};
-	char *b = out;
+	if (c < 0x80) {
+		if (dst_end - dst < 1) {
+			return 0;
+		}
+		dst[0] = c;
+		return 1;
+	} else if (c < 0x800) {
+		if (dst_end - dst < 2) {
+			return 0;
+		}
+		dst[0] = 0xc0 | (c >> 6);
+		dst[1] = 0x80 | (c & 0x3f);
+		return 2;
+	} else if (c < 0x10000) {
+		if (dst_end - dst < 3) {
+			return 0;
+		}
+		dst[0] = 0xe0 | (c >> 12);
+		dst[1] = 0x80 | ((c >> 6) & 0x3f);
+		dst[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
 
-	change_charset("UTF-16LE", "UTF-8", (char *)buf, maxlen * 2, out, sizeof(out));
-	while (*b && maxlen--) {
-		if (*b == '\\') {
-			fputs("\\\\", fp);
-		} else if (*b == '"') {
-			fputs("\\\"", fp);
-		} else if (*b == '\r') {
-			/* do nothing */
-		} else if (*b == '\t') {
-			fputs("\\t", fp);
-		} else if (*b == '\n') {
-			fputs("\\n", fp);
-		} else {
-			fputc(*b, fp);
+	if (dst_end - dst < 4) {
+		return 0;
+	}
+	dst[0] = 0xf0 | (c >> 18);
+	dst[1] = 0x80 | ((c >> 12) & 0x3f);
+	dst[2] = 0x80 | ((c >> 6) & 0x3f);
+	dst[3] = 0x80 | (c & 0x3f);
+	return 4;
+}
+
+/* returns the number of bytes consumed, 0 on an invalid or truncated sequence */
+static size_t
+utf8_decode(const uint8_t *src, const uint8_t *src_end, uint32_t *c_p)
+{
+	uint32_t c = src[0];
+	size_t n, i;
+
+	if (c < 0x80) {
+		*c_p = c;
+		return 1;
+	} else if (c >= 0xc2 && c < 0xe0) {
+		n = 2;
+		c &= 0x1f;
+	} else if (c >= 0xe0 && c < 0xf0) {
+		n = 3;
+		c &= 0x0f;
+	} else if (c >= 0xf0 && c < 0xf5) {
+		n = 4;
+		c &= 0x07;
+	} else {
+		return 0;
+	}
+
+	if (src_end - src < n) {
+		return 0;
+	}
+
+	for (i = 1; i < n; i++) {
+		if ((src[i] & 0xc0) != 0x80) {
+			return 0;
 		}
-		b++;
+		c = (c << 6) | (src[i] & 0x3f);
+	}
+
+	/* overlong, a surrogate, or out of the unicode range */
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10ffff)) ||
+			(c >= 0xd800 && c < 0xe000)) {
+		return 0;
 	}
+
+	*c_p = c;
+	return n;
 }
 
-void
-sprint(char *dst, size_t dstsize, const char *src, int srcsize)
+static int
+utf16le_to_utf8(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
 {
-	change_charset("GB2312", "UTF-8", (char *)src, srcsize, dst, dstsize);
+	const uint8_t *src_end = src + srclen;
+	const uint8_t *dst_end = dst + dstlen;
+
+	while (src_end - src >= 2) {
+		uint32_t c = src[0] | (src[1] << 8);
+		size_t n = 2, out;
+
+		if (c < 0x80 && dst < dst_end) {
+			*dst++ = c;
+			src += 2;
+			continue;
+		}
+
+		if (c >= 0xd800 && c < 0xe000) {
+			uint32_t c2;
+
+			if (c >= 0xdc00 || src_end - src < 4) {
+				return -1;
+			}
+
+			c2 = src[2] | (src[3] << 8);
+			if (c2 < 0xdc00 || c2 >= 0xe000) {
+				return -1;
+			}
+
+			c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+			n = 4;
+		}
+
+		out = utf8_encode(c, dst, dst_end);
+		if (out == 0) {
+			return -1;
+		}
+
+		dst += out;
+		src += n;
+	}
+
+	/* a trailing odd byte is an incomplete char */
+	return src == src_end ? 0 : -1;
 }
 
-void
-fsprint(FILE *fp, const char *buf, int maxlen)
+static int
+utf8_to_utf16le(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
 {
-	char out[1024] = {};
-	char *b = out;
+	const uint8_t *src_end = src + srclen;
+	const uint8_t *dst_end = dst + dstlen;
 
-	sprint(out, sizeof(out), buf, maxlen);
-	while (*b && maxlen--) {
-		if (*b == '\\') {
-			fputs("\\\\", fp);
+	while (src < src_end) {
+		uint32_t c;
+		size_t n;
+
+		if (*src < 0x80 && dst_end - dst >= 2) {
+			*dst++ = *src++;
+			*dst++ = 0;
+			continue;
+		}
+
+		n = utf8_decode(src, src_end, &c);
+		if (n == 0) {
+			return -1;
+		}
+
+		if (c < 0x10000) {
+			if (dst_end - dst < 2) {
+				return -1;
+			}
+			*dst++ = c & 0xff;
+			*dst++ = c >> 8;
 		} else {
-			fputc(*b, fp);
+			uint32_t hi = 0xd800 + ((c - 0x10000) >> 10);
+			uint32_t lo = 0xdc00 + ((c - 0x10000) & 0x3ff);
+
+			if (dst_end - dst < 4) {
+				return -1;
+			}
+			*dst++ = hi & 0xff;
+			*dst++ = hi >> 8;
+			*dst++ = lo & 0xff;
+			*dst++ = lo >> 8;
 		}
-		b++;
+		src += n;
 	}
+
+	return 0;
 }
 
+#ifndef NO_ICONV
+/*
+ * GBK and GB2312 (mostly a subset of the former, but with a few different
+ * mappings) are table-driven. The tables are filled once from iconv itself,
+ * so the output is exactly the same.
+ */
+#define GB_INVALID 0xffff
+#define GB_LEAD_BYTE 0xfffe
+
+struct gb_codec {
+	const char *name;
+	pthread_once_t once;
+	bool ready;
+	/* unicode char for each single byte, or one of GB_* above */
+	uint16_t single[256];
+	/* unicode char for each 2-byte code (lead byte << 8 | trail byte) */
+	uint16_t *dbl;
+	/* GB code for each BMP char, single byte codes are < 0x100 */
+	uint16_t *enc;
+};
+
+static struct gb_codec g_gbk_codec = { "GBK", PTHREAD_ONCE_INIT };
+static struct gb_codec g_gb2312_codec = { "GB2312", PTHREAD_ONCE_INIT };
+
+/* convert a single char with iconv, returns the output length or -1 */
+static int
+iconv_char(iconv_t cd, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+	char *in_p = (char *)in, *out_p = (char *)out;
+	size_t out_left = out_len;
+
+	iconv(cd, NULL, NULL, NULL, NULL);
+	if (iconv(cd, &in_p, &in_len, &out_p, &out_left) == (size_t)-1) {
+		return -1;
+	}
 
-void
-fwsprintf(FILE *fp, const char *fmt, const uint16_t *buf, int maxlen)
+	return out_len - out_left;
+}
+
+static void
+gb_codec_init(struct gb_codec *codec)
 {
-	char c;
+	iconv_t dec_cd, enc_cd = (iconv_t)-1;
+	uint8_t in[2], out[4];
+	unsigned i;
+	int len;
+
+	dec_cd = iconv_open("UTF-16LE", codec->name);
+	enc_cd = iconv_open(codec->name, "UTF-16LE");
+	codec->dbl = malloc(0x10000 * sizeof(*codec->dbl));
+	codec->enc = malloc(0x10000 * sizeof(*codec->enc));
+	if (dec_cd == (iconv_t)-1 || enc_cd == (iconv_t)-1 || !codec->dbl || !codec->enc) {
+		PWLOG(LOG_ERROR, "can't initialize the %s codec\n", codec->name);
+		goto out;
+	}
 
-	while ((c = *fmt++)) {
-		if (c == '%' && *fmt == 's') {
-			fwsprint(fp, buf, maxlen);
-			fmt++;
+	for (i = 0; i < 0x100; i++) {
+		in[0] = i;
+		len = iconv_char(dec_cd, in, 1, out, sizeof(out));
+		if (len == 2) {
+			codec->single[i] = out[0] | (out[1] << 8);
+		} else if (len < 0 && errno == EINVAL) {
+			/* incomplete */
+			codec->single[i] = GB_LEAD_BYTE;
 		} else {
-			putc(c, fp);
+			codec->single[i] = GB_INVALID;
 		}
 	}
-}
 
-void
-wsnprintf(uint16_t *dst, size_t dstsize, const char *src) {
-	char c;
+	for (i = 0; i < 0x10000; i++) {
+		codec->dbl[i] = GB_INVALID;
+		if (codec->single[i >> 8] != GB_LEAD_BYTE) {
+			continue;
+		}
 
-	memset(dst, 0, dstsize);
-	while (dstsize > 0 && (c = *src++)) {
-		if (c == '\n' && dstsize >= 2) {
-			*dst++ = '\r';
-			*dst++ = '\n';
-			dstsize -= 2;
-		} else {
-			*dst++ = c;
-			dstsize--;
+		in[0] = i >> 8;
+		in[1] = i & 0xff;
+		len = iconv_char(dec_cd, in, 2, out, sizeof(out));
+		if (len == 2) {
+			codec->dbl[i] = out[0] | (out[1] << 8);
 		}
 	}
 
-	if (dstsize == 0) {
-		*(dst - 1) = 0;
-	} else {
-		*dst = 0;
+	for (i = 0; i < 0x10000; i++) {
+		codec->enc[i] = GB_INVALID;
+		if (i >= 0xd800 && i < 0xe000) {
+			continue;
+		}
+
+		in[0] = i & 0xff;
+		in[1] = i >> 8;
+		len = iconv_char(enc_cd, in, 2, out, sizeof(out));
+		if (len == 1) {
+			codec->enc[i] = out[0];
+		} else if (len == 2) {
+			codec->enc[i] = (out[0] << 8) | out[1];
+		}
+	}
+
+	codec->ready = true;
+out:
+	if (dec_cd != (iconv_t)-1) {
+		iconv_close(dec_cd);
+	}
+	if (enc_cd != (iconv_t)-1) {
+		iconv_close(enc_cd);
 	}
 }
 
-uint32_t
-js_strlen(const char *str)
+static void
+gbk_codec_init(void)
 {
-	uint32_t len = 0;
-	char c;
+	gb_codec_init(&g_gbk_codec);
+}
 
-	while ((c = *str++)) {
-		if (c == '\n') {
-			len++;
-		}
-		len++;
+static void
+gb2312_codec_init(void)
+{
+	gb_codec_init(&g_gb2312_codec);
+}
+
+static struct gb_codec *
+get_gb_codec(const char *charset)
+{
+	if (strcmp(charset, "GBK") == 0) {
+		pthread_once(&g_gbk_codec.once, gbk_codec_init);
+		return g_gbk_codec.ready ? &g_gbk_codec : NULL;
+	} else if (strcmp(charset, "GB2312") == 0) {
+		pthread_once(&g_gb2312_codec.once, gb2312_codec_init);
+		return g_gb2312_codec.ready ? &g_gb2312_codec : NULL;
 	}
-	return len;
+
+	return NULL;
 }
 
-int
-pw_version_load(struct pw_version *ver)
+static int
+gb_to_utf8(struct gb_codec *codec, const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
 {
-	FILE *fp = fopen("patcher/version", "rb");
+	const uint8_t *src_end = src + srclen;
+	const uint8_t *dst_end = dst + dstlen;
 
-	if (!fp) {
-		memset(ver, 0, sizeof(*ver));
-		ver->magic = PW_VERSION_MAGIC;
-		return errno;
-	}
+	while (src < src_end) {
+		uint32_t c = codec->single[*src];
+		size_t n = 1, out;
 
-	fread(ver, 1, sizeof(*ver), fp);
-	ver->branch[sizeof(ver->branch) - 1] = 0;
-	fclose(fp);
+		if (c < 0x80 && dst < dst_end) {
+			*dst++ = c;
+			src++;
+			continue;
+		}
 
-	if (ver->magic != PW_VERSION_MAGIC) {
-		memset(ver, 0, sizeof(*ver));
-		ver->magic = PW_VERSION_MAGIC;
-		return 1;
+		if (c == GB_LEAD_BYTE) {
+			if (src_end - src < 2) {
+				return -1;
+			}
+			c = codec->dbl[(src[0] << 8) | src[1]];
+			n = 2;
+		}
+
+		if (c == GB_INVALID) {
+			return -1;
+		}
+
+		out = utf8_encode(c, dst, dst_end);
+		if (out == 0) {
+			return -1;
+		}
+
+		dst += out;
+		src += n;
 	}
 
 	return 0;
 }
 
-int
-pw_version_save(struct pw_version *ver)
+static int
+utf8_to_gb(struct gb_codec *codec, const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
 {
-	FILE *fp = fopen("patcher/version", "wb");
+	const uint8_t *src_end = src + srclen;
+	const uint8_t *dst_end = dst + dstlen;
 
-	if (!fp) {
-		return -errno;
-	}
+	while (src < src_end) {
+		uint32_t c, code;
+		size_t n;
 
-	fwrite(ver, 1, sizeof(*ver), fp);
-	ver->branch[sizeof(ver->branch) - 1] = 0;
-	fclose(fp);
+		n = utf8_decode(src, src_end, &c);
+		if (n == 0 || c >= 0x10000) {
+			return -1;
+		}
+
+		code = codec->enc[c];
+		if (code == GB_INVALID) {
+			return -1;
+		}
+
+		if (code < 0x100) {
+			if (dst == dst_end) {
+				return -1;
+			}
+			*dst++ = code;
+		} else {
+			if (dst_end - dst < 2) {
+				return -1;
+			}
+			*dst++ = code >> 8;
+			*dst++ = code & 0xff;
+		}
+		src += n;
+	}
 
 	return 0;
 }
 
-void
-pwlog(int type, const char *filename, unsigned lineno, const char *fnname, const char *fmt, ...)
+/*
+ * iconv_open() is expensive compared to converting a single short string, so
+ * keep the handles open. They can't be used by multiple threads at once, hence
+ * a small cache per thread.
+ */
+#define ICONV_CACHE_SIZE 8
+
+static __thread struct iconv_cache_entry {
+	char *src_charset;
+	char *dst_charset;
+	iconv_t cd;
+} g_iconv_cache[ICONV_CACHE_SIZE];
+
+static int
+iconv_convert(const char *src_charset, const char *dst_charset,
+		const char *src, size_t srclen, char *dst, size_t dstlen)
 {
-	va_list args;
-	const char *type_str;
+	struct iconv_cache_entry *ent = NULL;
+	iconv_t cd;
+	int i, rc;
 
-	if (type > g_pwlog_level) {
-		return;
-	}
+	for (i = 0; i < ICONV_CACHE_SIZE; i++) {
+		ent = &g_iconv_cache[i];
+		if (!ent->src_charset) {
+			break;
+		}
+
+		if (strcmp(ent->src_charset, src_charset) == 0 &&
+				strcmp(ent->dst_charset, dst_charset) == 0) {
+			/* reset the shift state */
+			iconv(ent->cd, NULL, NULL, NULL, NULL);
+			return iconv(ent->cd, (char **)&src, &srclen, &dst, &dstlen);
+		}
+	}
+
+	cd = iconv_open(dst_charset, src_charset);
+	if (cd == (iconv_t)-1) {
+		return -1;
+	}
+
+	if (i < ICONV_CACHE_SIZE) {
+		ent->src_charset = strdup(src_charset);
+		ent->dst_charset = strdup(dst_charset);
+		if (ent->src_charset && ent->dst_charset) {
+			ent->cd = cd;
+			return iconv(cd, (char **)&src, &srclen, &dst, &dstlen);
+		}
+
+		free(ent->src_charset);
+		free(ent->dst_charset);
+		ent->src_charset = ent->dst_charset = NULL;
+	}
+
+	/* no room in the cache */
+	rc = iconv(cd, (char **)&src, &srclen, &dst, &dstlen);
+	iconv_close(cd);
+	return rc;
+}
+#endif
+
+int
+change_charset(const char *src_charset, const char *dst_charset, const char *src, long srclen, char *dst, long dstlen)
+{
+#ifndef NO_ICONV
+	struct gb_codec *codec;
+#endif
+
+	if (!src || !dst) {
+		return -1;
+	}
+
+	if (strcmp(src_charset, "UTF-16LE") == 0 && strcmp(dst_charset, "UTF-8") == 0) {
+		return utf16le_to_utf8((const uint8_t *)src, srclen, (uint8_t *)dst, dstlen);
+	}
+
+	if (strcmp(src_charset, "UTF-8") == 0 && strcmp(dst_charset, "UTF-16LE") == 0) {
+		return utf8_to_utf16le((const uint8_t *)src, srclen, (uint8_t *)dst, dstlen);
+	}
+
+#ifdef NO_ICONV
+	return 0;
+#else
+	if (strcmp(dst_charset, "UTF-8") == 0 && (codec = get_gb_codec(src_charset))) {
+		return gb_to_utf8(codec, (const uint8_t *)src, srclen, (uint8_t *)dst, dstlen);
+	}
+
+	if (strcmp(src_charset, "UTF-8") == 0 && (codec = get_gb_codec(dst_charset))) {
+		return utf8_to_gb(codec, (const uint8_t *)src, srclen, (uint8_t *)dst, dstlen);
+	}
+
+	return iconv_convert(src_charset, dst_charset, src, srclen, dst, dstlen);
+#endif
+}
+
+
+/*
+ * The strings used to be converted with iconv into a 4 KB buffer, and only
+ * then escaped, one UTF-8 byte at a time, up to maxlen bytes. Keep the same
+ * limits, so the output is the same.
+ */
+#define WSPRINT_MAX_UTF8 4096
+
+/* copy the leading chars that don't need any escaping, returns their count */
+typedef size_t (*wstr_plain_run_fn)(uint8_t *dst, const uint16_t *src, size_t cnt);
+
+static size_t
+wstr_plain_run_generic(uint8_t *dst, const uint16_t *src, size_t cnt)
+{
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		uint16_t c = src[i];
+
+		if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') {
+			break;
+		}
+		dst[i] = c;
+	}
+
+	return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* dst must have room for cnt bytes, as whole vectors are stored */
+__attribute__((target("sse2")))
+static size_t
+wstr_plain_run_sse2(uint8_t *dst, const uint16_t *src, size_t cnt)
+{
+	size_t i = 0;
+
+	for (i = 0; i + 8 <= cnt; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i plain, special;
+		unsigned mask;
+
+		plain = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(0x1f)),
+				      _mm_cmplt_epi16(v, _mm_set1_epi16(0x80)));
+		special = _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('"')),
+				       _mm_cmpeq_epi16(v, _mm_set1_epi16('\\')));
+		mask = _mm_movemask_epi8(_mm_andnot_si128(special, plain));
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(v, v));
+		if (mask != 0xffff) {
+			return i + __builtin_ctz(~mask) / 2;
+		}
+	}
+
+	return i + wstr_plain_run_generic(dst + i, src + i, cnt - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+wstr_plain_run_avx2(uint8_t *dst, const uint16_t *src, size_t cnt)
+{
+	size_t i = 0;
+
+	for (i = 0; i + 16 <= cnt; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i plain, special;
+		uint32_t mask;
+
+		plain = _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16(0x1f)),
+					 _mm256_cmpgt_epi16(_mm256_set1_epi16(0x80), v));
+		special = _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('"')),
+					  _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\\')));
+		mask = _mm256_movemask_epi8(_mm256_andnot_si256(special, plain));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(
+					_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+		if (mask != 0xffffffff) {
+			return i + __builtin_ctz(~mask) / 2;
+		}
+	}
+
+	return i + wstr_plain_run_sse2(dst + i, src + i, cnt - i);
+}
+#endif
+
+static wstr_plain_run_fn
+get_wstr_plain_run_fn(void)
+{
+	static wstr_plain_run_fn cached;
+	wstr_plain_run_fn fn;
+
+	/* called from multiple threads; they'd all pick the same fn anyway */
+	fn = __atomic_load_n(&cached, __ATOMIC_ACQUIRE);
+	if (fn) {
+		return fn;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		fn = wstr_plain_run_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		fn = wstr_plain_run_sse2;
+	} else {
+		fn = wstr_plain_run_generic;
+	}
+#else
+	fn = wstr_plain_run_generic;
+#endif
+	__atomic_store_n(&cached, fn, __ATOMIC_RELEASE);
+	return fn;
+}
+
+/* UTF-16LE straight into escaped UTF-8, returns the output length (at most 2 * max_bytes) */
+static size_t
+wstr_to_json(uint8_t *dst, const uint16_t *src, size_t cnt, size_t max_bytes)
+{
+	wstr_plain_run_fn plain_run = get_wstr_plain_run_fn();
+	size_t room = WSPRINT_MAX_UTF8;
+	uint8_t *out = dst;
+	size_t i = 0;
+
+	while (i < cnt && max_bytes > 0) {
+		uint8_t utf8[4];
+		uint32_t c;
+		size_t n;
+
+		n = plain_run(out, src + i, MIN(cnt - i, MIN(max_bytes, room)));
+		out += n;
+		i += n;
+		max_bytes -= n;
+		room -= n;
+		if (i == cnt || max_bytes == 0 || room == 0 || src[i] == 0) {
+			break;
+		}
+
+		c = src[i];
+		if (c < 0x80) {
+			switch (c) {
+				case '\\':
+					*out++ = '\\';
+					*out++ = '\\';
+					break;
+				case '"':
+					*out++ = '\\';
+					*out++ = '"';
+					break;
+				case '\r':
+					break;
+				case '\t':
+					*out++ = '\\';
+					*out++ = 't';
+					break;
+				case '\n':
+					*out++ = '\\';
+					*out++ = 'n';
+					break;
+				default:
+					*out++ = c;
+					break;
+			}
+			i++;
+			max_bytes--;
+			room--;
+			continue;
+		}
+
+		if (c >= 0xd800 && c < 0xe000) {
+			/* stop at invalid surrogates, just like iconv */
+			if (c >= 0xdc00 || i + 1 == cnt || src[i + 1] < 0xdc00 || src[i + 1] >= 0xe000) {
+				break;
+			}
+			c = 0x10000 + ((c - 0xd800) << 10) + (src[i + 1] - 0xdc00);
+			i++;
+		}
+		i++;
+
+		n = utf8_encode(c, utf8, utf8 + sizeof(utf8));
+		if (n > room) {
+			break;
+		}
+		room -= n;
+
+		/* the limit is in bytes, so a char might be cut in half */
+		n = MIN(n, max_bytes);
+		memcpy(out, utf8, n);
+		out += n;
+		max_bytes -= n;
+	}
+
+	return out - dst;
+}
+
+void
+pw_buf_wsprint(struct pw_buf *buf, const uint16_t *str, int maxlen)
+{
+	size_t max_bytes = MIN(maxlen, WSPRINT_MAX_UTF8);
+
+	if (maxlen <= 0) {
+		return;
+	}
+
+	if (buf->null) {
+		uint8_t tmp[WSPRINT_MAX_UTF8 * 2];
+
+		buf->len += wstr_to_json(tmp, str, maxlen, max_bytes);
+		return;
+	}
+
+	if (pw_buf_reserve(buf, max_bytes * 2) != 0) {
+		return;
+	}
+
+	buf->len += wstr_to_json((uint8_t *)buf->data + buf->len, str, maxlen, max_bytes);
+}
+
+void
+sprint(char *dst, size_t dstsize, const char *src, int srcsize)
+{
+	change_charset("GB2312", "UTF-8", (char *)src, srcsize, dst, dstsize);
+}
+
+void
+pw_buf_sprint(struct pw_buf *buf, const char *str, int maxlen)
+{
+	char out[1024] = {};
+	char *b = out;
+
+	sprint(out, sizeof(out), str, maxlen);
+	while (*b && maxlen--) {
+		if (*b == '\\') {
+			pw_buf_write(buf, "\\\\", 2);
+		} else {
+			pw_buf_putc(buf, *b);
+		}
+		b++;
+	}
+}
+
+int
+pw_buf_reserve(struct pw_buf *buf, size_t len)
+{
+	size_t cap;
+	char *data;
+
+	if (buf->null || buf->len + len < buf->cap) {
+		return 0;
+	}
+
+	if (buf->oom) {
+		return -ENOMEM;
+	}
+
+	/* always keep space for a null-terminator */
+	cap = MAX(MAX(buf->cap * 2, buf->len + len + 1), 4096);
+	data = realloc(buf->data, cap);
+	if (!data) {
+		PWLOG(LOG_ERROR, "realloc(%zu) failed\n", cap);
+		buf->oom = true;
+		return -ENOMEM;
+	}
+
+	buf->data = data;
+	buf->cap = cap;
+	return 0;
+}
+
+void
+pw_buf_write(struct pw_buf *buf, const void *data, size_t len)
+{
+	if (pw_buf_reserve(buf, len) != 0) {
+		return;
+	}
+
+	if (!buf->null) {
+		memcpy(buf->data + buf->len, data, len);
+	}
+	buf->len += len;
+}
+
+void
+pw_buf_printf(struct pw_buf *buf, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	if (buf->null) {
+		len = vsnprintf(NULL, 0, fmt, args);
+	} else {
+		len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+		if (len >= 0 && buf->len + len >= buf->cap) {
+			va_end(args);
+			if (pw_buf_reserve(buf, len) != 0) {
+				return;
+			}
+			va_start(args, fmt);
+			len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+		}
+	}
+	va_end(args);
+
+	if (len > 0) {
+		buf->len += len;
+	}
+}
+
+/*
+ * Shortest decimal representation that parses back to the very same float,
+ * computed with Ryu (Ulf Adams, 2018). The tables are 5^-q and 5^i scaled
+ * to 59 and 61 significant bits respectively.
+ */
+static const uint64_t g_ftoa_pow5_inv[] = {
+	0x0800000000000001, 0x0666666666666667, 0x051eb851eb851eb9, 0x04189374bc6a7efa,
+	0x068db8bac710cb2a, 0x053e2d6238da3c22, 0x0431bde82d7b634e, 0x06b5fca6af2bd216,
+	0x055e63b88c230e78, 0x044b82fa09b5a52d, 0x06df37f675ef6eae, 0x057f5ff85e592558,
+	0x0465e6604b7a8447, 0x0709709a125da071, 0x05a126e1a84ae6c1, 0x0480ebe7b9d58567,
+	0x0734aca5f6226f0b, 0x05c3bd5191b525a3, 0x049c97747490eae9, 0x0760f253edb4ab0e,
+	0x05e72843249088d8, 0x04b8ed0283a6d3e0, 0x078e480405d7b966, 0x060b6cd004ac9452,
+	0x04d5f0a66a23a9db, 0x07bcb43d769f762b, 0x063090312bb2c4ef, 0x04f3a68dbc8f03f3,
+	0x07ec3daf94180651, 0x065697bfa9acd1da, 0x051212ffbaf0a7e2
+};
+static const uint64_t g_ftoa_pow5[] = {
+	0x1000000000000000, 0x1400000000000000, 0x1900000000000000, 0x1f40000000000000,
+	0x1388000000000000, 0x186a000000000000, 0x1e84800000000000, 0x1312d00000000000,
+	0x17d7840000000000, 0x1dcd650000000000, 0x12a05f2000000000, 0x174876e800000000,
+	0x1d1a94a200000000, 0x12309ce540000000, 0x16bcc41e90000000, 0x1c6bf52634000000,
+	0x11c37937e0800000, 0x16345785d8a00000, 0x1bc16d674ec80000, 0x1158e460913d0000,
+	0x15af1d78b58c4000, 0x1b1ae4d6e2ef5000, 0x10f0cf064dd59200, 0x152d02c7e14af680,
+	0x1a784379d99db420, 0x108b2a2c28029094, 0x14adf4b7320334b9, 0x19d971e4fe8401e7,
+	0x1027e72f1f128130, 0x1431e0fae6d7217c, 0x193e5939a08ce9db, 0x1f8def8808b02452,
+	0x13b8b5b5056e16b3, 0x18a6e32246c99c60, 0x1ed09bead87c0378, 0x13426172c74d822b,
+	0x1812f9cf7920e2b6, 0x1e17b84357691b64, 0x12ced32a16a1b11e, 0x178287f49c4a1d66,
+	0x1d6329f1c35ca4bf, 0x125dfa371a19e6f7, 0x16f578c4e0a060b5, 0x1cb2d6f618c878e3,
+	0x11efc659cf7d4b8d, 0x166bb7f0435c9e71, 0x1c06a5ec5433c60d
+};
+
+static inline int32_t
+ftoa_pow5bits(int32_t e)
+{
+	return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+static inline uint32_t
+ftoa_log10_pow2(int32_t e)
+{
+	return ((uint32_t)e * 78913) >> 18;
+}
+
+static inline uint32_t
+ftoa_log10_pow5(int32_t e)
+{
+	return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline uint32_t
+ftoa_pow5_factor(uint32_t val)
+{
+	uint32_t cnt = 0;
+
+	while (val % 5 == 0) {
+		val /= 5;
+		cnt++;
+	}
+
+	return cnt;
+}
+
+static inline uint32_t
+ftoa_mul_shift(uint32_t m, uint64_t factor, int32_t shift)
+{
+	uint64_t lo = (uint64_t)m * (uint32_t)factor;
+	uint64_t hi = (uint64_t)m * (factor >> 32);
+
+	return (uint32_t)(((lo >> 32) + hi) >> (shift - 32));
+}
+
+/* decompose into digits * 10^exp with the fewest possible digits */
+static uint32_t
+ftoa_shortest(uint32_t ieee_mantissa, uint32_t ieee_exp, int32_t *exp_p)
+{
+	int32_t e2, e10;
+	uint32_t m2, mv, mp, mm, vr, vp, vm, q;
+	bool accept_bounds, mm_shift;
+	bool vm_trailing_zeros = false, vr_trailing_zeros = false;
+	uint8_t last_removed = 0;
+	int32_t removed = 0;
+
+	if (ieee_exp == 0) {
+		e2 = 1 - 127 - 23 - 2;
+		m2 = ieee_mantissa;
+	} else {
+		e2 = (int32_t)ieee_exp - 127 - 23 - 2;
+		m2 = (1u << 23) | ieee_mantissa;
+	}
+
+	accept_bounds = (m2 & 1) == 0;
+	mv = 4 * m2;
+	mp = 4 * m2 + 2;
+	mm_shift = ieee_mantissa != 0 || ieee_exp <= 1;
+	mm = 4 * m2 - 1 - mm_shift;
+
+	if (e2 >= 0) {
+		int32_t k, i;
+
+		q = ftoa_log10_pow2(e2);
+		e10 = q;
+		k = 59 + ftoa_pow5bits(q) - 1;
+		i = -e2 + q + k;
+		vr = ftoa_mul_shift(mv, g_ftoa_pow5_inv[q], i);
+		vp = ftoa_mul_shift(mp, g_ftoa_pow5_inv[q], i);
+		vm = ftoa_mul_shift(mm, g_ftoa_pow5_inv[q], i);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+			int32_t l = 59 + ftoa_pow5bits(q - 1) - 1;
+
+			last_removed = ftoa_mul_shift(mv, g_ftoa_pow5_inv[q - 1], -e2 + q - 1 + l) % 10;
+		}
+
+		if (q <= 9) {
+			/* only one of mp, mv, and mm can be a multiple of 5, if any */
+			if (mv % 5 == 0) {
+				vr_trailing_zeros = ftoa_pow5_factor(mv) >= q;
+			} else if (accept_bounds) {
+				vm_trailing_zeros = ftoa_pow5_factor(mm) >= q;
+			} else {
+				vp -= ftoa_pow5_factor(mp) >= q;
+			}
+		}
+	} else {
+		int32_t i, k, j;
+
+		q = ftoa_log10_pow5(-e2);
+		e10 = q + e2;
+		i = -e2 - q;
+		k = ftoa_pow5bits(i) - 61;
+		j = q - k;
+		vr = ftoa_mul_shift(mv, g_ftoa_pow5[i], j);
+		vp = ftoa_mul_shift(mp, g_ftoa_pow5[i], j);
+		vm = ftoa_mul_shift(mm, g_ftoa_pow5[i], j);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+			j = q - 1 - (ftoa_pow5bits(i + 1) - 61);
+			last_removed = ftoa_mul_shift(mv, g_ftoa_pow5[i + 1], j) % 10;
+		}
+
+		if (q <= 1) {
+			/* mv has at least q trailing 0 bits, and so do mp and mm */
+			vr_trailing_zeros = true;
+			if (accept_bounds) {
+				vm_trailing_zeros = mm_shift;
+			} else {
+				vp--;
+			}
+		} else if (q < 31) {
+			vr_trailing_zeros = (mv & ((1u << (q - 1)) - 1)) == 0;
+		}
+	}
+
+	if (vm_trailing_zeros || vr_trailing_zeros) {
+		/* rare, the exact value might end with zeroes */
+		while (vp / 10 > vm / 10) {
+			vm_trailing_zeros &= vm % 10 == 0;
+			vr_trailing_zeros &= last_removed == 0;
+			last_removed = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		if (vm_trailing_zeros) {
+			while (vm % 10 == 0) {
+				vr_trailing_zeros &= last_removed == 0;
+				last_removed = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+
+		if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+			/* round to even */
+			last_removed = 4;
+		}
+
+		*exp_p = e10 + removed;
+		return vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+	}
+
+	while (vp / 10 > vm / 10) {
+		last_removed = vr % 10;
+		vr /= 10;
+		vp /= 10;
+		vm /= 10;
+		removed++;
+	}
+
+	*exp_p = e10 + removed;
+	return vr + (vr == vm || last_removed >= 5);
+}
+
+static const double g_ftoa_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * JSON readers (cjson included) parse numbers as doubles, and only then
+ * round them to floats. Very rarely that double rounding turns the shortest
+ * decimal into a neighbouring float, e.g. 7.038531e-26.
+ */
+static bool
+ftoa_reads_back(float f, uint32_t digits, int32_t exp)
+{
+	char tmp[PW_FTOA_BUF_SIZE];
+	double d;
+
+	if (exp >= -22 && exp <= 22) {
+		/* both operands are exact, so the result is correctly rounded */
+		d = exp < 0 ? digits / g_ftoa_pow10[-exp] : digits * g_ftoa_pow10[exp];
+	} else {
+		snprintf(tmp, sizeof(tmp), "%ue%d", digits, exp);
+		d = strtod(tmp, NULL);
+	}
+
+	return (float)d == f;
+}
+
+int
+pw_ftoa(float f, char *out)
+{
+	uint32_t bits, digits, tmp;
+	char dig[10];
+	int32_t exp, point;
+	int ndig = 0, i;
+	char *p = out;
+
+	memcpy(&bits, &f, sizeof(bits));
+	if (((bits >> 23) & 0xff) == 0xff) {
+		/* not representable in json anyway */
+		return snprintf(out, PW_FTOA_BUF_SIZE, "%.8f", f);
+	}
+
+	if (bits >> 31) {
+		*p++ = '-';
+	}
+
+	if ((bits & 0x7fffffff) == 0) {
+		memcpy(p, "0.0", 4);
+		return p - out + 3;
+	}
+
+	digits = ftoa_shortest(bits & 0x7fffff, (bits >> 23) & 0xff, &exp);
+	if (!ftoa_reads_back(bits >> 31 ? -f : f, digits, exp)) {
+		/* 9 significant digits are always enough */
+		return snprintf(out, PW_FTOA_BUF_SIZE, "%.8e", f);
+	}
+
+	tmp = digits;
+	do {
+		dig[ndig++] = '0' + tmp % 10;
+		tmp /= 10;
+	} while (tmp);
+
+	/* number of digits before the decimal point */
+	point = ndig + exp;
+	if (point > 0 && point <= 9) {
+		for (i = 0; i < point; i++) {
+			*p++ = i < ndig ? dig[ndig - 1 - i] : '0';
+		}
+		*p++ = '.';
+		if (point >= ndig) {
+			*p++ = '0';
+		}
+		for (i = point; i < ndig; i++) {
+			*p++ = dig[ndig - 1 - i];
+		}
+	} else if (point <= 0 && point > -5) {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = point; i < 0; i++) {
+			*p++ = '0';
+		}
+		for (i = 0; i < ndig; i++) {
+			*p++ = dig[ndig - 1 - i];
+		}
+	} else {
+		/* d.ddde[-]x */
+		*p++ = dig[ndig - 1];
+		if (ndig > 1) {
+			*p++ = '.';
+			for (i = 1; i < ndig; i++) {
+				*p++ = dig[ndig - 1 - i];
+			}
+		}
+		*p++ = 'e';
+		exp = point - 1;
+		if (exp < 0) {
+			*p++ = '-';
+			exp = -exp;
+		}
+		if (exp >= 10) {
+			*p++ = '0' + exp / 10;
+		}
+		*p++ = '0' + exp % 10;
+	}
+
+	*p = 0;
+	return p - out;
+}
+
+void
+pw_buf_print_float(struct pw_buf *buf, float f)
+{
+	char tmp[PW_FTOA_BUF_SIZE];
+	int len = pw_ftoa(f, tmp);
+
+	pw_buf_write(buf, tmp, len);
+}
+
+int
+pw_buf_save(struct pw_buf *buf, const char *filename)
+{
+	FILE *fp;
+	size_t written;
+
+	if (buf->oom) {
+		return -ENOMEM;
+	}
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		PWLOG(LOG_ERROR, "cant open %s for writing\n", filename);
+		return -errno;
+	}
+
+	written = fwrite(buf->data, 1, buf->len, fp);
+	fclose(fp);
+	if (written != buf->len) {
+		PWLOG(LOG_ERROR, "fwrite(%s) failed\n", filename);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+void
+pw_buf_free(struct pw_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->cap = 0;
+}
+
+#define PW_ARENA_DEFAULT_PAGE_SIZE (256 * 1024)
+#define PW_ARENA_ALIGN 16
+
+struct pw_arena_page {
+	struct pw_arena_page *next;
+	size_t used;
+	size_t size;
+	char data[] __attribute__((aligned(PW_ARENA_ALIGN)));
+};
+
+struct pw_arena {
+	struct pw_arena_page *head;
+	size_t page_size;
+};
+
+struct pw_arena *
+pw_arena_init(size_t page_size)
+{
+	struct pw_arena *arena = calloc(1, sizeof(*arena));
+
+	if (!arena) {
+		return NULL;
+	}
+
+	arena->page_size = page_size ? page_size : PW_ARENA_DEFAULT_PAGE_SIZE;
+	return arena;
+}
+
+void *
+pw_arena_alloc(struct pw_arena *arena, size_t size)
+{
+	struct pw_arena_page *page = arena->head;
+	void *ret;
+
+	size = (size + PW_ARENA_ALIGN - 1) & ~(size_t)(PW_ARENA_ALIGN - 1);
+	if (page && page->size - page->used >= size) {
+		ret = page->data + page->used;
+		page->used += size;
+		return ret;
+	}
+
+	if (size > arena->page_size / 4) {
+		/* big allocations get their own page, behind the current one */
+		page = calloc(1, sizeof(*page) + size);
+		if (!page) {
+			return NULL;
+		}
+
+		page->size = page->used = size;
+		if (arena->head) {
+			page->next = arena->head->next;
+			arena->head->next = page;
+		} else {
+			arena->head = page;
+		}
+		return page->data;
+	}
+
+	page = calloc(1, sizeof(*page) + arena->page_size);
+	if (!page) {
+		return NULL;
+	}
+
+	page->size = arena->page_size;
+	page->used = size;
+	page->next = arena->head;
+	arena->head = page;
+	return page->data;
+}
+
+void
+pw_arena_free(struct pw_arena *arena)
+{
+	struct pw_arena_page *page;
+
+	if (!arena) {
+		return;
+	}
+
+	page = arena->head;
+	while (page) {
+		struct pw_arena_page *next = page->next;
+
+		free(page);
+		page = next;
+	}
+
+	free(arena);
+}
+
+void
+wsnprintf(uint16_t *dst, size_t dstsize, const char *src) {
+	char c;
+
+	memset(dst, 0, dstsize);
+	while (dstsize > 0 && (c = *src++)) {
+		if (c == '\n' && dstsize >= 2) {
+			*dst++ = '\r';
+			*dst++ = '\n';
+			dstsize -= 2;
+		} else {
+			*dst++ = c;
+			dstsize--;
+		}
+	}
+
+	if (dstsize == 0) {
+		*(dst - 1) = 0;
+	} else {
+		*dst = 0;
+	}
+}
+
+uint32_t
+js_strlen(const char *str)
+{
+	uint32_t len = 0;
+	char c;
+
+	while ((c = *str++)) {
+		if (c == '\n') {
+			len++;
+		}
+		len++;
+	}
+	return len;
+}
+
+int
+pw_version_load(struct pw_version *ver)
+{
+	FILE *fp = fopen("patcher/version", "rb");
+
+	if (!fp) {
+		memset(ver, 0, sizeof(*ver));
+		ver->magic = PW_VERSION_MAGIC;
+		return errno;
+	}
+
+	fread(ver, 1, sizeof(*ver), fp);
+	ver->branch[sizeof(ver->branch) - 1] = 0;
+	fclose(fp);
+
+	if (ver->magic != PW_VERSION_MAGIC) {
+		memset(ver, 0, sizeof(*ver));
+		ver->magic = PW_VERSION_MAGIC;
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+pw_version_save(struct pw_version *ver)
+{
+	FILE *fp = fopen("patcher/version", "wb");
+
+	if (!fp) {
+		return -errno;
+	}
+
+	fwrite(ver, 1, sizeof(*ver), fp);
+	ver->branch[sizeof(ver->branch) - 1] = 0;
+	fclose(fp);
+
+	return 0;
+}
+
+void
+pwlog(int type, const char *filename, unsigned lineno, const char *fnname, const char *fmt, ...)
+{
+	va_list args;
+	const char *type_str;
+
+	if (type > g_pwlog_level) {
+		return;
+	}
 
 	switch (type) {
 		case LOG_ERROR:
@@ -428,11 +1681,97 @@ pwlog(int type, const char *filename, unsigned lineno, const char *fnname, const
 	fflush(stderr);
 }
 
-static void __attribute__((constructor))
-common_init()
+static unsigned g_num_threads;
+
+unsigned
+pw_get_num_threads(void)
+{
+	const char *env;
+	long num;
+
+	if (g_num_threads > 0) {
+		return g_num_threads;
+	}
+
+	env = getenv("PW_THREADS");
+	num = env ? atoi(env) : 0;
+	if (num <= 0) {
+#ifdef __MINGW32__
+		SYSTEM_INFO info;
+
+		GetSystemInfo(&info);
+		num = info.dwNumberOfProcessors;
+#else
+		num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+
+	g_num_threads = MAX(1, MIN(num, PW_MAX_THREADS));
+	return g_num_threads;
+}
+
+void
+pw_set_num_threads(unsigned num)
+{
+	g_num_threads = MIN(num, PW_MAX_THREADS);
+}
+
+struct parallel_for_ctx {
+	size_t count;
+	size_t next;
+	pw_parallel_for_fn fn;
+	void *ctx;
+};
+
+/* set on pw_parallel_for() workers, nested loops run inline */
+static __thread bool t_in_parallel_for;
+
+static void *
+parallel_for_worker(void *arg)
+{
+	struct parallel_for_ctx *pf = arg;
+	size_t i;
+
+	t_in_parallel_for = true;
+	while ((i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED)) < pf->count) {
+		pf->fn(pf->ctx, i);
+	}
+
+	return NULL;
+}
+
+void
+pw_parallel_for(size_t count, pw_parallel_for_fn fn, void *ctx)
 {
-	g_nullfile = fopen("/dev/null", "w");
-	if (g_nullfile == NULL) {
-		g_nullfile = fopen("NUL", "w");
+	struct parallel_for_ctx pf = { .count = count, .fn = fn, .ctx = ctx };
+	pthread_t threads[PW_MAX_THREADS];
+	unsigned num_threads = MIN(pw_get_num_threads(), count);
+	unsigned started = 0;
+	unsigned i;
+
+	if (t_in_parallel_for) {
+		size_t j;
+
+		for (j = 0; j < count; j++) {
+			fn(ctx, j);
+		}
+		return;
+	}
+
+	/* the calling thread is one of the workers */
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL, parallel_for_worker, &pf) != 0) {
+			/* not fatal, there will be just fewer workers */
+			PWLOG(LOG_ERROR, "pthread_create() failed\n");
+			break;
+		}
+		started++;
+	}
+
+	parallel_for_worker(&pf);
+	t_in_parallel_for = false;
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
 	}
 }
@@ -10,10 +10,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
-
-#ifndef NO_ICONV
-#include <iconv.h>
-#endif
+#include <string.h>
 
 #ifdef __MINGW32__
 #include <sys/types.h>
@@ -41,7 +38,6 @@
 #define PW_POINTER_BUF_SIZE 8
 
 extern const char g_zeroes[4096];
-extern FILE *g_nullfile;
 extern int g_idmap_can_set;
 
 extern bool g_cfg_d3d8;
@@ -57,41 +53,112 @@ struct pw_version {
 
 int download(const char *url, const char *filename);
 int readfile(const char *path, char **buf, size_t *len);
+/* the downloaded data is null-terminated */
 int download_mem(const char *url, char **buf, size_t *len);
+/* returning non-zero stops the download, download_cb() then returns the same value */
+typedef int (*download_data_cb)(void *ctx, const char *data, size_t len);
+/* pass the data to cb in chunks as it arrives, without saving it anywhere */
+int download_cb(const char *url, download_data_cb cb, void *ctx);
+
+/**
+ * Growable in-memory output. The current length doubles as a save point:
+ * anything written after pw_buf_mark() can be dropped with pw_buf_rollback(),
+ * which is how the serializer undoes trailing commas and empty objects.
+ */
+struct pw_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+	/* don't store anything, just count the length. Used to compute sizes */
+	bool null;
+	/* an allocation failed, everything written afterwards is lost */
+	bool oom;
+};
 
-void sprint(char *dst, size_t dstsize, const char *src, int srcsize);
-void fsprint(FILE *fp, const char *buf, int maxlen);
-void fwsprint(FILE *fp, const uint16_t *buf, int maxlen);
-void fwsprintf(FILE *fp, const char *fmt, const uint16_t *buf, int maxlen);
-void wsnprintf(uint16_t *dst, size_t dstsize, const char *src);
+#define PW_BUF_NULL_INIT { .null = true }
 
-const char *get_basename(const char *in);
-const char *get_extension(const char *in);
+int pw_buf_reserve(struct pw_buf *buf, size_t len);
+void pw_buf_write(struct pw_buf *buf, const void *data, size_t len);
+void pw_buf_printf(struct pw_buf *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
-static int __attribute__ ((unused)) __attribute__((optimize("O0")))
-change_charset(char *src_charset, char *dst_charset, char *src, long srclen, char *dst, long dstlen)
+/* enough for "-1.23456789e-45" and "nan" */
+#define PW_FTOA_BUF_SIZE 24
+/**
+ * Print the shortest decimal that parses back into the same float, e.g. "0.1"
+ * instead of "0.10000000". Integral values keep a ".0" so they still read as
+ * floats, very small and very big values use the exponent notation.
+ * Returns the length of the string.
+ */
+int pw_ftoa(float f, char *out);
+void pw_buf_print_float(struct pw_buf *buf, float f);
+/* write the whole buffer to a file (replacing it) */
+int pw_buf_save(struct pw_buf *buf, const char *filename);
+void pw_buf_free(struct pw_buf *buf);
+
+/**
+ * Bump allocator for data that lives as long as its owner, e.g. everything
+ * nested in a loaded file. Allocations are zeroed and can be only freed all
+ * at once with pw_arena_free(). Not thread-safe.
+ */
+struct pw_arena;
+/* page_size is the size of each internal allocation, 0 for a default */
+struct pw_arena *pw_arena_init(size_t page_size);
+void *pw_arena_alloc(struct pw_arena *arena, size_t size);
+void pw_arena_free(struct pw_arena *arena);
+
+static inline void
+pw_buf_putc(struct pw_buf *buf, char c)
 {
-	if (!src || !dst) {
-		return -1;
+	if (buf->null) {
+		buf->len++;
+		return;
 	}
 
-#ifdef NO_ICONV
-	return 0;
-#else
-	iconv_t cd;
-	int rc;
-
-	cd = iconv_open(dst_charset, src_charset);
-	if (cd == 0) {
-		return -1;
+	if (buf->len + 1 >= buf->cap && pw_buf_reserve(buf, 1) != 0) {
+		return;
 	}
 
-	rc = iconv(cd, &src, (size_t *) &srclen, &dst, (size_t *) &dstlen);
-	iconv_close(cd);
-	return rc;
-#endif
+	buf->data[buf->len++] = c;
+}
+
+static inline void
+pw_buf_puts(struct pw_buf *buf, const char *str)
+{
+	pw_buf_write(buf, str, strlen(str));
+}
+
+static inline size_t
+pw_buf_mark(struct pw_buf *buf)
+{
+	return buf->len;
+}
+
+/* same as fseek() back on a file, the following writes overwrite the old data */
+static inline void
+pw_buf_rollback(struct pw_buf *buf, size_t mark)
+{
+	if (mark < buf->len) {
+		buf->len = mark;
+	}
 }
 
+void sprint(char *dst, size_t dstsize, const char *src, int srcsize);
+/* GB2312 / UTF-16LE strings converted to UTF-8 and escaped for json */
+void pw_buf_sprint(struct pw_buf *buf, const char *str, int maxlen);
+void pw_buf_wsprint(struct pw_buf *buf, const uint16_t *str, int maxlen);
+void wsnprintf(uint16_t *dst, size_t dstsize, const char *src);
+
+const char *get_basename(const char *in);
+const char *get_extension(const char *in);
+
+/**
+ * Convert between charsets, just like iconv() would. That includes converting
+ * up to the first invalid or truncated character and returning -1 there,
+ * or when the output is full. UTF-8, UTF-16LE, GBK and GB2312 are converted
+ * without iconv, other charsets go through cached iconv handles.
+ */
+int change_charset(const char *src_charset, const char *dst_charset, const char *src, long srclen, char *dst, long dstlen);
+
 void normalize_json_string(char *str, bool use_crlf);
 
 #define LOG_ERROR 0
@@ -101,6 +168,20 @@ void normalize_json_string(char *str, bool use_crlf);
 #define LOG_DEBUG_5 105
 extern int g_pwlog_level;
 void pwlog(int type, const char *filename, unsigned lineno, const char *fnname, const char *fmt, ...);
+
+#define PW_MAX_THREADS 64
+
+/* number of online CPUs, unless overridden with PW_THREADS env or pw_set_num_threads() */
+unsigned pw_get_num_threads(void);
+void pw_set_num_threads(unsigned num);
+
+typedef void (*pw_parallel_for_fn)(void *ctx, size_t i);
+/**
+ * Call fn(ctx, i) for every i in [0, count) on up to pw_get_num_threads()
+ * threads, including the calling one. Returns once all calls are done.
+ * When called from inside another pw_parallel_for(), it runs serially.
+ */
+void pw_parallel_for(size_t count, pw_parallel_for_fn fn, void *ctx);
 #define PWLOG(type, ...) pwlog((type), __FILE__, __LINE__, __func__, __VA_ARGS__)
 
 int pw_version_load(struct pw_version *ver);
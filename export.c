@@ -155,6 +155,7 @@ print_elements(const char *path)
 
 	pw_elements_save(&elements, "config/elements.data.srv", true);
 	pw_elements_save(&elements, "config/elements.data.cl", false);
+	pw_elements_free(&elements);
 
 	return 0;
 }
@@ -180,6 +181,7 @@ print_npcgen()
 
 		snprintf(tmpbuf, sizeof(tmpbuf), "json/%s/spawners.json", map->name);
 		pw_npcs_serialize(&npc, "spawners", tmpbuf);
+		pw_npcs_free(&npc);
 	}
 
 	return 0;
@@ -214,6 +216,7 @@ print_tasks(const char *path)
 	free(buf);
 
 	rc = pw_tasks_serialize(&taskf, "tasks.json");
+	pw_tasks_free(&taskf);
 	if (rc) {
 		PWLOG(LOG_ERROR, "pw_tasks_serialize() failed: %d\n", rc);
 		return rc;
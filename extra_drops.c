@@ -44,6 +44,7 @@ extra_drops_load(const char *filename)
 {
 	FILE *fp;
 	struct pw_chain_table table;
+	struct pw_arena *arena;
 	void *el;
 	int rc, i;
 
@@ -66,7 +67,10 @@ extra_drops_load(const char *filename)
 	fread(&count, sizeof(count), 1, fp);
 	fprintf(stderr, "count=%d\n", count);
 
-	rc = pw_chain_table_init(&table, "extra_drops", extra_drop_serializer, serializer_get_size(extra_drop_serializer), count);
+	arena = pw_arena_init(0);
+	assert(arena);
+
+	rc = pw_chain_table_init(&table, "extra_drops", extra_drop_serializer, serializer_get_size(extra_drop_serializer), count, arena);
 	assert(rc == 0);
 
 	table.chain->count = table.chain->capacity;
@@ -78,7 +82,7 @@ extra_drops_load(const char *filename)
 		fread(&num, sizeof(num), 1, fp);
 
 		struct pw_chain_table **tbl_p = el;
-		*tbl_p = pw_chain_table_fread(fp, "monster_ids", num, monster_id_serializer);
+		*tbl_p = pw_chain_table_fread(fp, "monster_ids", num, monster_id_serializer, arena);
 
 		fread(el + PW_POINTER_BUF_SIZE, serializer_get_size(extra_drop_serializer) - PW_POINTER_BUF_SIZE, 1, fp);
 
@@ -86,30 +90,17 @@ extra_drops_load(const char *filename)
 	}
 
 	fclose(fp);
-	fp = fopen("extra_drops.json", "wb");
-	if (fp == NULL) {
-		PWLOG(LOG_ERROR, "cant open extra_drops.json\n");
-		return;
-	}
 
-	fprintf(fp, "[");
-	PW_CHAIN_TABLE_FOREACH(el, &table) {
-		struct serializer *tmp_slzr = extra_drop_serializer;
-		size_t pos_begin = ftell(fp);
-		void *tmp_el = el;
+	struct pw_buf buf = {};
 
-		_serialize(fp, &tmp_slzr, &tmp_el, 1, true, true, true);
-
-		if (ftell(fp) > pos_begin + 2) {
-			fprintf(fp, ",\n");
-		}
-	}
+	pw_buf_putc(&buf, '[');
+	pw_chain_table_serialize_objs(&buf, &table, true, ",\n", 2);
 
 	/* replace ,\n} with }] */
-	fseek(fp, -3, SEEK_CUR);
-	fprintf(fp, "}]");
+	pw_buf_rollback(&buf, pw_buf_mark(&buf) - 3);
+	pw_buf_write(&buf, "}]", 2);
 
-	size_t sz = ftell(fp);
-	fclose(fp);
-	truncate("extra_drops.json", sz);
+	pw_buf_save(&buf, "extra_drops.json");
+	pw_buf_free(&buf);
+	pw_arena_free(arena);
 }
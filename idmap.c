@@ -127,34 +127,50 @@ idmap_load_dat(struct pw_idmap *map, const char *filename)
 	return 0;
 }
 
+/* "#pid:off" or just "pid" */
+static uint64_t
+parse_lid(const char *s)
+{
+	uint32_t pid = 0, off = 0;
+
+	if (*s == '#') {
+		s++;
+	}
+
+	while (*s >= '0' && *s <= '9') {
+		pid = pid * 10 + (*s++ - '0');
+	}
+
+	if (*s != ':' || s[1] < '0' || s[1] > '9') {
+		return pid;
+	}
+
+	s++;
+	while (*s >= '0' && *s <= '9') {
+		off = off * 10 + (*s++ - '0');
+	}
+
+	return (pid > 0 ? 0x80000000 : 0) + 0x100000 * pid + off;
+}
+
 static void
 idmap_load_json_cb(void *_map, struct cjson *obj)
 {
+	static struct cjson_path lid_path = CJSON_PATH("lid");
+	static struct cjson_path id_path = CJSON_PATH("id");
+	static struct cjson_path type_path = CJSON_PATH("type");
 	struct pw_idmap *map = _map;
 	struct pw_idmap_file_entry e;
 
-	struct cjson *lid_o = JS(obj, "lid");
+	struct cjson *lid_o = JP(obj, &lid_path);
 	if (lid_o->type == CJSON_TYPE_STRING) {
-		const char *s = lid_o->s;
-		int rc, pid, off;
-
-
-		if (s[0] == '#') {
-			s++;
-		}
-
-		rc = sscanf(s, "%u:%u", &pid, &off);
-		if (rc == 2) {
-			e.lid = (pid > 0 ? 0x80000000 : 0) + 0x100000 * pid + off;
-		} else {
-			e.lid = pid;
-		}
+		e.lid = parse_lid(lid_o->s);
 	} else {
 		e.lid = lid_o->i;
 	}
 
-	e.id = JSi(obj, "id");
-	e.type = JSi(obj, "type");
+	e.id = JPi(obj, &id_path);
+	e.type = JPi(obj, &type_path);
 
 	idmap_add_entry(map, e);
 }
@@ -162,19 +178,18 @@ idmap_load_json_cb(void *_map, struct cjson *obj)
 static int
 idmap_load_json(struct pw_idmap *map, const char *filename)
 {
-	char *buf;
-	size_t buflen;
+	FILE *fp;
 	int rc;
 
-	rc = readfile(filename, &buf, &buflen);
-	if (rc != 0) {
+	fp = fopen(filename, "rb");
+	if (!fp) {
 		/* we'll create it on pw_idmap_save(), no problem */
 		return 0;
 	}
 
-	rc = cjson_parse_arr_stream(buf, idmap_load_json_cb, map);
-	free(buf);
-	return rc > 0 ? 0 : rc;
+	rc = cjson_feed_fp(fp, idmap_load_json_cb, map);
+	fclose(fp);
+	return rc;
 }
 
 struct pw_idmap *
@@ -450,6 +465,59 @@ pw_idmap_set(struct pw_idmap *map, long long lid, long type, void *data)
 	return el;
 }
 
+static void
+idmap_collect_type_cb(void *_node, void *ctx1, void *ctx2)
+{
+	struct pw_avl_node *node = _node;
+	struct pw_idmap_el *el = (void *)node->data;
+	struct pw_buf *buf = ctx1;
+	long type = *(long *)ctx2;
+
+	if (el->is_async_fn || (type && el->type != type)) {
+		return;
+	}
+
+	pw_buf_write(buf, &el, sizeof(el));
+}
+
+void
+pw_idmap_clear(struct pw_idmap *map, long type)
+{
+	struct pw_buf buf = {};
+	struct pw_idmap_el **els;
+	size_t i, cnt;
+
+	/* the tree can't be modified while iterating it */
+	pw_avl_foreach(map->by_lid, idmap_collect_type_cb, &buf, &type);
+	if (buf.oom) {
+		PWLOG(LOG_ERROR, "%s: out of memory, entries left in place\n", map->name);
+		pw_buf_free(&buf);
+		return;
+	}
+
+	els = (void *)buf.data;
+	cnt = buf.len / sizeof(*els);
+	for (i = 0; i < cnt; i++) {
+		struct pw_idmap_el *el = els[i];
+		struct pw_idmap_el **el_p;
+
+		el_p = pw_avl_get(map->by_id, el->id);
+		while (el_p && *el_p != el) {
+			el_p = pw_avl_get_next(map->by_id, el_p);
+		}
+
+		if (el_p) {
+			pw_avl_remove(map->by_id, el_p);
+			pw_avl_free(map->by_id, el_p);
+		}
+
+		pw_avl_remove(map->by_lid, el);
+		pw_avl_free(map->by_lid, el);
+	}
+
+	pw_buf_free(&buf);
+}
+
 static void
 idmap_save_dat_cb(void *_node, void *ctx1, void *ctx2)
 {
@@ -26,6 +26,12 @@ long pw_idmap_register_type(struct pw_idmap *map);
 struct pw_idmap_el *pw_idmap_get(struct pw_idmap *map, long long lid, long type);
 int pw_idmap_get_async(struct pw_idmap *map, long long lid, long type, pw_idmap_async_fn fn, void *fn_ctx);
 struct pw_idmap_el *pw_idmap_set(struct pw_idmap *map, long long lid, long type, void *data);
+/**
+ * Forget all the set entries of given type (0 for all types), e.g. before
+ * their data is freed. The lid <-> id mappings are kept, so the same ids are
+ * assigned on the next pw_idmap_set(). Pending async lookups are kept too.
+ */
+void pw_idmap_clear(struct pw_idmap *map, long type);
 int pw_idmap_save(struct pw_idmap *map, const char *filename);
 
 #endif /* PW_IDMAP_H */
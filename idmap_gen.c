@@ -40,8 +40,10 @@ import_stream_cb(void *ctx, struct cjson *obj)
 		return;
 	}
 
-	const char *type = JSs(obj, "_db", "type");
-	long long id = JSi(obj, "id");
+	static struct cjson_path db_type_path = CJSON_PATH("_db.type");
+	static struct cjson_path id_path = CJSON_PATH("id");
+	const char *type = JPs(obj, &db_type_path);
+	long long id = JPi(obj, &id_path);
 	PWLOG(LOG_INFO, "type: %s, id: 0x%llx\n", type, id);
 
 	if (strncmp(type, "spawners_", 9) == 0) {
@@ -110,14 +112,21 @@ main(int argc, char *argv[])
 		return 1;
 	}
 
+	struct cjson_arena *arena = cjson_arena_init(0);
+	if (!arena) {
+		PWLOG(LOG_ERROR, "cjson_arena_init() failed\n");
+		return 1;
+	}
+
 	char *b = buf;
 	do {
-		rc = cjson_parse_arr_stream(b, import_stream_cb, NULL);
+		rc = cjson_parse_arr_stream_arena(b, arena, import_stream_cb, NULL);
 		/* skip comma and newline */
 		b += rc;
 		while (*b && *b != '[') b++;
 	} while (rc > 0);
 
+	cjson_arena_free(arena);
 	free(buf);
 	if (rc < 0) {
 		PWLOG(LOG_ERROR, "cjson_parse_arr_stream() failed: %d\n", rc);
@@ -10,6 +10,7 @@
 #include <sys/types.h>
 #include <limits.h>
 #include <assert.h>
+#include <errno.h>
 
 #include "common.h"
 #include "cjson_ext.h"
@@ -59,17 +60,13 @@ memcmp_ic(const char *s1, const char *s2, size_t nbytes)
 }
 
 static size_t
-icon_serialize_fn(FILE *fp, struct serializer *f, void *data)
+icon_serialize_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	unsigned len = 128;
 	char out[1024] = {};
 	char *tmp = out, *basename = out;
 	int i;
 
-	if (fp == g_nullfile) {
-		return 128;
-	}
-
 	sprint(out, sizeof(out), data, len);
 	while (*tmp) {
 		if (*tmp == '\\') {
@@ -88,14 +85,14 @@ icon_serialize_fn(FILE *fp, struct serializer *f, void *data)
 		return 128;
 	}
 
-	fprintf(fp, "\"icon\":%d,", i);
+	pw_buf_printf(buf, "\"icon\":%d,", i);
 	return 128;
 }
 
 static size_t
 icon_deserialize_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE || !g_icon_names[0]) {
 		return 128;
@@ -109,35 +106,36 @@ icon_deserialize_fn(struct cjson *f, struct serializer *slzr, void *data)
 }
 
 static size_t
-float_or_int_fn(FILE *fp, struct serializer *f, void *data)
+float_or_int_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t u = *(uint32_t *)data;
 
 	if (u > 10240) {
-		fprintf(fp, "%.8f,", *(float *)&u);
+		pw_buf_print_float(buf, *(float *)&u);
+		pw_buf_putc(buf, ',');
 	} else {
-		fprintf(fp, "%u,", u);
+		pw_buf_printf(buf, "%u,", u);
 	}
 
 	return 4;
 }
 
 static size_t
-serialize_item_id_fn(FILE *fp, struct serializer *f, void *data)
+serialize_item_id_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 	uint32_t color;
 	char *desc;
 
-	fprintf(fp, "\"id\":%u,", id);
+	pw_buf_printf(buf, "\"id\":%u,", id);
 	color = g_item_colors[id];
 	if (color) {
-		fprintf(fp, "\"color\":%u,", color);
+		pw_buf_printf(buf, "\"color\":%u,", color);
 	}
 
 	desc = g_item_descs[id];
 	if (desc) {
-		fprintf(fp, "\"desc\":\"%s\",", desc);
+		pw_buf_printf(buf, "\"desc\":\"%s\",", desc);
 	}
 
 	return 4;
@@ -160,7 +158,7 @@ deserialize_id_field_async_fn(struct pw_idmap_el *node, void *target_data)
 static size_t
 deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -181,7 +179,7 @@ deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void
 }
 
 static size_t
-serialize_elements_id_field_fn(FILE *fp, struct serializer *f, void *data)
+serialize_elements_id_field_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	/* TODO */
 	return 4;
@@ -192,7 +190,7 @@ static struct serializer equipment_addon_serializer[] = {
 	{ "name", _WSTRING(32) },
 	{ "num_params", _INT32 },
 	{ "params", _ARRAY_START(3) },
-		{ "", _CUSTOM, float_or_int_fn },
+		{ "", _CUSTOM(4), float_or_int_fn },
 	{ "", _ARRAY_END },
 	{ "", _TYPE_END },
 };
@@ -203,7 +201,7 @@ static struct serializer mines_serializer[] = {
 	{ "name", _WSTRING(32) },
 	{ "level", _INT32 },
 	{ "level_required", _INT32 },
-	{ "item_required", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "item_required", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "use_up_tool", _INT32 },
 	{ "time_min", _INT32 },
 	{ "time_max", _INT32 },
@@ -211,7 +209,7 @@ static struct serializer mines_serializer[] = {
 	{ "sp", _INT32 },
 	{ "file_model", _STRING(128) },
 	{ "mat_item", _ARRAY_START(16) },
-		{ "id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+		{ "id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 		{ "prob", _FLOAT },
 	{ "", _ARRAY_END },
 	{ "mat_count", _ARRAY_START(2) },
@@ -250,7 +248,7 @@ static struct serializer monsters_serializer[] = {
 	{ "role_in_war", _INT32 },
 	{ "level", _INT32 },
 	{ "show_level", _INT32 },
-	{ "id_pet_egg", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_pet_egg", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "hp", _INT32 },
 	{ "phys_def", _INT32 },
 	{ "magic_def", _ARRAY_START(5) },
@@ -354,7 +352,7 @@ static struct serializer recipes_serializer[] = {
 	{ "skill_level", _INT32 },
 	{ "_bind_type", _INT32 },
 	{ "targets", _ARRAY_START(4) },
-		{ "id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+		{ "id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 		{ "prob", _FLOAT },
 	{ "", _ARRAY_END },
 	{ "fail_prob", _FLOAT },
@@ -364,7 +362,7 @@ static struct serializer recipes_serializer[] = {
 	{ "xp", _INT32 },
 	{ "sp", _INT32 },
 	{ "mats", _ARRAY_START(32) },
-		{ "id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+		{ "id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 		{ "num", _INT32 },
 	{ "", _ARRAY_END },
 	{ "", _TYPE_END },
@@ -376,7 +374,7 @@ static struct serializer npc_sells_serializer[] = {
 	{ "pages", _ARRAY_START(8) },
 		{ "title", _WSTRING(8) },
 		{ "item_id", _ARRAY_START(32) },
-			{ "", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+			{ "", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 		{ "", _ARRAY_END },
 	{ "", _ARRAY_END },
 	{ "_id_dialog", _INT32 },
@@ -391,38 +389,38 @@ static struct serializer npcs_serializer[] = {
 	{ "attack_rule", _INT32 },
 	{ "file_model", _STRING(128) },
 	{ "tax_rate", _FLOAT },
-	{ "base_monster_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "base_monster_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "greeting", _WSTRING(256) },
-	{ "target_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "target_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "domain_related", _INT32 },
-	{ "id_talk_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_sell_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_buy_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_repair_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_install_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_uninstall_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_task_out_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_task_in_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_task_matter_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_skill_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_heal_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_transmit_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_transport_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_proxy_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_storage_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_make_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_decompose_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_identify_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_war_towerbuild_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_resetprop_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_petname_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_petlearnskill_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_petforgetskill_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_equipbind_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_equipdestroy_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "id_equipundestroy_service", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_talk_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_sell_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_buy_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_repair_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_install_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_uninstall_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_task_out_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_task_in_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_task_matter_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_skill_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_heal_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_transmit_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_transport_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_proxy_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_storage_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_make_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_decompose_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_identify_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_war_towerbuild_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_resetprop_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_petname_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_petlearnskill_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_petforgetskill_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_equipbind_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_equipdestroy_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_equipundestroy_service", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "combined_services", _INT32 },
-	{ "id_mine", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id_mine", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "", _TYPE_END },
 };
 
@@ -445,7 +443,7 @@ static struct serializer npc_crafts_serializer[] = {
 	{ "pages", _ARRAY_START(8) },
 		{ "title", _WSTRING(8) },
 		{ "recipe_id", _ARRAY_START(32) },
-			{ "", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+			{ "", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 		{ "", _ARRAY_END },
 	{ "", _ARRAY_END },
 	{ "", _TYPE_END },
@@ -474,7 +472,7 @@ static struct serializer weapon_minor_types_serializer[] = {
 };
 
 static struct serializer weapon_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(1) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
@@ -483,7 +481,7 @@ static struct serializer weapon_essence_serializer[] = {
 	{ "file_model_right", _STRING(128) },
 	{ "file_model_left", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "require_strength", _INT32 },
 	{ "require_dexterity", _INT32 },
 	{ "require_magic", _INT32 },
@@ -533,7 +531,7 @@ static struct serializer weapon_essence_serializer[] = {
 	{ "durability_drop_max", _INT32 },
 	{ "decompose_price", _INT32 },
 	{ "decompose_time", _INT32 },
-	{ "element_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "element_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "element_num", _INT32 },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
@@ -555,14 +553,14 @@ static struct serializer armor_minor_types_serializer[] = {
 };
 
 static struct serializer armor_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(2) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "realname", _STRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "equip_location", _INT32 },
 	{ "level", _INT32 },
 	{ "require_strength", _INT32 },
@@ -612,7 +610,7 @@ static struct serializer armor_essence_serializer[] = {
 	{ "durability_drop_max", _INT32 },
 	{ "decompose_price", _INT32 },
 	{ "decompose_time", _INT32 },
-	{ "element_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "element_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "element_num", _INT32 },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
@@ -634,14 +632,14 @@ static struct serializer decoration_minor_types_serializer[] = {
 };
 
 static struct serializer decoration_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(3) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_model", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "level", _INT32 },
 	{ "require_strength", _INT32 },
 	{ "require_agility", _INT32 },
@@ -684,7 +682,7 @@ static struct serializer decoration_essence_serializer[] = {
 	{ "durability_drop_max", _INT32 },
 	{ "decompose_price", _INT32 },
 	{ "decompose_time", _INT32 },
-	{ "element_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "element_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "element_num", _INT32 },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
@@ -705,13 +703,13 @@ static struct serializer medicine_minor_types_serializer[] = {
 };
 
 static struct serializer medicine_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(4) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "require_level", _INT32 },
 	{ "cool_time", _INT32 },
 	{ "hp_add_total", _INT32 },
@@ -739,18 +737,18 @@ static struct serializer material_sub_type_serializer[] = {
 };
 
 static struct serializer material_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(5) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "decompose_price", _INT32 },
 	{ "decompose_time", _INT32 },
-	{ "element_id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "element_id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "element_num", _INT32 },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
@@ -759,12 +757,12 @@ static struct serializer material_essence_serializer[] = {
 };
 
 static struct serializer damagerune_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(6) },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "is_magic", _INT32 },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
@@ -778,12 +776,12 @@ static struct serializer damagerune_essence_serializer[] = {
 };
 
 static struct serializer armorrune_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(7) },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "file_gfx", _STRING(128) },
 	{ "file_sfx", _STRING(128) },
 	{ "is_magic", _INT32 },
@@ -800,12 +798,12 @@ static struct serializer armorrune_essence_serializer[] = {
 };
 
 static struct serializer skilltome_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(8) },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "stack_max", _INT32 },
@@ -815,12 +813,12 @@ static struct serializer skilltome_essence_serializer[] = {
 };
 
 static struct serializer flysword_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(9) },
 	{ "name", _WSTRING(32) },
 	{ "file_model", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "level", _INT32 },
@@ -841,12 +839,12 @@ static struct serializer flysword_essence_serializer[] = {
 };
 
 static struct serializer wingmanwing_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(10) },
 	{ "name", _WSTRING(32) },
 	{ "file_model", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "require_level", _INT32 },
@@ -860,11 +858,11 @@ static struct serializer wingmanwing_essence_serializer[] = {
 };
 
 static struct serializer townscroll_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(11) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "use_time", _FLOAT },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
@@ -875,11 +873,11 @@ static struct serializer townscroll_essence_serializer[] = {
 };
 
 static struct serializer revivescroll_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(12) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "use_time", _FLOAT },
 	{ "cool_time", _INT32 },
 	{ "price", _INT32 },
@@ -891,11 +889,11 @@ static struct serializer revivescroll_essence_serializer[] = {
 };
 
 static struct serializer element_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(13) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "level", _INT32 },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
@@ -906,10 +904,10 @@ static struct serializer element_essence_serializer[] = {
 };
 
 static struct serializer taskmatter_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(14) },
 	{ "name", _WSTRING(32) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
 	{ "proc_type", _INT32 },
@@ -917,12 +915,12 @@ static struct serializer taskmatter_essence_serializer[] = {
 };
 
 static struct serializer tossmatter_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(15) },
 	{ "name", _WSTRING(32) },
 	{ "file_model", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "file_firegfx", _STRING(128) },
 	{ "file_hitgfx", _STRING(128) },
 	{ "file_hitsfx", _STRING(128) },
@@ -949,13 +947,13 @@ static struct serializer projectile_types_serializer[] = {
 };
 
 static struct serializer projectile_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(16) },
 	{ "projectile_types", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_model", _STRING(128) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "file_firegfx", _STRING(128) },
 	{ "file_hitgfx", _STRING(128) },
 	{ "file_hitsfx", _STRING(128) },
@@ -981,12 +979,12 @@ static struct serializer quiver_sub_type_serializer[] = {
 };
 
 static struct serializer quiver_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(17) },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "id_projectile", _INT32 },
 	{ "num_min", _INT32 },
 	{ "num_max", _INT32 },
@@ -1000,12 +998,12 @@ static struct serializer stone_types_serializer[] = {
 };
 
 static struct serializer stone_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(18) },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "level", _INT32 },
 	{ "color", _INT32 },
 	{ "price", _INT32 },
@@ -1025,7 +1023,7 @@ static struct serializer stone_essence_serializer[] = {
 static size_t
 deserialize_tasks_id_field_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -1045,22 +1043,22 @@ deserialize_tasks_id_field_fn(struct cjson *f, struct serializer *slzr, void *da
 }
 
 static size_t
-serialize_tasks_id_field_fn(FILE *fp, struct serializer *f, void *data)
+serialize_tasks_id_field_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 
-	fprintf(fp, "\"%s\":%d,", f->name, id);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, id);
 	return 4;
 }
 
 static struct serializer taskdice_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(19) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "tasks", _ARRAY_START(8) },
-		{ "id", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+		{ "id", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 		{ "prob", _FLOAT },
 	{ "", _ARRAY_END },
 	{ "use_on_pick", _INT32 },
@@ -1070,11 +1068,11 @@ static struct serializer taskdice_essence_serializer[] = {
 };
 
 static struct serializer tasknormalmatter_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(20) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "stack_max", _INT32 },
@@ -1084,14 +1082,14 @@ static struct serializer tasknormalmatter_essence_serializer[] = {
 };
 
 static struct serializer fashion_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(21) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "realname", _STRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "equip_location", _INT32 },
 	{ "level", _INT32 },
 	{ "require_level", _INT32 },
@@ -1106,13 +1104,13 @@ static struct serializer fashion_essence_serializer[] = {
 };
 
 static struct serializer faceticket_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(22) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "require_level", _INT32 },
 	{ "bound_file", _STRING(128) },
 	{ "unsymmetrical", _INT32 },
@@ -1125,13 +1123,13 @@ static struct serializer faceticket_essence_serializer[] = {
 };
 
 static struct serializer facepill_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(23) },
 	{ "major_type", _INT32 },
 	{ "minor_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "duration", _INT32 },
 	{ "camera_scale", _FLOAT },
 	{ "character_combo_id", _INT32 },
@@ -1147,12 +1145,12 @@ static struct serializer facepill_essence_serializer[] = {
 };
 
 static struct serializer gm_generator_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(24) },
 	{ "id_type", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "id_object", _INT32 },
 	{ "stack_max", _INT32 },
 	{ "has_guid", _INT32 },
@@ -1161,11 +1159,11 @@ static struct serializer gm_generator_essence_serializer[] = {
 };
 
 static struct serializer pet_egg_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(25) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "id_pet", _INT32 },
 	{ "money_hatched", _INT32 },
 	{ "money_restored", _INT32 },
@@ -1186,11 +1184,11 @@ static struct serializer pet_egg_essence_serializer[] = {
 };
 
 static struct serializer pet_food_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(26) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "level", _INT32 },
 	{ "hornor", _INT32 },
 	{ "exp", _INT32 },
@@ -1204,11 +1202,11 @@ static struct serializer pet_food_essence_serializer[] = {
 };
 
 static struct serializer pet_faceticket_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(27) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "stack_max", _INT32 },
@@ -1218,11 +1216,11 @@ static struct serializer pet_faceticket_essence_serializer[] = {
 };
 
 static struct serializer fireworks_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(28) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "file_fw", _STRING(128) },
 	{ "level", _INT32 },
 	{ "time_to_fire", _INT32 },
@@ -1235,11 +1233,11 @@ static struct serializer fireworks_essence_serializer[] = {
 };
 
 static struct serializer war_tankcallin_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(29) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "stack_max", _INT32 },
@@ -1249,11 +1247,11 @@ static struct serializer war_tankcallin_essence_serializer[] = {
 };
 
 static struct serializer skillmatter_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(30) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "level_required", _INT32 },
 	{ "id_skill", _INT32 },
 	{ "level_skill", _INT32 },
@@ -1266,11 +1264,11 @@ static struct serializer skillmatter_essence_serializer[] = {
 };
 
 static struct serializer refine_ticket_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(31) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "desc", _WSTRING(16) },
 	{ "ext_reserved_prob", _FLOAT },
 	{ "ext_succeed_prob", _FLOAT },
@@ -1287,11 +1285,11 @@ static struct serializer refine_ticket_essence_serializer[] = {
 };
 
 static struct serializer bible_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(32) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "addon_ids", _ARRAY_START(10) },
 		{ "", _INT32 },
 	{ "", _ARRAY_END },
@@ -1304,11 +1302,11 @@ static struct serializer bible_essence_serializer[] = {
 };
 
 static struct serializer speaker_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(33) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "id_icon_set", _INT32 },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
@@ -1319,11 +1317,11 @@ static struct serializer speaker_essence_serializer[] = {
 };
 
 static struct serializer autohp_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(34) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "total_hp", _INT32 },
 	{ "trigger_amount", _FLOAT },
 	{ "cool_time", _INT32 },
@@ -1336,11 +1334,11 @@ static struct serializer autohp_essence_serializer[] = {
 };
 
 static struct serializer automp_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(35) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "total_mp", _INT32 },
 	{ "trigger_amount", _FLOAT },
 	{ "cool_time", _INT32 },
@@ -1353,11 +1351,11 @@ static struct serializer automp_essence_serializer[] = {
 };
 
 static struct serializer double_exp_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(36) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "double_exp_time", _INT32 },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
@@ -1368,11 +1366,11 @@ static struct serializer double_exp_essence_serializer[] = {
 };
 
 static struct serializer transmitscroll_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(37) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "price", _INT32 },
 	{ "shop_price", _INT32 },
 	{ "stack_max", _INT32 },
@@ -1382,11 +1380,11 @@ static struct serializer transmitscroll_essence_serializer[] = {
 };
 
 static struct serializer dye_ticket_essence_serializer[] = {
-	{ "id", _CUSTOM, serialize_item_id_fn, deserialize_item_id_fn },
+	{ "id", _CUSTOM(4), serialize_item_id_fn, deserialize_item_id_fn },
 	{ "type", _CONST_INT(38) },
 	{ "name", _WSTRING(32) },
 	{ "file_matter", _STRING(128) },
-	{ "icon", _CUSTOM, icon_serialize_fn, icon_deserialize_fn },
+	{ "icon", _CUSTOM(128), icon_serialize_fn, icon_deserialize_fn },
 	{ "h_min", _FLOAT },
 	{ "h_max", _FLOAT },
 	{ "s_min", _FLOAT },
@@ -1406,7 +1404,7 @@ static struct serializer armor_sets_serializer[] = {
 	{ "name", _WSTRING(32) },
 	{ "max_equips", _INT32 },
 	{ "equip_ids", _ARRAY_START(12) },
-		{ "", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+		{ "", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "", _ARRAY_END },
 	{ "addon_ids", _ARRAY_START(11) },
 		{ "", _INT32 },
@@ -1468,7 +1466,7 @@ static struct serializer npc_tasks_in_serializer[] = {
 	{ "id", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "tasks", _ARRAY_START(32) },
-		{ "", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+		{ "", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "", _ARRAY_END },
 	{ "", _TYPE_END },
 };
@@ -1477,7 +1475,7 @@ static struct serializer npc_tasks_out_serializer[] = {
 	{ "id", _INT32 },
 	{ "name", _WSTRING(32) },
 	{ "tasks", _ARRAY_START(32) },
-		{ "", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+		{ "", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "", _ARRAY_END },
 	{ "", _TYPE_END },
 };
@@ -1616,130 +1614,180 @@ get_table(struct pw_elements *elements, const char *name)
 	return NULL;
 }
 
-#define EXPORT_TABLE(elements, table_name, filename) \
-({ \
-	FILE *fp = fopen(filename, "wb"); \
-	struct pw_chain_table *table = get_table(elements, #table_name); \
-	long sz; \
-\
-	if (fp == NULL) { \
-		PWLOG(LOG_ERROR, "cant open %s for writing\n", filename); \
-	} else { \
-		sz = serialize(fp, table->serializer, \
-				(void *)table->chain->data, table->chain->count); \
-		fclose(fp); \
-		truncate(filename, sz); \
-	} \
-})
+/* standalone tables, each exported to its own file */
+static const struct {
+	const char *table_name;
+	const char *filename;
+} g_export_tables[] = {
+	{ "mines", "mines.json" },
+	{ "monsters", "monsters.json" },
+	{ "recipes", "recipes.json" },
+	{ "npcs", "npcs.json" },
+	{ "npc_sells", "npc_sells.json" },
+	{ "npc_crafts", "npc_crafts.json" },
+
+	{ "weapon_major_types", "weapon_major_types.json" },
+	{ "weapon_minor_types", "weapon_minor_types.json" },
+	{ "armor_major_types", "armor_major_types.json" },
+	{ "armor_minor_types", "armor_minor_types.json" },
+	{ "decoration_major_types", "decoration_major_types.json" },
+	{ "decoration_minor_types", "decoration_minor_types.json" },
+
+	{ "armorrune_sub_type", "armorrune_types.json" },
+	{ "damagerune_sub_type", "attackrune_types.json" },
+
+	{ "medicine_major_types", "medicine_major_types.json" },
+	{ "medicine_minor_types", "medicine_minor_types.json" },
+
+	{ "projectile_types", "projectile_types.json" },
+	{ "quiver_sub_type", "quiver_types.json" },
+	{ "stone_types", "stone_types.json" },
+
+	{ "monster_addon", "monster_addons.json" },
+	{ "monster_type", "monster_types.json" },
+	{ "npc_type", "npc_types.json" },
+	{ "mine_type", "mine_types.json" },
+	{ "fashion_major_type", "fashion_major_types.json" },
+	{ "fashion_sub_type", "fashion_sub_types.json" },
+	{ "gm_generator_type", "gm_generator_types.json" },
+	{ "pet_type", "pet_types.json" },
+
+	{ "armor_sets", "armor_sets.json" },
+	{ "equipment_addon", "equipment_addon.json" },
+
+	{ "npc_tasks_in", "npc_tasks_in.json" },
+	{ "npc_tasks_out", "npc_tasks_out.json" },
+	{ "npc_task_matter_service", "npc_tasks_matter.json" },
+};
+
+/* item tables, all exported to items.json in this order */
+static const char *g_export_items[] = {
+	"weapon_essence",
+	"armor_essence",
+	"decoration_essence",
+	"medicine_essence",
+	"material_essence",
+	"damagerune_essence",
+	"armorrune_essence",
+	"skilltome_essence",
+	"flysword_essence",
+	"wingmanwing_essence",
+	"townscroll_essence",
+	"revivescroll_essence",
+	"element_essence",
+	"taskmatter_essence",
+	"tossmatter_essence",
+	"projectile_essence",
+	"quiver_essence",
+	"stone_essence",
+	"taskdice_essence",
+	"tasknormalmatter_essence",
+	"fashion_essence",
+	"faceticket_essence",
+	"facepill_essence",
+	"gm_generator_essence",
+	"pet_egg_essence",
+	"pet_food_essence",
+	"pet_faceticket_essence",
+	"fireworks_essence",
+	"war_tankcallin_essence",
+	"skillmatter_essence",
+	"refine_ticket_essence",
+	"bible_essence",
+	"speaker_essence",
+	"autohp_essence",
+	"automp_essence",
+	"double_exp_essence",
+	"transmitscroll_essence",
+	"dye_ticket_essence",
+};
+
+#define EXPORT_TABLES_CNT (sizeof(g_export_tables) / sizeof(g_export_tables[0]))
+#define EXPORT_ITEMS_CNT (sizeof(g_export_items) / sizeof(g_export_items[0]))
+
+/* tables this big are split into chunks serialized in parallel instead */
+#define EXPORT_CHUNKED_MIN_CNT 1024
+
+struct export_ctx {
+	struct pw_elements *elements;
+	struct pw_buf items[EXPORT_ITEMS_CNT];
+};
+
+static void
+export_table(struct export_ctx *ctx, size_t i, bool chunked)
+{
+	struct pw_chain_table *table;
+	struct pw_buf *buf, tmp_buf = {};
+	const char *name;
+
+	if (i < EXPORT_TABLES_CNT) {
+		name = g_export_tables[i].table_name;
+		buf = &tmp_buf;
+	} else {
+		name = g_export_items[i - EXPORT_TABLES_CNT];
+		buf = &ctx->items[i - EXPORT_TABLES_CNT];
+	}
+
+	table = get_table(ctx->elements, name);
+	if ((table->chain->count >= EXPORT_CHUNKED_MIN_CNT) != chunked) {
+		return;
+	}
+
+	if (chunked) {
+		serialize_parallel(buf, table->serializer, (void *)table->chain->data, table->chain->count);
+	} else {
+		serialize(buf, table->serializer, (void *)table->chain->data, table->chain->count);
+	}
+
+	if (i < EXPORT_TABLES_CNT) {
+		pw_buf_save(buf, g_export_tables[i].filename);
+		pw_buf_free(buf);
+	}
+}
+
+static void
+export_table_fn(void *ctx, size_t i)
+{
+	export_table(ctx, i, false);
+}
 
 void
 pw_elements_serialize(struct pw_elements *elements)
 {
-	EXPORT_TABLE(elements, mines, "mines.json");
-	EXPORT_TABLE(elements, monsters, "monsters.json");
-	EXPORT_TABLE(elements, recipes, "recipes.json");
-	EXPORT_TABLE(elements, npcs, "npcs.json");
-	EXPORT_TABLE(elements, npc_sells, "npc_sells.json");
-	EXPORT_TABLE(elements, npc_crafts, "npc_crafts.json");
-
-	EXPORT_TABLE(elements, weapon_major_types, "weapon_major_types.json");
-	EXPORT_TABLE(elements, weapon_minor_types, "weapon_minor_types.json");
-	EXPORT_TABLE(elements, armor_major_types, "armor_major_types.json");
-	EXPORT_TABLE(elements, armor_minor_types, "armor_minor_types.json");
-	EXPORT_TABLE(elements, decoration_major_types, "decoration_major_types.json");
-	EXPORT_TABLE(elements, decoration_minor_types, "decoration_minor_types.json");
-
-	EXPORT_TABLE(elements, armorrune_sub_type, "armorrune_types.json");
-	EXPORT_TABLE(elements, damagerune_sub_type, "attackrune_types.json");
-
-	EXPORT_TABLE(elements, medicine_major_types, "medicine_major_types.json");
-	EXPORT_TABLE(elements, medicine_minor_types, "medicine_minor_types.json");
-
-	EXPORT_TABLE(elements, projectile_types, "projectile_types.json");
-	EXPORT_TABLE(elements, quiver_sub_type, "quiver_types.json");
-	EXPORT_TABLE(elements, stone_types, "stone_types.json");
-
-	EXPORT_TABLE(elements, monster_addon, "monster_addons.json");
-	EXPORT_TABLE(elements, monster_type, "monster_types.json");
-	EXPORT_TABLE(elements, npc_type, "npc_types.json");
-	EXPORT_TABLE(elements, mine_type, "mine_types.json");
-	EXPORT_TABLE(elements, fashion_major_type, "fashion_major_types.json");
-	EXPORT_TABLE(elements, fashion_sub_type, "fashion_sub_types.json");
-	EXPORT_TABLE(elements, gm_generator_type, "gm_generator_types.json");
-	EXPORT_TABLE(elements, pet_type, "pet_types.json");
-
-	EXPORT_TABLE(elements, armor_sets, "armor_sets.json");
-	EXPORT_TABLE(elements, equipment_addon, "equipment_addon.json");
-
-	EXPORT_TABLE(elements, npc_tasks_in, "npc_tasks_in.json");
-	EXPORT_TABLE(elements, npc_tasks_out, "npc_tasks_out.json");
-	EXPORT_TABLE(elements, npc_task_matter_service, "npc_tasks_matter.json");
-
-	FILE *fp = fopen("items.json", "wb");
-	if (fp == NULL) {
-		PWLOG(LOG_ERROR, "cant open items.json for writing\n");
+	struct export_ctx *ctx = calloc(1, sizeof(*ctx));
+	struct pw_buf buf = {};
+	size_t i;
+
+	if (!ctx) {
+		PWLOG(LOG_ERROR, "calloc() failed\n");
 		return;
 	}
-	size_t prev_sz, sz = 0;
-
-#define STR(x, y) #x #y
-#define EXPORT_ITEMS(table_name) \
-({ \
-	struct pw_chain_table *table = get_table(elements, STR(table_name, _essence)); \
-\
-	prev_sz = sz; \
-	sz = serialize(fp, table->serializer, \
-			(void *)table->chain->data, table->chain->count); \
-	if (prev_sz > 0) { \
-		fseek(fp, prev_sz - 1, SEEK_SET); \
-		fprintf(fp, ",\n"); /* overwrite ] and [ */ \
-		fseek(fp, sz, SEEK_SET); \
-	} \
-})
-
-	EXPORT_ITEMS(weapon);
-	EXPORT_ITEMS(armor);
-	EXPORT_ITEMS(decoration);
-	EXPORT_ITEMS(medicine);
-	EXPORT_ITEMS(material);
-	EXPORT_ITEMS(damagerune);
-	EXPORT_ITEMS(armorrune);
-	EXPORT_ITEMS(skilltome);
-	EXPORT_ITEMS(flysword);
-	EXPORT_ITEMS(wingmanwing);
-	EXPORT_ITEMS(townscroll);
-	EXPORT_ITEMS(revivescroll);
-	EXPORT_ITEMS(element);
-	EXPORT_ITEMS(taskmatter);
-	EXPORT_ITEMS(tossmatter);
-	EXPORT_ITEMS(projectile);
-	EXPORT_ITEMS(quiver);
-	EXPORT_ITEMS(stone);
-	EXPORT_ITEMS(taskdice);
-	EXPORT_ITEMS(tasknormalmatter);
-	EXPORT_ITEMS(fashion);
-	EXPORT_ITEMS(faceticket);
-	EXPORT_ITEMS(facepill);
-	EXPORT_ITEMS(gm_generator);
-	EXPORT_ITEMS(pet_egg);
-	EXPORT_ITEMS(pet_food);
-	EXPORT_ITEMS(pet_faceticket);
-	EXPORT_ITEMS(fireworks);
-	EXPORT_ITEMS(war_tankcallin);
-	EXPORT_ITEMS(skillmatter);
-	EXPORT_ITEMS(refine_ticket);
-	EXPORT_ITEMS(bible);
-	EXPORT_ITEMS(speaker);
-	EXPORT_ITEMS(autohp);
-	EXPORT_ITEMS(automp);
-	EXPORT_ITEMS(double_exp);
-	EXPORT_ITEMS(transmitscroll);
-	EXPORT_ITEMS(dye_ticket);
-
-#undef EXPORT_ITEMS
 
-	fclose(fp);
-	truncate("items.json", sz);
+	/* every table is serialized into its own buffer, so they can all go in
+	 * parallel. The big ones are split into chunks and done one by one */
+	ctx->elements = elements;
+	pw_parallel_for(EXPORT_TABLES_CNT + EXPORT_ITEMS_CNT, export_table_fn, ctx);
+	for (i = 0; i < EXPORT_TABLES_CNT + EXPORT_ITEMS_CNT; i++) {
+		export_table(ctx, i, true);
+	}
+
+	for (i = 0; i < EXPORT_ITEMS_CNT; i++) {
+		size_t prev_sz = buf.len;
+
+		if (ctx->items[i].oom) {
+			buf.oom = true;
+		}
+		pw_buf_write(&buf, ctx->items[i].data, ctx->items[i].len);
+		if (prev_sz > 0 && !buf.oom) {
+			/* join the arrays: overwrite ] and [ */
+			memcpy(buf.data + prev_sz - 1, ",\n", 2);
+		}
+		pw_buf_free(&ctx->items[i]);
+	}
+
+	pw_buf_save(&buf, "items.json");
+	pw_buf_free(&buf);
+	free(ctx);
 }
 
 static int
@@ -1808,34 +1856,15 @@ get_item_type_by_id(unsigned type) {
 	return "unknown";
 }
 
-int
-pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj)
+/* find or create the element to be patched, returns NULL if obj_type is not a known table */
+static void *
+get_patch_target(struct pw_elements *elements, const char *obj_type, int64_t id,
+		struct pw_chain_table **table_p)
 {
 	struct pw_chain_table *table = NULL;
 	struct pw_idmap_el *node;
 	void **table_el;
-	const char *obj_type;
-	int64_t id;
 	int i;
-	bool is_item;
-
-	obj_type = JSs(obj, "_db", "type");
-	if (!obj_type) {
-		PWLOG(LOG_ERROR, "missing obj._db.type\n");
-		return -1;
-	}
-
-	is_item = strcmp(obj_type, "items") == 0;
-	if (is_item) {
-		uint32_t type = JSi(obj, "type");
-		obj_type = get_item_type_by_id(type);
-	}
-
-	id = JSi(obj, "id");
-	if (!id) {
-		PWLOG(LOG_ERROR, "missing obj.id\n");
-		return -1;
-	}
 
 	for (i = 0; i < elements->tables_count; i++) {
 		table = elements->tables[i];
@@ -1845,10 +1874,7 @@ pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj)
 	}
 
 	if (i == elements->tables_count) {
-		if (table && strcmp(table->name, "metadata") != 0) {
-			PWLOG(LOG_ERROR, "unknown obj type\n");
-		}
-		return -1;
+		return NULL;
 	}
 
 	node = pw_idmap_get(g_elements_map, id, table->idmap_type);
@@ -1868,8 +1894,66 @@ pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj)
 
 	}
 
+	*table_p = table;
+	return table_el;
+}
+
+static void
+patch_obj_finish(struct pw_chain_table *table, const char *obj_type, bool is_item, void *table_el)
+{
+	pw_chain_table_set_removed(table, table_el, *(uint32_t *)table_el & (1 << 31));
+
+	if (is_item && strcmp(obj_type, "taskdice_essence") == 0) {
+		void *tasks = serializer_get_field(table->serializer, "tasks", table_el);
+		float *prob = (float *)(tasks + 4);
+
+		if (*prob == 0) {
+			*prob = 1.0;
+		}
+	}
+}
+
+int
+pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj)
+{
+	static struct cjson_path db_type_path = CJSON_PATH("_db.type");
+	static struct cjson_path type_path = CJSON_PATH("type");
+	static struct cjson_path id_path = CJSON_PATH("id");
+	static struct cjson_path desc_path = CJSON_PATH("desc");
+	struct pw_chain_table *table;
+	void *table_el;
+	const char *obj_type;
+	int64_t id;
+	bool is_item;
+
+	obj_type = JPs(obj, &db_type_path);
+	if (!obj_type) {
+		PWLOG(LOG_ERROR, "missing obj._db.type\n");
+		return -1;
+	}
+
+	is_item = strcmp(obj_type, "items") == 0;
 	if (is_item) {
-		struct cjson *desc = JS(obj, "desc");
+		uint32_t type = JPi(obj, &type_path);
+		obj_type = get_item_type_by_id(type);
+	}
+
+	id = JPi(obj, &id_path);
+	if (!id) {
+		PWLOG(LOG_ERROR, "missing obj.id\n");
+		return -1;
+	}
+
+	table_el = get_patch_target(elements, obj_type, id, &table);
+	if (!table_el) {
+		if (strcmp(obj_type, "metadata") != 0) {
+			PWLOG(LOG_ERROR, "unknown obj type\n");
+		}
+		return -1;
+	}
+
+	if (is_item) {
+		struct cjson *desc = JP(obj, &desc_path);
 		if (desc->type == CJSON_TYPE_STRING) {
 			uint32_t id = *(uint32_t *)table_el;
 
@@ -1877,20 +1961,313 @@ pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj)
 		}
 	}
 
+	pw_chain_table_set_des_arena(elements->arena);
 	deserialize(obj, table->serializer, table_el);
+	pw_chain_table_set_des_arena(NULL);
+	patch_obj_finish(table, obj_type, is_item, table_el);
+	return 0;
+}
 
-	if (is_item && strcmp(obj_type, "taskdice_essence") == 0) {
-		void *tasks = serializer_get_field(table->serializer, "tasks", table_el);
-		float *prob = (float *)(tasks + 4);
+/* the fields needed before the object can be deserialized */
+struct patch_obj_hdr {
+	char db_type[64];
+	int64_t id;
+	int64_t type;
+	bool has_type;
+	char *desc;
+	/* object keys, printed like with a cjson tree; only when logging */
+	struct pw_buf *keys;
+};
 
-		if (*prob == 0) {
-			*prob = 1.0;
+/* pw_elements_patch_obj_str() state, shared by all the sax callbacks */
+struct patch_obj_sax {
+	struct pw_elements *elements;
+	struct patch_obj_hdr hdr;
+	/* the target, once all the header fields are known */
+	struct pw_chain_table *table;
+	const char *obj_type;
+	bool is_item;
+	void *table_el;
+	/* top-level keys that came before the target was known */
+	struct pw_buf early_keys;
+	/* some of the early keys are fields, so another pass is needed */
+	bool late;
+	bool deserializing;
+	struct deserialize_sax_ctx des;
+};
+
+static void
+patch_obj_hdr_add_key(struct patch_obj_hdr *hdr, struct cjson *obj)
+{
+	struct cjson *parent;
+	int depth = 0;
+
+	/* keys of nested objects are listed too, but not of array elements */
+	for (parent = obj->parent; parent; parent = parent->parent) {
+		if (parent->type != CJSON_TYPE_OBJECT) {
+			return;
+		}
+		depth++;
+	}
+
+	while (depth--) {
+		pw_buf_puts(hdr->keys, "  ");
+	}
+	pw_buf_puts(hdr->keys, obj->key);
+	pw_buf_putc(hdr->keys, '\n');
+}
+
+/* children of a complete cjson tree, the tree itself was listed in open() */
+static void
+patch_obj_hdr_add_children(struct patch_obj_hdr *hdr, struct cjson *obj)
+{
+	for (struct cjson *child = obj->a; child; child = child->next) {
+		patch_obj_hdr_add_key(hdr, child);
+		if (child->type == CJSON_TYPE_OBJECT) {
+			patch_obj_hdr_add_children(hdr, child);
+		}
+	}
+}
+
+static void
+patch_obj_hdr_value(struct patch_obj_sax *s, struct cjson *val)
+{
+	struct patch_obj_hdr *hdr = &s->hdr;
+	struct cjson *parent = val->parent;
+
+	if (hdr->keys) {
+		if (val->type == CJSON_TYPE_OBJECT) {
+			patch_obj_hdr_add_children(hdr, val);
+		} else if (val->type != CJSON_TYPE_ARRAY) {
+			patch_obj_hdr_add_key(hdr, val);
+		}
+	}
+
+	if (!parent->parent) {
+		if (strcmp(val->key, "id") == 0) {
+			hdr->id = cjson_int(val);
+		} else if (strcmp(val->key, "type") == 0) {
+			hdr->type = cjson_int(val);
+			hdr->has_type = true;
+		} else if (strcmp(val->key, "desc") == 0 && val->type == CJSON_TYPE_STRING) {
+			if (s->table_el && s->is_item) {
+				pw_item_desc_set(*(uint32_t *)s->table_el, val->s);
+			} else {
+				free(hdr->desc);
+				hdr->desc = strdup(val->s);
+			}
+		}
+	} else if (!parent->parent->parent && parent->key && strcmp(parent->key, "_db") == 0 &&
+			strcmp(val->key, "type") == 0 && val->type == CJSON_TYPE_STRING) {
+		snprintf(hdr->db_type, sizeof(hdr->db_type), "%s", val->s);
+	}
+}
+
+/* 1 if the target was found, 0 if the header is incomplete, -ENOENT if it's not an element */
+static int
+patch_obj_resolve(struct patch_obj_sax *s, bool final)
+{
+	struct patch_obj_hdr *hdr = &s->hdr;
+
+	if (!hdr->db_type[0] || !hdr->id) {
+		return final ? -ENOENT : 0;
+	}
+
+	s->is_item = strcmp(hdr->db_type, "items") == 0;
+	if (s->is_item && !hdr->has_type && !final) {
+		return 0;
+	}
+
+	s->obj_type = s->is_item ? get_item_type_by_id(hdr->type) : hdr->db_type;
+	if (s->obj_type) {
+		s->table_el = get_patch_target(s->elements, s->obj_type, hdr->id, &s->table);
+	}
+
+	return s->table_el ? 1 : -ENOENT;
+}
+
+static void
+patch_obj_found(struct patch_obj_sax *s, unsigned depth)
+{
+	struct serializer *slzr = s->table->serializer;
+	const char *key;
+	size_t off;
+
+	PWLOG(LOG_INFO, "type: %s, id: 0x%llx\n", s->hdr.db_type, (long long)s->hdr.id);
+	if (s->is_item && s->hdr.desc) {
+		pw_item_desc_set(*(uint32_t *)s->table_el, s->hdr.desc);
+	}
+
+	for (off = 0; off < s->early_keys.len; off += strlen(key) + 1) {
+		key = s->early_keys.data + off;
+		if (strcmp(key, "id") != 0 && serializer_get_offset(slzr, key) >= 0) {
+			s->late = true;
 		}
 	}
 
+	if (!s->late) {
+		deserialize_sax_begin(&s->des, slzr, s->table_el, depth);
+		s->deserializing = true;
+	}
+}
+
+static unsigned
+patch_obj_depth(struct cjson *obj)
+{
+	unsigned depth = 0;
+
+	while ((obj = obj->parent)) {
+		depth++;
+	}
+
+	return depth;
+}
+
+static void
+patch_obj_add_early_key(struct patch_obj_sax *s, struct cjson *obj)
+{
+	if (obj->parent && !obj->parent->parent && strcmp(obj->key, "_db") != 0) {
+		pw_buf_write(&s->early_keys, obj->key, strlen(obj->key) + 1);
+	}
+}
+
+static int
+patch_obj_sax_open(void *ctx, struct cjson *obj)
+{
+	struct patch_obj_sax *s = ctx;
+
+	if (s->hdr.keys && obj->parent) {
+		patch_obj_hdr_add_key(&s->hdr, obj);
+	}
+
+	if (s->deserializing) {
+		return g_deserialize_sax_ops.open(&s->des, obj);
+	}
+
+	if (!s->table_el) {
+		patch_obj_add_early_key(s, obj);
+	}
+
+	return 0;
+}
+
+static int
+patch_obj_sax_close(void *ctx, struct cjson *obj)
+{
+	struct patch_obj_sax *s = ctx;
+
+	if (s->deserializing) {
+		return g_deserialize_sax_ops.close(&s->des, obj);
+	}
+
 	return 0;
 }
 
+static int
+patch_obj_sax_value(void *ctx, struct cjson *val)
+{
+	struct patch_obj_sax *s = ctx;
+	int rc;
+
+	/* array elements have no keys and are never part of the header */
+	if (val->key) {
+		patch_obj_hdr_value(s, val);
+	}
+
+	if (s->deserializing) {
+		return g_deserialize_sax_ops.value(&s->des, val);
+	}
+
+	if (!s->table_el) {
+		rc = patch_obj_resolve(s, false);
+		if (rc < 0) {
+			/* not an element */
+			return CJSON_SAX_STOP;
+		} else if (rc == 0) {
+			patch_obj_add_early_key(s, val);
+			return 0;
+		}
+
+		patch_obj_found(s, patch_obj_depth(val));
+		if (s->deserializing) {
+			return g_deserialize_sax_ops.value(&s->des, val);
+		}
+	}
+
+	/* another pass is needed, just finish listing the keys */
+	return s->hdr.keys ? 0 : CJSON_SAX_STOP;
+}
+
+static const struct cjson_sax_ops g_patch_obj_sax_ops = {
+	.open = patch_obj_sax_open,
+	.close = patch_obj_sax_close,
+	.value = patch_obj_sax_value,
+};
+
+/**
+ * Same as pw_elements_patch_obj(), but straight from the json string, without
+ * building a cjson tree. The target element is found from the _db.type, id,
+ * and (for items) type fields, and if they come first the rest is written
+ * into it in the same pass. Returns -ENOENT without modifying str if it's not
+ * an elements object, e.g. npcs or tasks, so the caller can handle it instead.
+ * idx is optional, see cjson_sax_parse().
+ */
+int
+pw_elements_patch_obj_str(struct pw_elements *elements, char *str, struct cjson_index *idx)
+{
+	struct patch_obj_sax s = { .elements = elements };
+	struct pw_buf keys = {};
+	int rc;
+
+	if (*str != '{') {
+		return -ENOENT;
+	}
+
+	if (LOG_INFO <= g_pwlog_level) {
+		s.hdr.keys = &keys;
+	}
+
+	pw_chain_table_set_des_arena(elements->arena);
+	rc = cjson_sax_parse(str, NULL, &g_patch_obj_sax_ops, &s, idx);
+	if (s.deserializing) {
+		deserialize_sax_end(&s.des);
+		s.deserializing = false;
+	}
+
+	if (!s.table_el) {
+		if (rc == 0 && patch_obj_resolve(&s, true) == 1) {
+			/* the header came last, nothing was written yet */
+			s.late = true;
+			patch_obj_found(&s, 0);
+		} else {
+			if (rc == 0) {
+				rc = -ENOENT;
+			}
+			goto out;
+		}
+	}
+
+	if (keys.len) {
+		fwrite(keys.data, 1, keys.len, stderr);
+	}
+
+	if (rc == 0 && s.late) {
+		s.hdr.keys = NULL;
+		deserialize_sax_begin(&s.des, s.table->serializer, s.table_el, 0);
+		s.deserializing = true;
+		rc = cjson_sax_parse(str, NULL, &g_patch_obj_sax_ops, &s, idx);
+		deserialize_sax_end(&s.des);
+	}
+
+	patch_obj_finish(s.table, s.obj_type, s.is_item, s.table_el);
+out:
+	pw_chain_table_set_des_arena(NULL);
+	free(s.hdr.desc);
+	pw_buf_free(&s.early_keys);
+	pw_buf_free(&keys);
+	return rc;
+}
+
 static void
 pw_elements_load_table(struct pw_elements *elements, const char *name, uint32_t el_size, int skipped_offset, struct serializer *serializer, FILE *fp)
 {
@@ -1900,34 +2277,23 @@ pw_elements_load_table(struct pw_elements *elements, const char *name, uint32_t
 	void *el;
 	long idmap_type;
 
-	table = calloc(1, sizeof(*table));
+	fread(&count, 1, sizeof(count), fp);
+	table = pw_chain_table_alloc(name, serializer, el_size, count, elements->arena);
 	if (!table) {
-		PWLOG(LOG_ERROR, "calloc() failed\n");
+		PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed\n");
 		return;
 	}
-
-	table->el_size = el_size;
-	table->name = name;
-	table->serializer = serializer;
-
-	fread(&count, 1, sizeof(count), fp);
-	table->chain = table->chain_last = chain = calloc(1, sizeof(struct pw_chain_el) + count * el_size);
-	if (!chain) {
-		PWLOG(LOG_ERROR, "calloc() failed\n");
-		return;
+	chain = table->chain;
+	if (skipped_offset) {
+		/* 4 bytes at skipped_offset aren't stored in the file */
+		pw_chain_table_fread_els(table, fp, count, el_size - 4, skipped_offset);
+	} else {
+		pw_chain_table_fread_els(table, fp, count, el_size, el_size);
 	}
-	chain->count = chain->capacity = count;
 
 	idmap_type = pw_idmap_register_type(g_elements_map);
 	el = chain->data;
 	for (i = 0; i < count; i++) {
-		if (skipped_offset) {
-			fread(el, 1, skipped_offset, fp);
-			fread((char *)el + skipped_offset + 4, 1, el_size - skipped_offset - 4, fp);
-		} else {
-			fread(el, 1, el_size, fp);
-		}
-
 		unsigned id = *(uint32_t *)el;
 
 		pw_idmap_set(g_elements_map, id, idmap_type, el);
@@ -1939,24 +2305,24 @@ pw_elements_load_table(struct pw_elements *elements, const char *name, uint32_t
 }
 
 static void
-pw_elements_read_talk_proc(struct talk_proc *talk, FILE *fp)
+pw_elements_read_talk_proc(struct talk_proc *talk, FILE *fp, struct pw_arena *arena)
 {
 	fread(&talk->id, 1, sizeof(talk->id), fp);
 	fread(&talk->name, 1, sizeof(talk->name), fp);
 
 	fread(&talk->questions_cnt, 1, sizeof(talk->questions_cnt), fp);
-	talk->questions = calloc(talk->questions_cnt, sizeof(*talk->questions));
+	talk->questions = pw_arena_alloc(arena, talk->questions_cnt * sizeof(*talk->questions));
 	for (int q = 0; q < talk->questions_cnt; ++q) {
 			struct question *question = &talk->questions[q];
 			fread(&question->id, 1, sizeof(question->id), fp);
 			fread(&question->control, 1, sizeof(question->control), fp);
 
 			fread(&question->text_size, 1, sizeof(question->text_size), fp);
-			question->text = calloc(question->text_size, sizeof(*question->text));
+			question->text = pw_arena_alloc(arena, question->text_size * sizeof(*question->text));
 			fread(question->text, 1, question->text_size * sizeof(*question->text), fp);
 
 			fread(&question->choices_cnt, 1, sizeof(question->choices_cnt), fp);
-			question->choices = calloc(question->choices_cnt, sizeof(*question->choices));
+			question->choices = pw_arena_alloc(arena, question->choices_cnt * sizeof(*question->choices));
 			fread(question->choices, 1, question->choices_cnt * sizeof(*question->choices), fp);
 	}
 }
@@ -1968,13 +2334,13 @@ pw_elements_load_talk_proc(struct pw_elements *elements, FILE *fp)
 	int32_t count;
 
 	fread(&count, 1, sizeof(count), fp);
-	elements->talk_proc = table = calloc(count, sizeof(struct talk_proc));
+	elements->talk_proc = table = pw_arena_alloc(elements->arena, count * sizeof(struct talk_proc));
 	elements->talk_proc_cnt = count;
 
 	for (int i = 0; i < count; ++i) {
 		struct talk_proc *talk = table + i * sizeof(struct talk_proc);
 
-		pw_elements_read_talk_proc(talk, fp);
+		pw_elements_read_talk_proc(talk, fp, elements->arena);
 	}
 
 	return count;
@@ -2014,11 +2380,11 @@ pw_elements_save_talk_proc(struct pw_elements *elements, FILE *fp)
 }
 
 static void
-load_control_block_0(struct control_block0 *block, FILE *fp)
+load_control_block_0(struct control_block0 *block, FILE *fp, struct pw_arena *arena)
 {
 		fread(&block->unk1, 1, sizeof(block->unk1), fp);
 		fread(&block->size, 1, sizeof(block->size), fp);
-		block->unk2 = calloc(1, block->size);
+		block->unk2 = pw_arena_alloc(arena, block->size);
 		fread(block->unk2, 1, block->size, fp);
 		fread(&block->unk3, 1,sizeof(block->unk3), fp);
 }
@@ -2033,11 +2399,11 @@ save_control_block_0(struct control_block0 *block, FILE *fp)
 }
 
 static void
-load_control_block_1(struct control_block1 *block, FILE *fp)
+load_control_block_1(struct control_block1 *block, FILE *fp, struct pw_arena *arena)
 {
 		fread(&block->unk1, 1, sizeof(block->unk1), fp);
 		fread(&block->size, 1, sizeof(block->size), fp);
-		block->unk2 = calloc(1, block->size);
+		block->unk2 = pw_arena_alloc(arena, block->size);
 		fread(block->unk2, 1, block->size, fp);
 }
 
@@ -2068,6 +2434,12 @@ pw_elements_load(struct pw_elements *el, const char *filename, const char *idmap
 
 	memset(el, 0, sizeof(*el));
 
+	el->arena = pw_arena_init(0);
+	if (!el->arena) {
+		fclose(fp);
+		return -ENOMEM;
+	}
+
 	fread(&el->hdr, 1, sizeof(el->hdr), fp);
 	if (el->hdr.version != 12 && el->hdr.version != 10) {
 		PWLOG(LOG_ERROR, "element version mismatch, expected 10 or 12, found %d\n", el->hdr.version);
@@ -2101,7 +2473,7 @@ pw_elements_load(struct pw_elements *el, const char *filename, const char *idmap
 	LOAD_ARR(damagerune_essence, 364);
 	LOAD_ARR(armorrune_sub_type, 68);
 	LOAD_ARR(armorrune_essence, 624);
-	load_control_block_0(&el->control_block0, fp);
+	load_control_block_0(&el->control_block0, fp, el->arena);
 	LOAD_ARR(skilltome_sub_type, 68);
 	LOAD_ARR(skilltome_essence, 348);
 	LOAD_ARR(flysword_essence, 516);
@@ -2182,7 +2554,7 @@ pw_elements_load(struct pw_elements *el, const char *filename, const char *idmap
 	LOAD_ARR(pet_faceticket_essence, 344);
 	LOAD_ARR(fireworks_essence, 480);
 	LOAD_ARR(war_tankcallin_essence, 344);
-	load_control_block_1(&el->control_block1, fp);
+	load_control_block_1(&el->control_block1, fp, el->arena);
 	LOAD_ARR(npc_war_towerbuild_service, 148);
 	LOAD_ARR(player_secondlevel_config, 1092);
 	LOAD_ARR(npc_resetprop_service, 368);
@@ -2217,7 +2589,7 @@ pw_elements_load(struct pw_elements *el, const char *filename, const char *idmap
 static void
 pw_elements_save_table(struct pw_chain_table *table, FILE *fp, int skipped_offset)
 {
-	struct pw_chain_el *chain;
+	struct pw_chain_run run = {};
 	size_t count_off;
 	uint32_t count = 0;
 
@@ -2225,22 +2597,29 @@ pw_elements_save_table(struct pw_chain_table *table, FILE *fp, int skipped_offse
 	/* item count goes here, but we don't know it yet */
 	fseek(fp, 4, SEEK_CUR);
 
-	chain = table->chain;
-	while (chain) {
-		for (uint32_t i = 0; i < chain->count; i++) {
-			void *el = (void *)(chain->data + i * table->el_size);
-
-			/* skip items with the *removed* bit set */
-			if (*(uint32_t *)el & (1 << 31)) continue;
-			if (skipped_offset) {
-				fwrite(el, 1, skipped_offset, fp);
-				fwrite((char *)el + skipped_offset + 4, 1, table->el_size - skipped_offset - 4, fp);
-			} else {
-				fwrite(el, 1, table->el_size, fp);
-			}
+	/* skip items with the *removed* bit set */
+	while (pw_chain_table_next_live_run(table, &run)) {
+		void *el = table->chains[run.chain]->data + run.start * table->el_size;
+
+		if (!skipped_offset) {
+			fwrite(el, table->el_size, run.end - run.start, fp);
+			count += run.end - run.start;
+			continue;
+		}
+
+		for (size_t i = run.start; i < run.end; i++) {
+			fwrite(el, 1, skipped_offset, fp);
+			fwrite((char *)el + skipped_offset + 4, 1, table->el_size - skipped_offset - 4, fp);
+			el += table->el_size;
 			count++;
 		}
-		chain = chain->next;
+	}
+
+	if (table->removed_cnt) {
+		struct pw_chain_table_stats stats;
+
+		pw_chain_table_get_stats(table, &stats);
+		PWLOG(LOG_DEBUG_1, "%s: %zu/%zu live in %zu runs\n", table->name, stats.live, stats.size, stats.live_runs);
 	}
 
 	size_t end_off = ftell(fp);
@@ -2249,6 +2628,20 @@ pw_elements_save_table(struct pw_chain_table *table, FILE *fp, int skipped_offse
 	fseek(fp, end_off, SEEK_SET);
 }
 
+void
+pw_elements_free(struct pw_elements *el)
+{
+	for (size_t i = 0; i < el->tables_count; i++) {
+		if (el->tables[i]->idmap_type) {
+			pw_idmap_clear(g_elements_map, el->tables[i]->idmap_type);
+		}
+	}
+
+	/* tables, talk_proc and control blocks */
+	pw_arena_free(el->arena);
+	memset(el, 0, sizeof(*el));
+}
+
 int
 pw_elements_save(struct pw_elements *el, const char *filename, bool is_server)
 {
@@ -2294,7 +2687,7 @@ pw_elements_save(struct pw_elements *el, const char *filename, bool is_server)
 			if (is_server) {
 				struct control_block0 cb0;
 
-				load_control_block_0(&cb0, server_fp);
+				load_control_block_0(&cb0, server_fp, el->arena);
 				save_control_block_0(&cb0, fp);
 			} else {
 				save_control_block_0(&el->control_block0, fp);
@@ -2303,7 +2696,7 @@ pw_elements_save(struct pw_elements *el, const char *filename, bool is_server)
 			if (is_server) {
 				struct control_block1 cb1;
 
-				load_control_block_1(&cb1, server_fp);
+				load_control_block_1(&cb1, server_fp, el->arena);
 				save_control_block_1(&cb1, fp);
 			} else {
 				save_control_block_1(&el->control_block1, fp);
@@ -2340,30 +2733,53 @@ get_chain_table(struct pw_elements *elements, const char *name)
 	return NULL;
 }
 
+static void
+prepare_recipe_fn(void *ctx, void *el)
+{
+	struct recipes *recipe = el;
+	int next_idx = 0;
+
+	for (int i = 0; i < 32; i++) {
+		if (recipe->mats[i].id) {
+			recipe->mats[next_idx].id = recipe->mats[i].id;
+			recipe->mats[next_idx].num = recipe->mats[i].num;
+			next_idx++;
+		}
+
+		if (i >= next_idx) {
+			recipe->mats[i].id = 0;
+			recipe->mats[i].num = 0;
+		}
+	}
+}
+
 void
 pw_elements_prepare(struct pw_elements *elements)
 {
-	struct recipes *recipe;
 	struct pw_chain_table *tbl = get_chain_table(elements, "recipes");
-	void *el;
 
-	PW_CHAIN_TABLE_FOREACH(el, tbl) {
-		int next_idx = 0;
-		recipe = el;
+	pw_chain_table_parallel_foreach(tbl, prepare_recipe_fn, NULL);
+}
 
-		for (int i = 0; i < 32; i++) {
-			if (recipe->mats[i].id) {
-				recipe->mats[next_idx].id = recipe->mats[i].id;
-				recipe->mats[next_idx].num = recipe->mats[i].num;
-				next_idx++;
-			}
+struct monster_rates_ctx {
+	double xp_rate;
+	double sp_rate;
+	double coin_rate;
+	int xp_off;
+	int sp_off;
+	int money_average_off;
+	int money_var_off;
+};
 
-			if (i >= next_idx) {
-				recipe->mats[i].id = 0;
-				recipe->mats[i].num = 0;
-			}
-		}
-	}
+static void
+adjust_monster_rates_fn(void *_ctx, void *el)
+{
+	struct monster_rates_ctx *ctx = _ctx;
+
+	*(uint32_t *)(el + ctx->xp_off) *= ctx->xp_rate;
+	*(uint32_t *)(el + ctx->sp_off) *= ctx->sp_rate;
+	*(uint32_t *)(el + ctx->money_average_off) *= ctx->coin_rate;
+	*(uint32_t *)(el + ctx->money_var_off) *= ctx->coin_rate;
 }
 
 void
@@ -2389,20 +2805,18 @@ pw_elements_adjust_rates(struct pw_elements *elements, struct cjson *rates)
 		exp_penalty_cfg->adjust[i].matter = 1.0f;
 	}
 
-	void *el;
-
 	tbl = get_chain_table(elements, "monsters");
-	int monster_xp_off = serializer_get_offset(tbl->serializer, "exp");
-	int monster_sp_off = serializer_get_offset(tbl->serializer, "sp");
-	int monster_money_average_off = serializer_get_offset(tbl->serializer, "money_average");
-	int monster_money_var_off = serializer_get_offset(tbl->serializer, "money_var");
-
-	PW_CHAIN_TABLE_FOREACH(el, tbl) {
-		*(uint32_t *)(el + monster_xp_off) *= xp_rate;
-		*(uint32_t *)(el + monster_sp_off) *= sp_rate;
-		*(uint32_t *)(el + monster_money_average_off) *= coin_rate;
-		*(uint32_t *)(el + monster_money_var_off) *= coin_rate;
-	}
+	struct monster_rates_ctx monster_ctx = {
+		.xp_rate = xp_rate,
+		.sp_rate = sp_rate,
+		.coin_rate = coin_rate,
+		.xp_off = serializer_get_offset(tbl->serializer, "exp"),
+		.sp_off = serializer_get_offset(tbl->serializer, "sp"),
+		.money_average_off = serializer_get_offset(tbl->serializer, "money_average"),
+		.money_var_off = serializer_get_offset(tbl->serializer, "money_var"),
+	};
+
+	pw_chain_table_parallel_foreach(tbl, adjust_monster_rates_fn, &monster_ctx);
 
 	tbl = get_chain_table(elements, "player_levelexp_config");
 	node = pw_idmap_get(g_elements_map, 592, tbl->idmap_type);
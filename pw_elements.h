@@ -18,6 +18,7 @@
 
 struct pw_elements;
 struct cjson;
+struct cjson_index;
 struct pw_idmap;
 
 extern uint32_t g_elements_last_id;
@@ -29,10 +30,12 @@ extern char g_item_colors[];
 extern char *g_item_descs[];
 
 int pw_elements_load(struct pw_elements *el, const char *filename, const char *idmap_filename);
+void pw_elements_free(struct pw_elements *el);
 int pw_elements_save(struct pw_elements *el, const char *filename, bool is_server);
 int pw_elements_idmap_save(struct pw_elements *el, const char *filename);
 void pw_elements_serialize(struct pw_elements *elements);
 int pw_elements_patch_obj(struct pw_elements *elements, struct cjson *obj);
+int pw_elements_patch_obj_str(struct pw_elements *elements, char *str, struct cjson_index *idx);
 void pw_elements_adjust_rates(struct pw_elements *elements, struct cjson *rates);
 void pw_elements_prepare(struct pw_elements *elements);
 
@@ -81,6 +84,7 @@ struct pw_elements {
 
 	struct pw_chain_table *tables[256];
 	size_t tables_count;
+	struct pw_arena *arena;
 };
 
 #endif /* PW_ELEMENTS_H */
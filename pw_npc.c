@@ -89,12 +89,12 @@ pw_npcs_save_static(const char *triggers_idmap_path, const char *spawners_idmap_
 }
 
 size_t
-pw_npcs_serialize_trigger_id(FILE *fp, struct serializer *f, void *data)
+pw_npcs_serialize_trigger_id(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t trigger = *(uint32_t *)data;
 
 	if (trigger) {
-		fprintf(fp, "\"%s\":\"%u\",", f->name, trigger);
+		pw_buf_printf(buf, "\"%s\":\"%u\",", f->name, trigger);
 	}
 	return 4;
 }
@@ -109,7 +109,7 @@ deserialize_trigger_id_async_fn(struct pw_idmap_el *node, void *target_data)
 size_t
 pw_npcs_deserialize_trigger_id(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -139,7 +139,7 @@ deserialize_trigger_ai_id_async_fn(struct pw_idmap_el *node, void *target_data)
 size_t
 pw_npc_deserialize_trigger_ai_id(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -168,22 +168,22 @@ pw_npc_deserialize_trigger_ai_id(struct cjson *f, struct serializer *slzr, void
 }
 
 size_t
-pw_npc_serialize_trigger_ai_id(FILE *fp, struct serializer *f, void *data)
+pw_npc_serialize_trigger_ai_id(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 
 	if (id) {
-		fprintf(fp, "\"%s\":%d,", f->name, id);
+		pw_buf_printf(buf, "\"%s\":%d,", f->name, id);
 	}
 	return 4;
 }
 
 static size_t
-serialize_spawner_type_fn(FILE *fp, struct serializer *f, void *data)
+serialize_spawner_type_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t is_npc = *(uint32_t *)data;
 
-	fprintf(fp, "\"type\":\"%s\",", is_npc ? "npc" : "monster");
+	pw_buf_printf(buf, "\"type\":\"%s\",", is_npc ? "npc" : "monster");
 	return 4;
 }
 
@@ -191,7 +191,7 @@ static size_t
 deserialize_spawner_type_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
 	uint32_t is_npc = 0;
-	const char *name = JSs(f);
+	const char *name = cjson_str(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -205,7 +205,7 @@ deserialize_spawner_type_fn(struct cjson *f, struct serializer *slzr, void *data
 }
 
 static size_t
-serialize_id_removed_fn(FILE *fp, struct serializer *f, void *data)
+serialize_id_removed_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	/* TODO? */
 	return 0;
@@ -222,7 +222,7 @@ deserialize_id_removed_fn(struct cjson *f, struct serializer *slzr, void *data)
 
 	deserialize_log(f, &is_removed);
 
-	if (JSi(f)) {
+	if (cjson_int(f)) {
 		*(uint32_t *)(data) |= (1 << 31);
 	} else {
 		*(uint32_t *)(data) &= ~(1 << 31);
@@ -241,7 +241,7 @@ deserialize_elements_id_field_async_fn(struct pw_idmap_el *node, void *target_da
 static size_t
 deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -262,14 +262,14 @@ deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void
 }
 
 static size_t
-serialize_elements_id_field_fn(FILE *fp, struct serializer *f, void *data)
+serialize_elements_id_field_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	/* TODO */
 	return 4;
 }
 
 static struct serializer spawner_group_serializer[] = {
-	{ "type", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "type", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "count", _INT32 },
 	{ "respawn_time", _INT32 },
 	{ "_unused2", _INT32 },
@@ -302,14 +302,14 @@ static struct serializer spawner_serializer[] = {
 	{ "spread", _ARRAY_START(3) },
 		{ "", _FLOAT },
 	{ "", _ARRAY_END },
-	{ "type", _CUSTOM, serialize_spawner_type_fn, deserialize_spawner_type_fn }, /* 4 bytes */
+	{ "type", _CUSTOM(4), serialize_spawner_type_fn, deserialize_spawner_type_fn },
 	{ "mob_type", _INT32 },
 	{ "auto_spawn", _INT8 },
 	{ "auto_respawn", _INT8 },
 	{ "_unused1", _INT8 },
-	{ "_removed", _CUSTOM, serialize_id_removed_fn, deserialize_id_removed_fn },
+	{ "_removed", _CUSTOM(0), serialize_id_removed_fn, deserialize_id_removed_fn },
 	{ "id", _INT32 },
-	{ "trigger", _CUSTOM, pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
+	{ "trigger", _CUSTOM(4), pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
 	{ "lifetime", _FLOAT },
 	{ "max_num", _INT32 },
 	{ "groups", _CHAIN_TABLE, spawner_group_serializer },
@@ -326,7 +326,7 @@ init_spawner_group_fn(void *grp, void *ctx)
 
 static struct serializer resource_group_serializer[] = {
 	{ "_unused_type", _INT32 },
-	{ "type", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "type", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "respawn_time", _INT32 },
 	{ "count", _INT32 },
 	{ "height_offset", _FLOAT },
@@ -345,19 +345,19 @@ static struct serializer resource_serializer[] = {
 	{ "auto_spawn", _INT8 },
 	{ "auto_respawn", _INT8 },
 	{ "_unused1", _INT8 },
-	{ "_removed", _CUSTOM, serialize_id_removed_fn, deserialize_id_removed_fn },
+	{ "_removed", _CUSTOM(0), serialize_id_removed_fn, deserialize_id_removed_fn },
 	{ "id", _INT32 },
 	{ "dir", _ARRAY_START(2) },
 		{ "", _INT8 },
 	{ "", _ARRAY_END },
 	{ "rad", _INT8 },
-	{ "trigger", _CUSTOM, pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
+	{ "trigger", _CUSTOM(4), pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
 	{ "max_num", _INT32 },
 	{ "groups", _CHAIN_TABLE, resource_group_serializer },
 	{ "", _TYPE_END },
 };
 static struct serializer dynamic_serializer[] = {
-	{ "_removed", _CUSTOM, serialize_id_removed_fn, deserialize_id_removed_fn },
+	{ "_removed", _CUSTOM(0), serialize_id_removed_fn, deserialize_id_removed_fn },
 	{ "id", _INT32 },
 	{ "pos", _ARRAY_START(3) },
 		{ "", _FLOAT },
@@ -366,13 +366,13 @@ static struct serializer dynamic_serializer[] = {
 		{ "", _INT8 },
 	{ "", _ARRAY_END },
 	{ "rad", _INT8 },
-	{ "trigger", _CUSTOM, pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
+	{ "trigger", _CUSTOM(4), pw_npcs_serialize_trigger_id, pw_npcs_deserialize_trigger_id },
 	{ "scale", _INT8 },
 	{ "", _TYPE_END },
 };
 
 static struct serializer trigger_serializer[] = {
-	{ "_removed", _CUSTOM, serialize_id_removed_fn, deserialize_id_removed_fn },
+	{ "_removed", _CUSTOM(0), serialize_id_removed_fn, deserialize_id_removed_fn },
 	{ "id", _INT32 },
 	{ "_ai_id", _INT32 }, /* ID to be referenced in aipolicy and API */
 	{ "name", _STRING(128) },
@@ -410,6 +410,12 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 	char buf2[256];
 
 	memset(npc, 0, sizeof(*npc));
+
+	npc->arena = pw_arena_init(0);
+	if (!npc->arena) {
+		return -ENOMEM;
+	}
+
 	snprintf(buf, sizeof(buf), "npcgen_%s", name);
 
 	npc->map_id = map_id;
@@ -440,7 +446,7 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 	PWLOG(LOG_DEBUG_5, "dynamics_count: %u\n", npc->hdr.dynamics_count);
 	PWLOG(LOG_DEBUG_5, "triggers_count: %u\n", npc->hdr.triggers_count);
 
-	rc = pw_chain_table_init(&npc->spawners, "spawners", spawner_serializer, serializer_get_size(spawner_serializer), npc->hdr.creature_sets_count);
+	rc = pw_chain_table_init(&npc->spawners, "spawners", spawner_serializer, serializer_get_size(spawner_serializer), npc->hdr.creature_sets_count, npc->arena);
 	if (rc) {
 		PWLOG(LOG_ERROR, "pw_chain_table_init() failed for npc->spawners, count: %u\n", npc->hdr.creature_sets_count);
 		goto err;
@@ -453,13 +459,11 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 		size_t off = ftell(fp);
 		struct pw_chain_table *tbl;
 
-		fread(el, 1, 59, fp);
-		if (npc->hdr.version >= 7) {
-		    fread(el + 59, 1, 12, fp); /* trigger, lifetime, max_num */
-		}
+		/* trigger, lifetime, max_num at the end are v7+ */
+		fread(el, 1, npc->hdr.version >= 7 ? 71 : 59, fp);
 
 		uint32_t groups_count = *(uint32_t *)serializer_get_field(spawner_serializer, "_groups_cnt", el);
-		tbl = pw_chain_table_fread(fp, "spawner_groups", groups_count, spawner_group_serializer);
+		tbl = pw_chain_table_fread(fp, "spawner_groups", groups_count, spawner_group_serializer, npc->arena);
 		if (!tbl) {
 			PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed for spawner->groups\n");
 			goto err;
@@ -477,7 +481,7 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 
 	}
 
-	rc = pw_chain_table_init(&npc->resources, "resources", resource_serializer, serializer_get_size(resource_serializer), npc->hdr.resource_sets_count);
+	rc = pw_chain_table_init(&npc->resources, "resources", resource_serializer, serializer_get_size(resource_serializer), npc->hdr.resource_sets_count, npc->arena);
 	if (rc) {
 		PWLOG(LOG_ERROR, "pw_chain_table_init() failed for npc->recources, count: %u\n", npc->hdr.creature_sets_count);
 		goto err;
@@ -490,16 +494,10 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 		size_t off = ftell(fp);
 		struct pw_chain_table *tbl;
 
-		fread(el, 1, 31, fp);
-		if (npc->hdr.version >= 6) {
-			fread(el + 31, 1, 3, fp);
-		}
-		if (npc->hdr.version >= 7) {
-			fread(el + 34, 1, 8, fp);
-		}
+		fread(el, 1, npc->hdr.version >= 7 ? 42 : npc->hdr.version >= 6 ? 34 : 31, fp);
 
 		uint32_t groups_count = *(uint32_t *)serializer_get_field(resource_serializer, "_groups_cnt", el);
-		tbl = pw_chain_table_fread(fp, "resource_groups", groups_count, resource_group_serializer);
+		tbl = pw_chain_table_fread(fp, "resource_groups", groups_count, resource_group_serializer, npc->arena);
 		if (!tbl) {
 			PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed for resource->groups\n");
 			goto err;
@@ -515,50 +513,42 @@ pw_npcs_load(struct pw_npc_file *npc, int map_id, const char *name, const char *
 		pw_idmap_set(g_spawners_map, id, npc->map_id, el);
 	}
 
-	rc = pw_chain_table_init(&npc->dynamics, "dynamics", dynamic_serializer, 24, npc->hdr.dynamics_count);
+	rc = pw_chain_table_init(&npc->dynamics, "dynamics", dynamic_serializer, 24, npc->hdr.dynamics_count, npc->arena);
 	if (rc) {
 		PWLOG(LOG_ERROR, "pw_chain_table_init() failed for npc->dynamics, count: %u\n", npc->hdr.dynamics_count);
 		goto err;
 	}
 
-	npc->dynamics.chain->count = npc->hdr.dynamics_count;
-	for (int i = 0;	i < npc->hdr.dynamics_count; i++) {
-		void *el = (void *)(npc->dynamics.chain->data + i * npc->dynamics.el_size);
+	if (npc->hdr.version >= 10) {
+		pw_chain_table_fread_els(&npc->dynamics, fp, npc->hdr.dynamics_count, 24, 24);
+	} else {
+		/* older versions don't have the last 4 (v9+) or 5 bytes */
+		size_t rec_size = npc->hdr.version >= 9 ? 23 : 19;
 
-		fread(el, 1, 19, fp);
+		pw_chain_table_fread_els(&npc->dynamics, fp, npc->hdr.dynamics_count, rec_size, rec_size);
+		for (int i = 0;	i < npc->hdr.dynamics_count; i++) {
+			void *el = (void *)(npc->dynamics.chain->data + i * npc->dynamics.el_size);
 
-		if (npc->hdr.version >= 9) {
-		    fread(el + 19, 1, 4, fp);
-		}
-
-		if (npc->hdr.version >= 10) {
-		    fread(el + 23, 1, 1, fp);
-		} else {
-		    *(uint8_t *)(el + 23) = 16;
+			*(uint8_t *)(el + 23) = 16;
 		}
-
-		PWLOG(LOG_DEBUG_5, "dynamic parsed, off=%u, id=%u\n", ftell(fp), i + 1);
-		//pw_idmap_set(npc->idmap, i + 1, npc->dynamics.idmap_type, el);
 	}
+	PWLOG(LOG_DEBUG_5, "dynamics parsed, off=%u\n", ftell(fp));
 
-	rc = pw_chain_table_init(&npc->triggers, "triggers", trigger_serializer, 199, npc->hdr.triggers_count);
+	rc = pw_chain_table_init(&npc->triggers, "triggers", trigger_serializer, 199, npc->hdr.triggers_count, npc->arena);
 	if (rc) {
 		PWLOG(LOG_ERROR, "pw_chain_table_init() failed for npc->triggers, count: %u\n", npc->hdr.triggers_count);
 		goto err;
 	}
 
-	npc->triggers.chain->count = npc->hdr.triggers_count;
+	/* the last 4 bytes are v8+ */
+	pw_chain_table_fread_els(&npc->triggers, fp, npc->hdr.triggers_count,
+			npc->hdr.version >= 8 ? 199 : 195, 195);
 	for (int i = 0;	i < npc->hdr.triggers_count; i++) {
 		void *el = (void *)(npc->triggers.chain->data + i * npc->triggers.el_size);
 		uint32_t id;
 
-		fread(el, 1, 195, fp);
-		if (npc->hdr.version >= 8) {
-			fread(el + 195, 1, 4, fp);
-		}
-
 		id = TRIGGER_ID(el) & ~(1UL << 31);
-		PWLOG(LOG_DEBUG_5, "trigger parsed, off=%u, id=%u\n", ftell(fp), id);
+		PWLOG(LOG_DEBUG_5, "trigger parsed, id=%u\n", id);
 
 		pw_idmap_set(g_triggers_map, id, npc->map_id, el);
 	}
@@ -571,9 +561,31 @@ err:
 	return -errno;
 }
 
+void
+pw_npcs_free(struct pw_npc_file *npc)
+{
+	/* each map's spawners and triggers are registered under its id */
+	if (g_spawners_map) {
+		pw_idmap_clear(g_spawners_map, npc->map_id);
+	}
+	if (g_triggers_map) {
+		pw_idmap_clear(g_triggers_map, npc->map_id);
+	}
+
+	pw_arena_free(npc->arena);
+	memset(&npc->spawners, 0, sizeof(npc->spawners));
+	memset(&npc->resources, 0, sizeof(npc->resources));
+	memset(&npc->dynamics, 0, sizeof(npc->dynamics));
+	memset(&npc->triggers, 0, sizeof(npc->triggers));
+	npc->arena = NULL;
+}
+
 int
 pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 {
+	static struct cjson_path id_path = CJSON_PATH("id");
+	static struct cjson_path db_type_path = CJSON_PATH("_db.type");
+	static struct cjson_path type_path = CJSON_PATH("type");
 	struct pw_chain_table *table;
 	struct pw_idmap_el *node;
 	void *table_el;
@@ -582,7 +594,7 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 	int64_t id;
 	struct cjson *c;
 
-	c = JS(obj, "id");
+	c = JP(obj, &id_path);
 	if (c->type != CJSON_TYPE_INTEGER) {
 		PWLOG(LOG_ERROR, "missing obj.id\n");
 		return -1;
@@ -590,8 +602,8 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 
 	id = c->i;
 
-	db_type = JSs(obj, "_db", "type");
-	obj_type = JSs(obj, "type");
+	db_type = JPs(obj, &db_type_path);
+	obj_type = JPs(obj, &type_path);
 	if (strncmp(db_type, "triggers_", strlen("triggers_")) == 0) {
 		table = &npc->triggers;
 		node = pw_idmap_get(g_triggers_map, id, npc->map_id);
@@ -637,7 +649,7 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 			if (strcmp(obj_type, "npc") == 0) {
 				*(uint8_t *)serializer_get_field(table->serializer, "auto_respawn", table_el) = 1;
 			}
-			grp_tbl = pw_chain_table_alloc("spawner_group", spawner_group_serializer, serializer_get_size(spawner_group_serializer), 8);
+			grp_tbl = pw_chain_table_alloc("spawner_group", spawner_group_serializer, serializer_get_size(spawner_group_serializer), 8, npc->arena);
 			if (!grp_tbl) {
 				PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed for spawner->groups\n");
 				return -1;
@@ -650,7 +662,7 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 			node = pw_idmap_set(g_spawners_map, id, npc->map_id, table_el);
 			RESOURCE_ID(table_el) = node->id;
 
-			grp_tbl = pw_chain_table_alloc("spawner_group", resource_group_serializer, serializer_get_size(resource_group_serializer), 8);
+			grp_tbl = pw_chain_table_alloc("spawner_group", resource_group_serializer, serializer_get_size(resource_group_serializer), 8, npc->arena);
 			if (!grp_tbl) {
 				PWLOG(LOG_ERROR, "pw_chain_table_alloc() failed for resource->groups\n");
 				return -1;
@@ -665,11 +677,18 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 	}
 
 	PWLOG(LOG_DEBUG_5, "0x%llx found with id=%u\n", id, node->id);
+	pw_chain_table_set_des_arena(npc->arena);
 	deserialize(obj, table->serializer, table_el);
+	pw_chain_table_set_des_arena(NULL);
 
 	if (table == &npc->spawners) {
 		float *pos = (float *)serializer_get_field(spawner_serializer, "pos", table_el);
 		*(uint32_t *)serializer_get_field(spawner_serializer, "_fixed_y", table_el) = pos[1] != 0;
+		pw_chain_table_set_removed(table, table_el, SPAWNER_ID(table_el) & (1 << 31));
+	} else if (table == &npc->resources) {
+		pw_chain_table_set_removed(table, table_el, RESOURCE_ID(table_el) & (1 << 31));
+	} else {
+		pw_chain_table_set_removed(table, table_el, TRIGGER_ID(table_el) & (1 << 31));
 	}
 
 	return 0;
@@ -678,13 +697,7 @@ pw_npcs_patch_obj(struct pw_npc_file *npc, struct cjson *obj)
 #define SAVE_TBL_CNT(name, slzr, data) \
 	({ \
 		struct pw_chain_table *tbl = *(void **)serializer_get_field(slzr, name, data); \
-		struct pw_chain_el *chain = tbl->chain; \
-		uint32_t cnt = 0; \
-		while (chain) { \
-			cnt += chain->count; \
-			chain = chain->next; \
-		} \
-		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = cnt; \
+		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = pw_chain_table_size(tbl); \
 	})
 
 int
@@ -703,15 +716,10 @@ pw_npcs_save(struct pw_npc_file *npc, const char *file_path)
 	fwrite(&npc->hdr, 1, sizeof(npc->hdr), fp);
 	
 	uint32_t spawners_count = 0;
-	PW_CHAIN_TABLE_FOREACH(el, &npc->spawners) {
+	PW_CHAIN_TABLE_FOREACH_LIVE(el, &npc->spawners) {
 		size_t off_begin;
 		uint32_t groups_count = 0;
 
-		if (SPAWNER_ID(el) & (1 << 31)) {
-			PWLOG(LOG_DEBUG_5, "spawner ignored, off=%u, id=%u\n", ftell(fp), SPAWNER_ID(el));
-			continue;
-		}
-
 		SAVE_TBL_CNT("groups", spawner_serializer, el);
 
 		off_begin = ftell(fp);
@@ -742,15 +750,10 @@ pw_npcs_save(struct pw_npc_file *npc, const char *file_path)
 	}
 
 	uint32_t resources_count = 0;
-	PW_CHAIN_TABLE_FOREACH(el, &npc->resources) {
+	PW_CHAIN_TABLE_FOREACH_LIVE(el, &npc->resources) {
 		size_t off_begin;
 		uint32_t groups_count = 0;
 
-		if (RESOURCE_ID(el) & (1 << 31)) {
-			PWLOG(LOG_DEBUG_5, "resource ignored, off=%u, id=%u\n", ftell(fp), RESOURCE_ID(el));
-			continue;
-		}
-
 		SAVE_TBL_CNT("groups", resource_serializer, el);
 
 		off_begin = ftell(fp);
@@ -780,29 +783,31 @@ pw_npcs_save(struct pw_npc_file *npc, const char *file_path)
 		fseek(fp, end_pos, SEEK_SET);
 	}
 
+	struct pw_chain_run run = {};
 	uint32_t dynamics_count = 0;
-	PW_CHAIN_TABLE_FOREACH(el, &npc->dynamics) {
-		PWLOG(LOG_DEBUG_5, "dynamic saved, off=%u, id=%u\n", ftell(fp), dynamics_count + 1);
-		fwrite(el, 1, npc->dynamics.el_size, fp);
-		dynamics_count++;
+	while (pw_chain_table_next_live_run(&npc->dynamics, &run)) {
+		el = npc->dynamics.chains[run.chain]->data + run.start * npc->dynamics.el_size;
+		fwrite(el, npc->dynamics.el_size, run.end - run.start, fp);
+		dynamics_count += run.end - run.start;
 	}
+	PWLOG(LOG_DEBUG_5, "dynamics saved, off=%u\n", ftell(fp));
 
-	uint32_t no_start_time_off = serializer_get_offset(npc->triggers.serializer, "_no_start_time");
-	uint32_t no_stop_time_off = serializer_get_offset(npc->triggers.serializer, "_no_stop_time");
+	size_t no_start_time_off = serializer_get_offset(npc->triggers.serializer, "_no_start_time");
+	size_t no_stop_time_off = serializer_get_offset(npc->triggers.serializer, "_no_stop_time");
 	uint32_t triggers_count = 0;
-	PW_CHAIN_TABLE_FOREACH(el, &npc->triggers) {
-		if (TRIGGER_ID(el) & (1 << 31)) {
-			PWLOG(LOG_DEBUG_5, "trigger ignored, off=%u, id=%u\n", ftell(fp), TRIGGER_ID(el));
-			continue;
+	memset(&run, 0, sizeof(run));
+	while (pw_chain_table_next_live_run(&npc->triggers, &run)) {
+		el = npc->triggers.chains[run.chain]->data + run.start * npc->triggers.el_size;
+		for (size_t i = 0; i < run.end - run.start; i++) {
+			void *trigger = el + i * npc->triggers.el_size;
+
+			*(uint8_t *)(trigger + no_start_time_off) = 1;
+			*(uint8_t *)(trigger + no_stop_time_off) = 1;
 		}
-
-		*(uint8_t *)(el + no_start_time_off) = 1;
-		*(uint8_t *)(el + no_stop_time_off) = 1;
-
-		PWLOG(LOG_DEBUG_5, "trigger saved, off=%u, id=%u\n", ftell(fp), TRIGGER_ID(el));
-		fwrite(el, 1, npc->triggers.el_size, fp);
-		triggers_count++;
+		fwrite(el, npc->triggers.el_size, run.end - run.start, fp);
+		triggers_count += run.end - run.start;
 	}
+	PWLOG(LOG_DEBUG_5, "triggers saved, off=%u\n", ftell(fp));
 
 	/* get back to header and write the real creature count */
 	fseek(fp, 4, SEEK_SET);
@@ -823,9 +828,8 @@ pw_npcs_save(struct pw_npc_file *npc, const char *file_path)
 int
 pw_npcs_serialize(struct pw_npc_file *npc, const char *type, const char *path)
 {
-	FILE *fp;
-	void *el;
-	int count = 0;
+	struct pw_buf buf = {};
+	int count, rc;
 	struct pw_chain_table *table;
 
 	if (strcmp(type, "triggers") == 0) {
@@ -836,33 +840,15 @@ pw_npcs_serialize(struct pw_npc_file *npc, const char *type, const char *path)
 		return -EINVAL;
 	}
 
-	fp = fopen(path, "wb");
-	if (fp == NULL) {
-		PWLOG(LOG_ERROR, "cant open %s\n", path);
-		return 1;
-	}
-
-	fprintf(fp, "[");
-
-	PW_CHAIN_TABLE_FOREACH(el, table) {
-		struct serializer *tmp_slzr = table->serializer;
-		size_t pos_begin = ftell(fp);
-		void *tmp_el = el;
-
-		_serialize(fp, &tmp_slzr, &tmp_el, 1, true, true, true);
-
-		if (ftell(fp) > pos_begin + 2) {
-			fprintf(fp, ",\n");
-		}
-		count++;
-	}
+	pw_buf_putc(&buf, '[');
+	pw_chain_table_serialize_objs(&buf, table, true, ",\n", 2);
+	count = pw_chain_table_size(table);
 
 	/* replace ,\n} with }] */
-	fseek(fp, -3, SEEK_CUR);
-	fprintf(fp, count > 0 ? "}]" : "]");
+	pw_buf_rollback(&buf, pw_buf_mark(&buf) - 3);
+	pw_buf_puts(&buf, count > 0 ? "}]" : "]");
 
-	size_t sz = ftell(fp);
-	fclose(fp);
-	truncate(path, sz);
-	return 0;
+	rc = pw_buf_save(&buf, path);
+	pw_buf_free(&buf);
+	return rc ? 1 : 0;
 }
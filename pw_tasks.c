@@ -78,15 +78,15 @@ xor_bytes(uint16_t *str, uint32_t len, uint32_t id) {
 }
 
 static size_t
-serialize_pascal_wstr_fn(FILE *fp, struct serializer *f, void *data)
+serialize_pascal_wstr_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t len = *(uint32_t *)data;
 	const uint16_t *wstr = *(void **)(data + 4);
 
-	fprintf(fp, "\"%s\":", f->name);
-	fprintf(fp, "\"");
-	fwsprint(fp, wstr, len);
-	fprintf(fp, "\",");
+	pw_buf_printf(buf, "\"%s\":", f->name);
+	pw_buf_printf(buf, "\"");
+	pw_buf_wsprint(buf, wstr, len);
+	pw_buf_printf(buf, "\",");
 
 	return 4 + PW_POINTER_BUF_SIZE;
 }
@@ -103,8 +103,7 @@ deserialize_pascal_wstr_fn(struct cjson *f, struct serializer *slzr, void *data)
 		return 4 + PW_POINTER_BUF_SIZE;
 	}
 
-	normalize_json_string(f->s, true);
-	uint32_t newlen = strlen(f->s);
+	uint32_t newlen = cjson_str_normalize(f, true);
 	deserialize_log(f, data);
 	memset(wstr, 0, len * 2);
 	if (newlen == 0) {
@@ -137,11 +136,11 @@ deserialize_pascal_wstr_fn(struct cjson *f, struct serializer *slzr, void *data)
 }
 
 static size_t
-serialize_common_item_id_fn(FILE *fp, struct serializer *f, void *data)
+serialize_common_item_id_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 
-	fprintf(fp, "\"%s\":%d,", f->name, id);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, id);
 	return 4;
 }
 
@@ -172,7 +171,7 @@ deserialize_common_item_id_fn(struct cjson *f, struct serializer *slzr, void *da
 		return 4;
 	}
 
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 	if (val >= 0x80000000) {
 		struct deserialize_common_item_id_async_ctx *ctx = calloc(1, sizeof(*ctx));
 
@@ -211,7 +210,7 @@ deserialize_id_field_async_fn(struct pw_idmap_el *node, void *target_data)
 static size_t
 deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -231,18 +230,18 @@ deserialize_elements_id_field_fn(struct cjson *f, struct serializer *slzr, void
 }
 
 static size_t
-serialize_elements_id_field_fn(FILE *fp, struct serializer *f, void *data)
+serialize_elements_id_field_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 
-	fprintf(fp, "\"%s\":%d,", f->name, id);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, id);
 	return 4;
 }
 
 static size_t
 deserialize_tasks_id_field_fn(struct cjson *f, struct serializer *slzr, void *data)
 {
-	int64_t val = JSi(f);
+	int64_t val = cjson_int(f);
 
 	if (f->type == CJSON_TYPE_NONE) {
 		return 4;
@@ -262,20 +261,20 @@ deserialize_tasks_id_field_fn(struct cjson *f, struct serializer *slzr, void *da
 }
 
 static size_t
-serialize_tasks_id_field_fn(FILE *fp, struct serializer *f, void *data)
+serialize_tasks_id_field_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t id = *(uint32_t *)data;
 
 	if (f->name[0]) {
-		fprintf(fp, "\"%s\":%d,", f->name, id);
+		pw_buf_printf(buf, "\"%s\":%d,", f->name, id);
 	} else if (id) {
-		fprintf(fp, "%d,", id);
+		pw_buf_printf(buf, "%d,", id);
 	}
 	return 4;
 }
 
 static size_t
-serialize_id_removed_fn(FILE *fp, struct serializer *f, void *data)
+serialize_id_removed_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	/* TODO? */
 	return 0;
@@ -292,7 +291,7 @@ deserialize_id_removed_fn(struct cjson *f, struct serializer *slzr, void *data)
 
 	deserialize_log(f, &is_removed);
 
-	if (JSi(f)) {
+	if (cjson_int(f)) {
 		*(uint32_t *)(data) |= (1 << 31);
 	} else {
 		*(uint32_t *)(data) &= ~(1 << 31);
@@ -336,7 +335,7 @@ static struct serializer pw_task_date_span_serializer[] = {
 };
 
 static struct serializer pw_task_item_serializer[] = {
-	{ "id", _CUSTOM, serialize_common_item_id_fn, deserialize_common_item_id_fn, (void *)(uintptr_t)0 },
+	{ "id", _CUSTOM(4), serialize_common_item_id_fn, deserialize_common_item_id_fn, (void *)(uintptr_t)0 },
 	{ "_is_common", _INT8 },
 	{ "amount", _INT32 },
 	{ "probability", _FLOAT },
@@ -356,9 +355,9 @@ static struct serializer pw_task_player_serializer[] = {
 };
 
 static struct serializer pw_task_mob_serializer[] = {
-	{ "id", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "id", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "count", _INT32 },
-	{ "drop_item_id", _CUSTOM, serialize_common_item_id_fn, deserialize_common_item_id_fn, (void *)(uintptr_t)4 },
+	{ "drop_item_id", _CUSTOM(4), serialize_common_item_id_fn, deserialize_common_item_id_fn, (void *)(uintptr_t)4 },
 	{ "drop_item_cnt", _INT32 },
 	{ "_drop_item_is_common", _INT8 },
 	{ "drop_item_probability", _FLOAT },
@@ -392,7 +391,7 @@ struct __attribute__((packed)) pw_task_award {
 static struct serializer pw_task_award_serializer[] = {
 	{ "coins", _INT32 },
 	{ "xp", _INT32 },
-	{ "new_quest", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+	{ "new_quest", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "sp", _INT32 },
 	{ "rep", _INT32 },
 	{ "culti", _INT32 },
@@ -402,7 +401,7 @@ static struct serializer pw_task_award_serializer[] = {
 	{ "petbag_slots", _INT32 },
 	{ "chi", _INT32 },
 	{ "tp", _OBJECT_START, NULL, NULL, pw_task_point_serializer },
-	{ "ai_trigger", _CUSTOM, pw_npc_serialize_trigger_ai_id, pw_npc_deserialize_trigger_ai_id },
+	{ "ai_trigger", _CUSTOM(4), pw_npc_serialize_trigger_ai_id, pw_npc_deserialize_trigger_ai_id },
 	{ "ai_trigger_enable", _INT8 },
 	{ "level_multiplier", _INT8 },
 	{ "divorce", _INT8 },
@@ -432,14 +431,14 @@ static struct serializer pw_task_award_scaled_serializer[] = {
 static struct serializer pw_task_talk_proc_choice_serializer[] = {
 	{ "id", _INT32, NULL, NULL, (void *)(uintptr_t)1 },
 	{ "text", _WSTRING(64) },
-	{ "param", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+	{ "param", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "", _TYPE_END },
 };
 
 static struct serializer pw_task_talk_proc_question_serializer[] = {
 	{ "id", _INT32, NULL, NULL, (void *)(uintptr_t)1 },
 	{ "parent_id", _INT32 },
-	{ "text", _CUSTOM, serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
+	{ "text", _CUSTOM(4 + PW_POINTER_BUF_SIZE), serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
 	{ "_choices_cnt", _INT32 },
 	{ "choices", _CHAIN_TABLE, pw_task_talk_proc_choice_serializer },
 	{ "", _TYPE_END },
@@ -462,20 +461,16 @@ static struct serializer pw_task_ref_serializer[] = {
 static struct serializer pw_task_serializer[];
 
 static size_t
-serialize_type_fn(FILE *fp, struct serializer *f, void *data)
+serialize_type_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	void *task = data;
 	int val;
 
-	if (fp == g_nullfile) {
-		return 0;
-	}
-
 	val = *(uint32_t *)serializer_get_field(pw_task_serializer, "_type", task);
 	if (*(uint8_t *)serializer_get_field(pw_task_serializer, "_is_gold_quest", task)) val = 10;
 
 	if (val) {
-		fprintf(fp, "\"%s\":%d,", f->name, val);
+		pw_buf_printf(buf, "\"%s\":%d,", f->name, val);
 	}
 
 	return 0;
@@ -491,7 +486,7 @@ deserialize_type_fn(struct cjson *f, struct serializer *slzr, void *data)
 		return 0;
 	}
 
-	val = JSi(f);
+	val = cjson_int(f);
 
 	switch (val) {
 		case 10:
@@ -509,22 +504,18 @@ deserialize_type_fn(struct cjson *f, struct serializer *slzr, void *data)
 }
 
 static size_t
-serialize_start_by_fn(FILE *fp, struct serializer *f, void *data)
+serialize_start_by_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	void *task = data;
 	int val = 2;
 
-	if (fp == g_nullfile) {
-		return 0;
-	}
-
 	if (*(uint32_t *)serializer_get_field(pw_task_serializer, "parent_quest", task)) val = 0;
 	else if (*(uint8_t *)serializer_get_field(pw_task_serializer, "_auto_trigger", task)) val = 1;
 	else if (*(uint8_t *)serializer_get_field(pw_task_serializer, "_start_on_enter", task)) val = 3;
 	else if (*(uint8_t *)serializer_get_field(pw_task_serializer, "_trigger_on_death", task)) val = 4;
 
 	if (val) {
-		fprintf(fp, "\"%s\":%d,", f->name, val);
+		pw_buf_printf(buf, "\"%s\":%d,", f->name, val);
 	}
 
 	return 0;
@@ -548,7 +539,7 @@ deserialize_start_by(struct cjson *f, struct serializer *slzr, void *data)
 		return 0;
 	}
 
-	switch (JSi(f)) {
+	switch (cjson_int(f)) {
 		case 1:
 			*(uint8_t *)serializer_get_field(pw_task_serializer, "_auto_trigger", task) = 1;
 			break;
@@ -567,7 +558,7 @@ deserialize_start_by(struct cjson *f, struct serializer *slzr, void *data)
 }
 
 static size_t
-serialize_subquest_activate_order_fn(FILE *fp, struct serializer *f, void *data)
+serialize_subquest_activate_order_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint8_t _activate_chosen_subquest = *(uint8_t *)data;
 	uint8_t _activate_random_subquest = *(uint8_t *)(data + 1);
@@ -582,7 +573,7 @@ serialize_subquest_activate_order_fn(FILE *fp, struct serializer *f, void *data)
 		val = 3;
 	}
 
-	fprintf(fp, "\"%s\":%d,", f->name, val);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, val);
 	return 0;
 }
 
@@ -601,7 +592,7 @@ deserialize_subquest_activate_order_fn(struct cjson *f, struct serializer *slzr,
 	*_activate_random_subquest = 0;
 	*_activate_subquests_in_order = 0;
 
-	switch (JSi(f)) {
+	switch (cjson_int(f)) {
 		case 1:
 			*_activate_chosen_subquest = 1;
 			break;
@@ -619,19 +610,15 @@ deserialize_subquest_activate_order_fn(struct cjson *f, struct serializer *slzr,
 }
 
 static size_t
-serialize_avail_frequency_fn(FILE *fp, struct serializer *f, void *data)
+serialize_avail_frequency_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	int val = 0;
 	void *task = data;
 
-	if (fp == g_nullfile) {
-		return 0;
-	}
-
 	val = *(uint32_t *)serializer_get_field(pw_task_serializer, "_avail_frequency", task);
 	if (*(uint8_t *)serializer_get_field(pw_task_serializer, "_need_record", task)) val = 6;
 
-	fprintf(fp, "\"%s\":%d,", f->name, val);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, val);
 	return 0;
 }
 
@@ -646,7 +633,7 @@ deserialize_avail_frequency_fn(struct cjson *f, struct serializer *slzr, void *d
 	uint32_t *_avail_frequency = serializer_get_field(slzr, "_avail_frequency", task);
 	uint8_t *_need_record = serializer_get_field(slzr, "_need_record", task);
 	uint8_t *_can_retake = serializer_get_field(slzr, "_can_retake", task);
-	uint32_t val = JSi(f);
+	uint32_t val = cjson_int(f);
 
 	switch (val) {
 		case 0:
@@ -670,16 +657,12 @@ deserialize_avail_frequency_fn(struct cjson *f, struct serializer *slzr, void *d
 }
 
 static size_t
-serialize_premise_class_fn(FILE *fp, struct serializer *f, void *data)
+serialize_premise_class_fn(struct pw_buf *buf, struct serializer *f, void *data)
 {
 	uint32_t arr_cnt = *(uint32_t *)data;
 	uint32_t *arr = (uint32_t *)(data + 4);
 	uint8_t classmask = 0;
 
-	if (fp == g_nullfile) {
-		return 0;
-	}
-
 	for (int i = 0; i < arr_cnt; i++) {
 		uint32_t val = arr[i];
 		assert(val < 8);
@@ -691,7 +674,7 @@ serialize_premise_class_fn(FILE *fp, struct serializer *f, void *data)
 		classmask = 255;
 	}
 
-	fprintf(fp, "\"%s\":%d,", f->name, classmask);
+	pw_buf_printf(buf, "\"%s\":%d,", f->name, classmask);
 	return 0;
 }
 
@@ -705,7 +688,7 @@ deserialize_premise_class_fn(struct cjson *f, struct serializer *slzr, void *dat
 	uint32_t *arr_cnt = (uint32_t *)data;
 	uint32_t *arr = (uint32_t *)(data + 4);
 
-	uint32_t val = JSi(f);
+	uint32_t val = cjson_int(f);
 	if (val == 0) {
 		/* pw treats no class requirement as all-class available, so we make
 		 * it require sin and psychic */
@@ -734,10 +717,10 @@ deserialize_premise_class_fn(struct cjson *f, struct serializer *slzr, void *dat
 
 
 static struct serializer pw_task_serializer[] = {
-	{ "start_by", _CUSTOM, serialize_start_by_fn, deserialize_start_by },
-	{ "avail_frequency", _CUSTOM, serialize_avail_frequency_fn, deserialize_avail_frequency_fn },
-	{ "type", _CUSTOM, serialize_type_fn, deserialize_type_fn },
-	{ "_removed", _CUSTOM, serialize_id_removed_fn, deserialize_id_removed_fn },
+	{ "start_by", _CUSTOM(0), serialize_start_by_fn, deserialize_start_by },
+	{ "avail_frequency", _CUSTOM(0), serialize_avail_frequency_fn, deserialize_avail_frequency_fn },
+	{ "type", _CUSTOM(0), serialize_type_fn, deserialize_type_fn },
+	{ "_removed", _CUSTOM(0), serialize_id_removed_fn, deserialize_id_removed_fn },
 	{ "id", _INT32 },
 	{ "name", _WSTRING(30) },
 	{ "_has_signature", _INT8 }, /* we'll be always setting this to 0 */
@@ -752,7 +735,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "_ptr3", _INT32 },
 	{ "_ptr4", _INT32 },
 	{ "_avail_frequency", _INT32 },
-	{ "subquest_activate_order", _CUSTOM, serialize_subquest_activate_order_fn, deserialize_subquest_activate_order_fn },
+	{ "subquest_activate_order", _CUSTOM(0), serialize_subquest_activate_order_fn, deserialize_subquest_activate_order_fn },
 	{ "_activate_chosen_subquest", _INT8 },
 	{ "_activate_random_subquest", _INT8 },
 	{ "_activate_subquests_in_order", _INT8 },
@@ -770,7 +753,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "start_on_enter_location", _OBJECT_START, NULL, NULL, pw_task_location_serializer },
 	{ "instant_teleport", _INT8 },
 	{ "instant_teleport_point", _OBJECT_START, NULL, NULL, pw_task_point_serializer },
-	{ "ai_trigger", _CUSTOM, pw_npc_serialize_trigger_ai_id, pw_npc_deserialize_trigger_ai_id },
+	{ "ai_trigger", _CUSTOM(4), pw_npc_serialize_trigger_ai_id, pw_npc_deserialize_trigger_ai_id },
 	{ "ai_trigger_enable", _INT8 },
 	{ "_auto_trigger", _INT8 },
 	{ "_trigger_on_death", _INT8 },
@@ -778,8 +761,8 @@ static struct serializer pw_task_serializer[] = {
 	{ "recommended_level", _INT32 },
 	{ "no_display_quest_title", _INT8 },
 	{ "_is_gold_quest", _INT8 },
-	{ "start_npc", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
-	{ "finish_npc", _CUSTOM, serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "start_npc", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
+	{ "finish_npc", _CUSTOM(4), serialize_elements_id_field_fn, deserialize_elements_id_field_fn },
 	{ "_is_craft_skill_quest", _INT8 },
 	{ "cant_be_found", _INT8 },
 	{ "no_show_direction", _INT8 },
@@ -801,7 +784,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "show_without_premise_reputation", _INT8 },
 	{ "_premise_quests_cnt", _INT32 },
 	{ "premise_quests", _ARRAY_START(5) },
-		{ "", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+		{ "", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "", _ARRAY_END },
 	{ "show_without_premise_quests", _INT8 },
 	{ "premise_cultivation", _INT32 },
@@ -810,7 +793,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "show_without_premise_faction_role", _INT8 },
 	{ "premise_gender", _INT32 },
 	{ "show_without_premise_gender", _INT8 },
-	{ "premise_class", _CUSTOM, serialize_premise_class_fn, deserialize_premise_class_fn },
+	{ "premise_class", _CUSTOM(0), serialize_premise_class_fn, deserialize_premise_class_fn },
 	{ "_premise_class_cnt", _INT32 },
 	{ "_premise_class_arr", _ARRAY_START(8) },
 		{ "", _INT32 },
@@ -823,7 +806,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "_premise_global_quest_cond", _INT32 },
 	{ "_mutex_quests_cnt", _INT32 },
 	{ "mutex_quests", _ARRAY_START(5) },
-		{ "", _CUSTOM, serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
+		{ "", _CUSTOM(4), serialize_tasks_id_field_fn, deserialize_tasks_id_field_fn },
 	{ "", _ARRAY_END },
 	{ "premise_blacksmith_level", _INT32 },
 	{ "premise_tailor_level", _INT32 },
@@ -872,7 +855,7 @@ static struct serializer pw_task_serializer[] = {
 	{ "_previous_quest", _INT32 }, /* the game doesn't read those, they're just for convenience */
 	{ "_next_quest", _INT32 },
 	{ "_sub_quest_first", _INT32 },
-/*	{ "signature", _CUSTOM, serialize_signature, deserialize_signature },
+/*	{ "signature", _CUSTOM(0), serialize_signature, deserialize_signature },
  * the signature is always removed */
 	{ "date_spans", _CHAIN_TABLE, pw_task_date_span_serializer },
 	{ "premise_items", _CHAIN_TABLE, pw_task_item_serializer },
@@ -886,10 +869,10 @@ static struct serializer pw_task_serializer[] = {
 	{ "failure_timed_award", _OBJECT_START, NULL, NULL, pw_task_award_timed_serializer },
 	{ "scaled_award", _OBJECT_START, NULL, NULL, pw_task_award_scaled_serializer },
 	{ "failure_scaled_award", _OBJECT_START, NULL, NULL, pw_task_award_scaled_serializer },
-	{ "briefing", _CUSTOM, serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
-	{ "unk1_text", _CUSTOM, serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
-	{ "unk2_text", _CUSTOM, serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
-	{ "description", _CUSTOM, serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
+	{ "briefing", _CUSTOM(4 + PW_POINTER_BUF_SIZE), serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
+	{ "unk1_text", _CUSTOM(4 + PW_POINTER_BUF_SIZE), serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
+	{ "unk2_text", _CUSTOM(4 + PW_POINTER_BUF_SIZE), serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
+	{ "description", _CUSTOM(4 + PW_POINTER_BUF_SIZE), serialize_pascal_wstr_fn, deserialize_pascal_wstr_fn },
 	{ "dialogue", _OBJECT_START },
 		{ "initial", _OBJECT_START, NULL, NULL, pw_task_talk_proc_serializer },
 		{ "notqualified", _OBJECT_START, NULL, NULL, pw_task_talk_proc_serializer },
@@ -903,7 +886,7 @@ static struct serializer pw_task_serializer[] = {
 };
 
 static int
-read_award(void **buf_p, FILE *fp, bool is_server)
+read_award(void **buf_p, FILE *fp, bool is_server, struct pw_arena *arena)
 {
 	void *data, *buf, *ptr;
 	size_t i, item_groups_count;
@@ -923,7 +906,7 @@ read_award(void **buf_p, FILE *fp, bool is_server)
 	}
 
 	item_groups_count = *(uint32_t *)serializer_get_field(slzr, "_item_groups_cnt", data);
-	*(void **)buf = ptr = pw_chain_table_fread(fp, "item_groups", 0, pw_task_item_group_serializer);
+	*(void **)buf = ptr = pw_chain_table_fread(fp, "item_groups", 0, pw_task_item_group_serializer, arena);
 	if (!ptr) {
 		return -1;
 	}
@@ -940,7 +923,7 @@ read_award(void **buf_p, FILE *fp, bool is_server)
 		size_t item_count = *(uint32_t *)serializer_get_field(pw_task_item_group_serializer, "_items_cnt", data_start);
 		void *items = serializer_get_field(pw_task_item_group_serializer, "items", data_start);
 
-		*(void **)items = pw_chain_table_fread(fp, "items", item_count, pw_task_item_serializer);
+		*(void **)items = pw_chain_table_fread(fp, "items", item_count, pw_task_item_serializer, arena);
 		if (!*(void **)items) {
 			return -1;
 		}
@@ -952,13 +935,7 @@ read_award(void **buf_p, FILE *fp, bool is_server)
 #define SAVE_TBL_CNT(name, slzr, data) \
 	({ \
 		struct pw_chain_table *tbl = *(void **)serializer_get_field(slzr, name, data); \
-		struct pw_chain_el *chain = tbl ? tbl->chain : NULL; \
-		uint32_t cnt = 0; \
-		while (chain) { \
-			cnt += chain->count; \
-			chain = chain->next; \
-		} \
-		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = cnt; \
+		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = tbl ? pw_chain_table_size(tbl) : 0; \
 	})
 
 #define SAVE_TRUNCATED_TBL_CNT(name, slzr, data) \
@@ -978,13 +955,7 @@ read_award(void **buf_p, FILE *fp, bool is_server)
 #define TRUNCATE_TBL(name, slzr, data) \
 	({ \
 		struct pw_chain_table *tbl = *(void **)serializer_get_field(slzr, name, data); \
-		struct pw_chain_el *chain = tbl ? tbl->chain : NULL; \
-		uint32_t cnt = 0; \
-		while (chain) { \
-			cnt += chain->count; \
-			chain = chain->next; \
-		} \
-		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = cnt; \
+		*(uint32_t *)serializer_get_field(slzr, "_" name "_cnt", data) = tbl ? pw_chain_table_size(tbl) : 0; \
 	})
 
 static void
@@ -997,11 +968,10 @@ write_award(void **buf_p, FILE *fp, bool is_client)
 
 	buf = data = *buf_p;
 	table = *(void **)serializer_get_field(slzr, "item_groups", data);
-	if (table && table->chain->count > 1) {
+	if (table && pw_chain_table_size(table) > 1) {
 		if (*(uint8_t *)serializer_get_field(table->serializer, "chosen_randomly", table->chain->data)) {
 			/* if it's a random item there must be just one group */
-			table->chain->count = 1;
-			table->chain->next = NULL;
+			pw_chain_table_truncate(table, 1);
 		}
 	}
 
@@ -1056,7 +1026,7 @@ write_award(void **buf_p, FILE *fp, bool is_client)
 }
 
 #define LOAD_CHAIN_TBL_CNT(fp, name, data_slzr, data_start, tbl_slzr, cnt) \
-	*(void **)(buf) = tbl_p = pw_chain_table_fread((fp), #name, cnt, tbl_slzr); \
+	*(void **)(buf) = tbl_p = pw_chain_table_fread((fp), #name, cnt, tbl_slzr, taskf->arena); \
 	if (!(tbl_p)) { \
 		PWLOG(LOG_ERROR, "pw_chain_table_fread() failed\n"); \
 		return -1; \
@@ -1135,12 +1105,12 @@ read_task(struct pw_task_file *taskf, FILE *fp, bool is_server)
 	LOAD_CHAIN_TBL(fp, "req_monsters", slzr, data, pw_task_mob_serializer);
 	LOAD_CHAIN_TBL(fp, "req_items", slzr, data, pw_task_item_serializer);
 
-	rc = read_award(&buf, fp, is_server);
+	rc = read_award(&buf, fp, is_server, taskf->arena);
 	if (rc < 0) {
 		return -1;
 	}
 
-	rc = read_award(&buf, fp, is_server);
+	rc = read_award(&buf, fp, is_server, taskf->arena);
 	if (rc < 0) {
 		return -1;
 	}
@@ -1156,7 +1126,7 @@ read_task(struct pw_task_file *taskf, FILE *fp, bool is_server)
 
 		for (i = 0; i < count; i++) {
 			void *el = pw_chain_table_new_el(tbl_p);
-			rc = read_award(&el, fp, is_server);
+			rc = read_award(&el, fp, is_server, taskf->arena);
 			if (rc) {
 				return -1;
 			}
@@ -1174,7 +1144,7 @@ read_task(struct pw_task_file *taskf, FILE *fp, bool is_server)
 
 		for (i = 0; i < count; i++) {
 			void *el = pw_chain_table_new_el(tbl_p);
-			rc = read_award(&el, fp, is_server);
+			rc = read_award(&el, fp, is_server, taskf->arena);
 			if (rc) {
 				return -1;
 			}
@@ -1274,18 +1244,20 @@ read_task(struct pw_task_file *taskf, FILE *fp, bool is_server)
 int
 pw_tasks_patch_obj(struct pw_task_file *taskf, struct cjson *obj)
 {
+	static struct cjson_path db_type_path = CJSON_PATH("_db.type");
+	static struct cjson_path id_path = CJSON_PATH("id");
 	void *table_el;
 	struct pw_idmap_el *node;
 	const char *obj_type;
 	int64_t id;
 
-	obj_type = JSs(obj, "_db", "type");
+	obj_type = JPs(obj, &db_type_path);
 	if (!obj_type) {
 		PWLOG(LOG_ERROR, "missing obj._db.type\n");
 		return -1;
 	}
 
-	id = JSi(obj, "id");
+	id = JPi(obj, &id_path);
 	if (!id) {
 		PWLOG(LOG_ERROR, "missing obj.id\n");
 		return -1;
@@ -1302,7 +1274,10 @@ pw_tasks_patch_obj(struct pw_task_file *taskf, struct cjson *obj)
 		*(uint8_t *)serializer_get_field(pw_task_serializer, "_can_retake", table_el) = 1;
 
 	}
+	pw_chain_table_set_des_arena(taskf->arena);
 	deserialize(obj, pw_task_serializer, table_el);
+	pw_chain_table_set_des_arena(NULL);
+	pw_chain_table_set_removed(taskf->tasks, table_el, *(uint32_t *)table_el & (1 << 31));
 	return 0;
 }
 
@@ -1625,6 +1600,11 @@ pw_tasks_load(struct pw_task_file *taskf, const char *path, const char *idmap_fi
 
 	memset(taskf, 0, sizeof(*taskf));
 
+	taskf->arena = pw_arena_init(0);
+	if (!taskf->arena) {
+		return -ENOMEM;
+	}
+
 	fp = fopen(path, "rb");
 	if (!fp) {
 		return -errno;
@@ -1662,7 +1642,7 @@ pw_tasks_load(struct pw_task_file *taskf, const char *path, const char *idmap_fi
 	g_tasks_map = taskf->idmap;
 
 	fread(jmp_offsets, sizeof(*jmp_offsets), count, fp);
-	taskf->tasks = pw_chain_table_alloc("quests", pw_task_serializer, serializer_get_size(pw_task_serializer), count);
+	taskf->tasks = pw_chain_table_alloc("quests", pw_task_serializer, serializer_get_size(pw_task_serializer), count, taskf->arena);
 	if (!taskf->tasks) {
 		free(jmp_offsets);
 		fclose(fp);
@@ -1684,39 +1664,33 @@ pw_tasks_load(struct pw_task_file *taskf, const char *path, const char *idmap_fi
 	return 0;
 }
 
-int
-pw_tasks_serialize(struct pw_task_file *taskf, const char *filename)
+void
+pw_tasks_free(struct pw_task_file *taskf)
 {
-	FILE *fp = fopen(filename, "wb");
-	void *el;
+	pw_idmap_clear(taskf->idmap, 0);
 
-	if (fp == NULL) {
-		PWLOG(LOG_ERROR, "cant open %s\n", filename);
-		return 1;
-	}
-
-	fprintf(fp, "[");
-
-	PW_CHAIN_TABLE_FOREACH(el, taskf->tasks) {
-		struct serializer *tmp_slzr = pw_task_serializer;
-		size_t pos_begin = ftell(fp);
-		void *tmp_el = el;
+	/* the tasks and all their nested tables */
+	pw_arena_free(taskf->arena);
+	taskf->arena = NULL;
+	taskf->tasks = NULL;
+}
 
-		_serialize(fp, &tmp_slzr, &tmp_el, 1, true, true, true);
+int
+pw_tasks_serialize(struct pw_task_file *taskf, const char *filename)
+{
+	struct pw_buf buf = {};
+	int rc;
 
-		if (ftell(fp) > pos_begin + 2) {
-			fprintf(fp, ",\n");
-		}
-	}
+	pw_buf_putc(&buf, '[');
+	pw_chain_table_serialize_objs(&buf, taskf->tasks, true, ",\n", 2);
 
 	/* replace ,\n} with }] */
-	fseek(fp, -3, SEEK_CUR);
-	fprintf(fp, "}]");
+	pw_buf_rollback(&buf, pw_buf_mark(&buf) - 3);
+	pw_buf_write(&buf, "}]", 2);
 
-	size_t sz = ftell(fp);
-	fclose(fp);
-	truncate(filename, sz);
-	return 0;
+	rc = pw_buf_save(&buf, filename);
+	pw_buf_free(&buf);
+	return rc ? 1 : 0;
 }
 
 int
@@ -1737,10 +1711,9 @@ pw_tasks_save(struct pw_task_file *taskf, const char *path, bool is_server)
 	fwrite(&taskf->version, sizeof(taskf->version), 1, fp);
   
 	count = 0;
-	PW_CHAIN_TABLE_FOREACH(el, taskf->tasks) {
-		uint32_t id = *(uint32_t *)el;
+	PW_CHAIN_TABLE_FOREACH_LIVE(el, taskf->tasks) {
 		uint32_t parent_id = *(uint32_t *)serializer_get_field(pw_task_serializer, "parent_quest", el);
-		if (!parent_id && (id & (1 << 31)) == 0) {
+		if (!parent_id) {
 			count++;
 		}
 	}
@@ -1757,11 +1730,10 @@ pw_tasks_save(struct pw_task_file *taskf, const char *path, bool is_server)
 	fseek(fp, count * sizeof (*jmp_offsets), SEEK_CUR);
 
 	uint32_t i = 0;
-	PW_CHAIN_TABLE_FOREACH(el, taskf->tasks) {
+	PW_CHAIN_TABLE_FOREACH_LIVE(el, taskf->tasks) {
 		struct serializer *slzr = pw_task_serializer;
-		uint32_t id = *(uint32_t *)el;
 		uint32_t parent_id = *(uint32_t *)serializer_get_field(slzr, "parent_quest", el);
-		if (parent_id || (id & (1 << 31))) {
+		if (parent_id) {
 			continue;
 		}
 
@@ -1778,29 +1750,60 @@ pw_tasks_save(struct pw_task_file *taskf, const char *path, bool is_server)
 	return 0;
 }
 
+struct task_rates_ctx {
+	double xp_rate;
+	double sp_rate;
+	double coins_rate;
+	int success_award_off;
+	int failure_award_off;
+	/* nested tables of awards */
+	int awards_tbl_offs[4];
+};
+
+static void
+adjust_award_rates(struct task_rates_ctx *ctx, struct pw_task_award *award)
+{
+	award->xp *= ctx->xp_rate;
+	award->sp *= ctx->sp_rate;
+	award->coins *= ctx->coins_rate;
+}
+
+static void
+adjust_task_rates_fn(void *_ctx, void *task)
+{
+	struct task_rates_ctx *ctx = _ctx;
+	void *el;
+	int i;
+
+	adjust_award_rates(ctx, task + ctx->success_award_off);
+	adjust_award_rates(ctx, task + ctx->failure_award_off);
+
+	for (i = 0; i < sizeof(ctx->awards_tbl_offs) / sizeof(ctx->awards_tbl_offs[0]); i++) {
+		struct pw_chain_table *table = *(void **)(task + ctx->awards_tbl_offs[i]);
+
+		PW_CHAIN_TABLE_FOREACH(el, table) {
+			adjust_award_rates(ctx, el);
+		}
+	}
+}
+
 void
 pw_tasks_adjust_rates(struct pw_task_file *taskf, struct cjson *rates)
 {
-	void *task;
+	struct task_rates_ctx ctx;
 
-	double xp_rate = JSf(rates, "quest", "xp");
-	double sp_rate = JSf(rates, "quest", "sp");
-	double coins_rate = JSf(rates, "quest", "coin");
+	ctx.xp_rate = JSf(rates, "quest", "xp");
+	ctx.sp_rate = JSf(rates, "quest", "sp");
+	ctx.coins_rate = JSf(rates, "quest", "coin");
 
 	fprintf(stderr, "Adjusting rates:\n");
-	fprintf(stderr, "  quest xp:   %8.4f\n", xp_rate);
-	fprintf(stderr, "  quest sp:   %8.4f\n", sp_rate);
-	fprintf(stderr, "  quest coin: %8.4f\n", coins_rate);
-
-	void adjust_award_rates(struct pw_task_award *award) {
-		award->xp *= xp_rate;
-		award->sp *= sp_rate;
-		award->coins *= coins_rate;
-	}
+	fprintf(stderr, "  quest xp:   %8.4f\n", ctx.xp_rate);
+	fprintf(stderr, "  quest sp:   %8.4f\n", ctx.sp_rate);
+	fprintf(stderr, "  quest coin: %8.4f\n", ctx.coins_rate);
 
 	struct serializer *slzr = taskf->tasks->serializer;
-	int success_award_off = serializer_get_offset(slzr, "award");
-	int failure_award_off = serializer_get_offset(slzr, "failure_award");
+	ctx.success_award_off = serializer_get_offset(slzr, "award");
+	ctx.failure_award_off = serializer_get_offset(slzr, "failure_award");
 	struct serializer *timed_award_slzr;
 	int success_timed_awards_tbl_off = serializer_get_offset_slzr(slzr, "timed_award", &timed_award_slzr);
 	int failure_timed_awards_tbl_off = serializer_get_offset_slzr(slzr, "failure_timed_award", &timed_award_slzr);
@@ -1814,25 +1817,11 @@ pw_tasks_adjust_rates(struct pw_task_file *taskf, struct cjson *rates)
 	success_scaled_awards_tbl_off += serializer_get_offset(scaled_award_slzr->ctx, "awards");
 	failure_scaled_awards_tbl_off += serializer_get_offset(scaled_award_slzr->ctx, "awards");
 
-	PW_CHAIN_TABLE_FOREACH(task, taskf->tasks) {
-		void *el;
-		int i;
-
-		adjust_award_rates(task + success_award_off);
-		adjust_award_rates(task + failure_award_off);
-
-		struct pw_chain_table *success_timed = *(void **)(task + success_timed_awards_tbl_off);
-		struct pw_chain_table *failure_timed = *(void **)(task + failure_timed_awards_tbl_off);
-		struct pw_chain_table *success_scaled = *(void **)(task + success_scaled_awards_tbl_off);
-		struct pw_chain_table *failure_scaled = *(void **)(task + failure_scaled_awards_tbl_off);
-		struct pw_chain_table *tables[] = { success_timed, failure_timed, success_scaled, failure_scaled };
+	ctx.awards_tbl_offs[0] = success_timed_awards_tbl_off;
+	ctx.awards_tbl_offs[1] = failure_timed_awards_tbl_off;
+	ctx.awards_tbl_offs[2] = success_scaled_awards_tbl_off;
+	ctx.awards_tbl_offs[3] = failure_scaled_awards_tbl_off;
 
-		for (i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
-			struct pw_chain_table *table = tables[i];
-
-			PW_CHAIN_TABLE_FOREACH(el, table) {
-				adjust_award_rates(el);
-			}
-		}
-	}
+	/* every task only touches its own awards */
+	pw_chain_table_parallel_foreach(taskf->tasks, adjust_task_rates_fn, &ctx);
 }
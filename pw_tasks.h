@@ -10,11 +10,13 @@ struct pw_task_file {
 	uint32_t version;
 	struct pw_idmap *idmap;
 	struct pw_chain_table *tasks;
+	struct pw_arena *arena;
 	unsigned max_arr_idx;
 	unsigned max_dialogue_id;
 };
 
 int pw_tasks_load(struct pw_task_file *taskf, const char *path, const char *idmap_path);
+void pw_tasks_free(struct pw_task_file *taskf);
 int pw_tasks_serialize(struct pw_task_file *taskf, const char *filename);
 int pw_tasks_patch_obj(struct pw_task_file *taskf, struct cjson *obj);
 int pw_tasks_save(struct pw_task_file *taskf, const char *path, bool is_server);
@@ -84,7 +84,7 @@ pw_tasks_npc_load(const char *filepath)
 		goto err;
 	}
 
-	tasks->table = pw_chain_table_alloc("", NULL, sizeof(struct tasks_npc_entry_tmp), tasks->hdr.npc_count);
+	tasks->table = pw_chain_table_alloc("", NULL, sizeof(struct tasks_npc_entry_tmp), tasks->hdr.npc_count, NULL);
 	if (!tasks->table) {
 		goto err;
 	}
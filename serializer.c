@@ -17,233 +17,620 @@
 #include <sys/stat.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "serializer.h"
 #include "common.h"
 #include "cjson.h"
 
-long
-_serialize(FILE *fp, struct serializer **slzr_table_p, void **data_p,
+/* "%u," */
+static void
+print_uint(struct pw_buf *buf, uint32_t num)
+{
+	char tmp[16];
+	char *b = tmp + sizeof(tmp);
+
+	*--b = ',';
+	do {
+		*--b = '0' + num % 10;
+		num /= 10;
+	} while (num);
+
+	pw_buf_write(buf, b, tmp + sizeof(tmp) - b);
+}
+
+enum serializer_op_type {
+	SERIALIZER_OP_INT8,
+	SERIALIZER_OP_INT32,
+	SERIALIZER_OP_CONST_INT,
+	SERIALIZER_OP_FLOAT,
+	SERIALIZER_OP_WSTRING,
+	SERIALIZER_OP_STRING,
+	SERIALIZER_OP_ARRAY,
+	SERIALIZER_OP_OBJECT,
+	SERIALIZER_OP_CUSTOM,
+};
+
+struct serializer_op {
+	enum serializer_op_type type;
+	/* the name starts with _, so the field is not exported */
+	bool hidden;
+	/* printed even when 0 (an id field with an idmap ctx) */
+	bool always;
+	/* the root "id" that deserialize() doesn't touch */
+	bool root_id;
+	/* offset inside the element */
+	uint32_t off;
+	/* string length, array element count, or the value of a const int */
+	uint32_t len;
+	/* "name": or NULL if the field is nameless */
+	char *key;
+	uint32_t key_len;
+	uint32_t name_hash;
+	/* the original table entry, passed to custom fns */
+	struct serializer *slzr;
+	/* array element or object fields */
+	struct serializer_plan *nested;
+};
+
+struct serializer_plan {
+	/* the _TYPE_END / _ARRAY_END / _OBJECT_END entry */
+	struct serializer *end;
+	uint32_t el_size;
+	/* elements are printed as objects rather than plain values */
+	bool is_obj;
+	/* open-addressing hash table of name -> op index + 1 (0 = empty slot) */
+	uint32_t *name_idx;
+	uint32_t name_idx_mask;
+	unsigned op_cnt;
+	struct serializer_op ops[];
+};
+
+static pthread_mutex_t g_plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the first field with a given name wins, just like in a linear search */
+static void
+index_plan_names(struct serializer_plan *plan)
+{
+	uint32_t size = 8;
+	unsigned i;
+
+	while (size < plan->op_cnt * 2) {
+		size *= 2;
+	}
+
+	plan->name_idx = calloc(size, sizeof(*plan->name_idx));
+	if (!plan->name_idx) {
+		PWLOG(LOG_ERROR, "calloc() failed\n");
+		abort();
+	}
+	plan->name_idx_mask = size - 1;
+
+	for (i = 0; i < plan->op_cnt; i++) {
+		struct serializer_op *op = &plan->ops[i];
+		uint32_t h = op->name_hash ? op->name_hash : cjson_key_hash(op->slzr->name);
+		uint32_t *slot;
+
+		while (*(slot = &plan->name_idx[h & plan->name_idx_mask])) {
+			if (strcmp(plan->ops[*slot - 1].slzr->name, op->slzr->name) == 0) {
+				break;
+			}
+			h++;
+		}
+
+		if (!*slot) {
+			*slot = i + 1;
+		}
+	}
+}
+
+static struct serializer_op *
+plan_lookup(struct serializer_plan *plan, const char *name)
+{
+	uint32_t h = cjson_key_hash(name);
+	uint32_t idx;
+
+	while ((idx = plan->name_idx[h & plan->name_idx_mask])) {
+		struct serializer_op *op = &plan->ops[idx - 1];
+
+		if (strcmp(op->slzr->name, name) == 0) {
+			return op;
+		}
+		h++;
+	}
+
+	return NULL;
+}
+
+static struct serializer_plan *
+compile_plan(struct serializer *slzr_table)
+{
+	struct serializer_plan *plan, *tmp;
+	struct serializer *slzr = slzr_table;
+	struct serializer_op *op;
+	unsigned cap = 16;
+	uint32_t off = 0;
+
+	if (slzr_table->plan) {
+		return slzr_table->plan;
+	}
+
+	plan = calloc(1, sizeof(*plan) + cap * sizeof(plan->ops[0]));
+	if (!plan) {
+		PWLOG(LOG_ERROR, "calloc() failed\n");
+		abort();
+	}
+
+	plan->is_obj = slzr->name[0] != 0;
+	while (slzr->type != _TYPE_END && slzr->type != _ARRAY_END && slzr->type != _OBJECT_END) {
+		if (plan->op_cnt == cap) {
+			cap *= 2;
+			tmp = realloc(plan, sizeof(*plan) + cap * sizeof(plan->ops[0]));
+			if (!tmp) {
+				PWLOG(LOG_ERROR, "realloc() failed\n");
+				abort();
+			}
+			plan = tmp;
+		}
+
+		op = &plan->ops[plan->op_cnt];
+		memset(op, 0, sizeof(*op));
+		op->slzr = slzr;
+		op->off = off;
+		op->hidden = slzr->name[0] == '_';
+		if (slzr->name[0] != 0) {
+			op->key_len = strlen(slzr->name) + 3;
+			op->key = malloc(op->key_len + 1);
+			if (!op->key) {
+				PWLOG(LOG_ERROR, "malloc() failed\n");
+				abort();
+			}
+			snprintf(op->key, op->key_len + 1, "\"%s\":", slzr->name);
+			op->name_hash = cjson_key_hash(slzr->name);
+		}
+
+		if (slzr->type == _INT8) {
+			op->type = SERIALIZER_OP_INT8;
+			off += 1;
+		} else if (slzr->type == _INT32) {
+			op->type = SERIALIZER_OP_INT32;
+			op->always = slzr->ctx != NULL;
+			/* TODO make id fields _CUSTOM in all serializers */
+			op->root_id = strcmp(slzr->name, "id") == 0 && slzr->ctx == NULL;
+			off += 4;
+		} else if (slzr->type > _CONST_INT(0) && slzr->type <= _CONST_INT(0x1000)) {
+			op->type = SERIALIZER_OP_CONST_INT;
+			op->len = slzr->type - _CONST_INT(0);
+		} else if (slzr->type == _FLOAT) {
+			op->type = SERIALIZER_OP_FLOAT;
+			off += 4;
+		} else if (slzr->type > _WSTRING(0) && slzr->type <= _WSTRING(0x1000)) {
+			op->type = SERIALIZER_OP_WSTRING;
+			op->len = slzr->type - _WSTRING(0);
+			off += op->len * 2;
+		} else if (slzr->type > _STRING(0) && slzr->type <= _STRING(0x1000)) {
+			op->type = SERIALIZER_OP_STRING;
+			op->len = slzr->type - _STRING(0);
+			off += op->len;
+		} else if (slzr->type > _ARRAY_START(0) && slzr->type <= _ARRAY_START(0x1000)) {
+			op->type = SERIALIZER_OP_ARRAY;
+			op->len = slzr->type - _ARRAY_START(0);
+			op->nested = compile_plan(slzr + 1);
+			off += op->nested->el_size * op->len;
+			slzr = op->nested->end;
+		} else if (slzr->type == _OBJECT_START) {
+			op->type = SERIALIZER_OP_OBJECT;
+			if (slzr->ctx) {
+				op->nested = compile_plan(slzr->ctx);
+			} else {
+				op->nested = compile_plan(slzr + 1);
+				slzr = op->nested->end;
+			}
+			off += op->nested->el_size;
+		} else if (slzr->type >= _CUSTOM(0) && slzr->type <= _CUSTOM(0x1000)) {
+			op->type = SERIALIZER_OP_CUSTOM;
+			op->len = slzr->type - _CUSTOM(0);
+			off += op->len;
+		} else {
+			/* unknown type, skip it */
+			slzr++;
+			continue;
+		}
+
+		plan->op_cnt++;
+		slzr++;
+	}
+
+	plan->end = slzr;
+	plan->el_size = off;
+	index_plan_names(plan);
+	__atomic_store_n(&slzr_table->plan, plan, __ATOMIC_RELEASE);
+	return plan;
+}
+
+struct serializer_plan *
+serializer_get_plan(struct serializer *slzr_table)
+{
+	struct serializer_plan *plan;
+
+	plan = __atomic_load_n(&slzr_table->plan, __ATOMIC_ACQUIRE);
+	if (plan) {
+		return plan;
+	}
+
+	pthread_mutex_lock(&g_plan_lock);
+	plan = compile_plan(slzr_table);
+	pthread_mutex_unlock(&g_plan_lock);
+	return plan;
+}
+
+static void
+print_key(struct pw_buf *buf, struct serializer_op *op)
+{
+	if (op->key) {
+		pw_buf_write(buf, op->key, op->key_len);
+	}
+}
+
+static long
+serialize_plan(struct pw_buf *buf, struct serializer_plan *plan, void *data,
 		unsigned data_cnt, bool skip_empty_objs, bool newlines, bool force_object)
 {
 	unsigned data_idx;
-	struct serializer *slzr = NULL;
-	void *data = *data_p;
-	bool nonzero, obj_printed;
-	long sz, arr_sz;
+	bool nonzero, obj_printed = plan->is_obj;
+	size_t sz, arr_sz;
 
 	if (!force_object) {
-		fprintf(fp, "[");
+		pw_buf_putc(buf, '[');
 	}
 	/* in case the arr is full of empty objects or just 0-fields -> print just [] */
-	arr_sz = ftell(fp);
+	arr_sz = pw_buf_mark(buf);
 	for (data_idx = 0; data_idx < data_cnt; data_idx++) {
-		slzr = *slzr_table_p;
-		obj_printed = false;
-		if (slzr->name[0] != 0) {
-			obj_printed = true;
-			fprintf(fp, "{");
+		struct serializer_op *op = plan->ops;
+		struct serializer_op *op_end = plan->ops + plan->op_cnt;
+		void *el = data + (size_t)plan->el_size * data_idx;
+
+		if (obj_printed) {
+			pw_buf_putc(buf, '{');
 		}
 		/* when obj contains only 0-fields -> print {} */
-		sz = ftell(fp);
+		sz = pw_buf_mark(buf);
 		nonzero = false;
 
-		while (true) {
-			if (slzr->type == _INT8) {
-				if (!obj_printed || (*(uint8_t *)data != 0 && slzr->name[0] != '_')) {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "%u,", *(uint8_t *)data);
-					nonzero = nonzero || *(uint8_t *)data != 0;
-				}
-				data += 1;
-			} else if (slzr->type == _INT16) {
-				if (!obj_printed || (*(uint16_t *)data != 0 && slzr->name[0] != '_')) {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "%u,", *(uint16_t *)data);
-					nonzero = nonzero || *(uint16_t *)data != 0;
-				}
-				data += 2;
-			} else if (slzr->type == _INT32) {
-				if (!obj_printed || (*(uint32_t *)data != 0 && slzr->name[0] != '_') || slzr->ctx != NULL) {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "%u,", *(uint32_t *)data);
-					nonzero = nonzero || *(uint32_t *)data != 0;
-				}
-				data += 4;
-			} else if (slzr->type > _CONST_INT(0) && slzr->type <= _CONST_INT(0x1000)) {
-				unsigned num = slzr->type - _CONST_INT(0);
-
-				if (!obj_printed || (num != 0 && slzr->name[0] != '_')) {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "%u,", num);
-					nonzero = nonzero || num != 0;
-				}
-			} else if (slzr->type == _FLOAT) {
-				if (!obj_printed || (*(float *)data != 0 && slzr->name[0] != '_')) {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "%.8f,", *(float *)data);
-					nonzero = nonzero || *(float *)data != 0;
-				}
-				data += 4;
-			} else if (slzr->type > _WSTRING(0) && slzr->type <= _WSTRING(0x1000)) {
-				unsigned len = slzr->type - _WSTRING(0);
-
-				if (slzr->name[0] != '_') {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "\"");
-					fwsprint(fp, (const uint16_t *)data, len);
-					fprintf(fp, "\",");
-					nonzero = nonzero || *(uint16_t *)data != 0;
+		for (; op < op_end; op++) {
+			void *field = el + op->off;
+			uint32_t num;
+
+			switch (op->type) {
+			case SERIALIZER_OP_INT8:
+				num = *(uint8_t *)field;
+				break;
+			case SERIALIZER_OP_INT32:
+				num = *(uint32_t *)field;
+				break;
+			case SERIALIZER_OP_CONST_INT:
+				num = op->len;
+				break;
+			case SERIALIZER_OP_FLOAT:
+				if (!obj_printed || (*(float *)field != 0 && !op->hidden)) {
+					print_key(buf, op);
+					pw_buf_print_float(buf, *(float *)field);
+					pw_buf_putc(buf, ',');
+					nonzero = nonzero || *(float *)field != 0;
 				}
-				data += len * 2;
-			} else if (slzr->type > _STRING(0) && slzr->type <= _STRING(0x1000)) {
-				unsigned len = slzr->type - _STRING(0);
-
-				if (slzr->name[0] != '_') {
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-					fprintf(fp, "\"");
-					fsprint(fp, (const char *)data, len);
-					fprintf(fp, "\",");
-					nonzero = nonzero || *(char *)data != 0;
+				continue;
+			case SERIALIZER_OP_WSTRING:
+				if (!op->hidden) {
+					print_key(buf, op);
+					pw_buf_putc(buf, '"');
+					pw_buf_wsprint(buf, (const uint16_t *)field, op->len);
+					pw_buf_write(buf, "\",", 2);
+					nonzero = nonzero || *(uint16_t *)field != 0;
 				}
-				data += len;
-			} else if (slzr->type > _ARRAY_START(0) && slzr->type <= _ARRAY_START(0x1000)) {
-				unsigned cnt = slzr->type - _ARRAY_START(0);
-				size_t pre_name_pos = ftell(fp);
-				const char *slzr_name = slzr->name;
-
-				if (slzr->name[0] != 0) {
-					fprintf(fp, "\"%s\":", slzr->name);
+				continue;
+			case SERIALIZER_OP_STRING:
+				if (!op->hidden) {
+					print_key(buf, op);
+					pw_buf_putc(buf, '"');
+					pw_buf_sprint(buf, (const char *)field, op->len);
+					pw_buf_write(buf, "\",", 2);
+					nonzero = nonzero || *(char *)field != 0;
 				}
+				continue;
+			case SERIALIZER_OP_ARRAY:
+			case SERIALIZER_OP_OBJECT: {
+				size_t pre_name_pos = pw_buf_mark(buf);
+				size_t pre_pos;
 
-				size_t pre_pos = ftell(fp);
-				slzr++;
-				_serialize(fp, &slzr, &data, cnt, true, false, false);
+				if (op->hidden) {
+					continue;
+				}
 
-				if (ftell(fp) <= pre_pos + 2 || slzr_name[0] == '_') {
-					fseek(fp, pre_name_pos, SEEK_SET);
+				print_key(buf, op);
+				pre_pos = pw_buf_mark(buf);
+				if (op->type == SERIALIZER_OP_ARRAY) {
+					serialize_plan(buf, op->nested, field, op->len, true, false, false);
 				} else {
-					fprintf(fp, ",");
-					nonzero = true;
+					serialize_plan(buf, op->nested, field, 1, true, false, true);
 				}
-			} else if (slzr->type == _OBJECT_START) {
-				if (slzr->name[0] != '_') {
-					size_t pre_name_pos = ftell(fp);
-
-					struct serializer *nested_slzr = slzr->ctx;
-					if (slzr->name[0] != 0) {
-						fprintf(fp, "\"%s\":", slzr->name);
-					}
-
-
-					size_t pre_pos = ftell(fp);
-					if (nested_slzr) {
-						_serialize(fp, &nested_slzr, &data, 1, true, false, true);
-					} else {
-						slzr++;
-						_serialize(fp, &slzr, &data, 1, true, false, true);
-					}
-					if (ftell(fp) <= pre_pos + 2) {
-						/* nothing printed in the object, skip its name */
-						fseek(fp, pre_name_pos, SEEK_SET);
-					} else {
-						fprintf(fp, ",");
-						nonzero = true;
-					}
+
+				if (pw_buf_mark(buf) <= pre_pos + 2) {
+					/* nothing printed in the container, skip its name */
+					pw_buf_rollback(buf, pre_name_pos);
 				} else {
-					/* just advance the slzr and data */
-					slzr++;
-					_serialize(g_nullfile, &slzr, &data, 1, true, false, true);
+					pw_buf_putc(buf, ',');
+					nonzero = true;
 				}
-			} else if (slzr->type == _CUSTOM) {
-				size_t pre_pos = ftell(fp);
-				data += slzr->fn(fp, slzr, data);
-				nonzero = nonzero || ftell(fp) != pre_pos;
-			} else if (slzr->type == _ARRAY_END) {
-				break;
-			} else if (slzr->type == _OBJECT_END) {
-				break;
-			} else if (slzr->type == _TYPE_END) {
-				break;
+				continue;
+			}
+			case SERIALIZER_OP_CUSTOM: {
+				size_t pre_pos = pw_buf_mark(buf);
+
+				op->slzr->fn(buf, op->slzr, field);
+				nonzero = nonzero || pw_buf_mark(buf) != pre_pos;
+				continue;
+			}
+			default:
+				continue;
+			}
+
+			if (!obj_printed || (num != 0 && !op->hidden) || op->always) {
+				print_key(buf, op);
+				print_uint(buf, num);
+				nonzero = nonzero || num != 0;
 			}
-			slzr++;
 		}
 
 		if (skip_empty_objs && !nonzero) {
 			if (obj_printed) {
 				/* go back to { */
-				fseek(fp, sz, SEEK_SET);
+				pw_buf_rollback(buf, sz);
 			} else {
 				/* overwrite previous comma */
-				fseek(fp, -1, SEEK_CUR);
+				pw_buf_rollback(buf, pw_buf_mark(buf) - 1);
 			}
 		} else {
 			/* overwrite previous comma */
-			fseek(fp, -1, SEEK_CUR);
+			pw_buf_rollback(buf, pw_buf_mark(buf) - 1);
 			/* save } of the last non-empty object since we may need to strip
 			 * all subsequent objects from the array */
-			arr_sz = ftell(fp) + (obj_printed ? 1 : 0);
+			arr_sz = pw_buf_mark(buf) + (obj_printed ? 1 : 0);
 		}
 
 		if (obj_printed) {
-			fprintf(fp, "}");
+			pw_buf_putc(buf, '}');
 		}
-		if (!force_object && skip_empty_objs && ftell(fp) < arr_sz) {
+		if (!force_object && skip_empty_objs && pw_buf_mark(buf) < arr_sz) {
 			/* we overwrote this before, time to restore it */
-			fprintf(fp, "[");
+			pw_buf_putc(buf, '[');
 		} else {
-			fprintf(fp, ",");
+			pw_buf_putc(buf, ',');
 		}
 		if (newlines) {
-			fprintf(fp, "\n");
+			pw_buf_putc(buf, '\n');
 		}
 	}
 
 	/* overwrite previous comma and strip empty objects from the array */
-	fseek(fp, arr_sz, SEEK_SET);
+	pw_buf_rollback(buf, arr_sz);
 
 	if (!force_object) {
-		fprintf(fp, "]");
+		pw_buf_putc(buf, ']');
 	}
 
-	*slzr_table_p = slzr;
-	*data_p = data;
 	return arr_sz + !force_object;
 }
 
 long
-serialize(FILE *fp, struct serializer *slzr_table, void *data, unsigned data_cnt)
+_serialize(struct pw_buf *buf, struct serializer **slzr_table_p, void **data_p,
+		unsigned data_cnt, bool skip_empty_objs, bool newlines, bool force_object)
+{
+	struct serializer_plan *plan = serializer_get_plan(*slzr_table_p);
+	long rc;
+
+	rc = serialize_plan(buf, plan, *data_p, data_cnt, skip_empty_objs, newlines, force_object);
+	*slzr_table_p = plan->end;
+	*data_p += (size_t)plan->el_size * data_cnt;
+	return rc;
+}
+
+long
+serialize(struct pw_buf *buf, struct serializer *slzr_table, void *data, unsigned data_cnt)
+{
+	return _serialize(buf, &slzr_table, &data, data_cnt, false, true, false);
+}
+
+/* number of elements serialized by a single serialize_objs() worker */
+#define SERIALIZE_CHUNK_SIZE 256
+
+struct serialize_objs_ctx {
+	struct serializer_plan *plan;
+	bool skip_empty_objs;
+	bool newlines;
+	const char *sep;
+	size_t sep_len;
+	size_t min_len;
+	struct serialize_range *chunks;
+	struct pw_buf *bufs;
+};
+
+static void
+serialize_objs_range(struct pw_buf *buf, struct serialize_objs_ctx *ctx, struct serialize_range *range)
+{
+	unsigned i;
+
+	for (i = 0; i < range->cnt; i++) {
+		size_t pos_begin = pw_buf_mark(buf);
+
+		serialize_plan(buf, ctx->plan, range->data + (size_t)ctx->plan->el_size * i,
+				1, ctx->skip_empty_objs, ctx->newlines, true);
+		if (pw_buf_mark(buf) > pos_begin + ctx->min_len) {
+			pw_buf_write(buf, ctx->sep, ctx->sep_len);
+		}
+	}
+}
+
+static void
+serialize_objs_chunk(void *_ctx, size_t i)
 {
-	return _serialize(fp, &slzr_table, &data, data_cnt, false, true, false);
+	struct serialize_objs_ctx *ctx = _ctx;
+
+	serialize_objs_range(&ctx->bufs[i], ctx, &ctx->chunks[i]);
+}
+
+void
+serialize_objs(struct pw_buf *buf, struct serializer *slzr_table, struct serialize_range *ranges,
+		unsigned range_cnt, bool skip_empty_objs, bool newlines, const char *sep, size_t min_len)
+{
+	struct serialize_objs_ctx ctx = {};
+	size_t total_cnt = 0, chunk_cnt = 0;
+	unsigned i, j;
+
+	ctx.plan = serializer_get_plan(slzr_table);
+	ctx.skip_empty_objs = skip_empty_objs;
+	ctx.newlines = newlines;
+	ctx.sep = sep;
+	ctx.sep_len = strlen(sep);
+	ctx.min_len = min_len;
+
+	for (i = 0; i < range_cnt; i++) {
+		total_cnt += ranges[i].cnt;
+		chunk_cnt += (ranges[i].cnt + SERIALIZE_CHUNK_SIZE - 1) / SERIALIZE_CHUNK_SIZE;
+	}
+
+	if (chunk_cnt < 2 || pw_get_num_threads() == 1) {
+		for (i = 0; i < range_cnt; i++) {
+			serialize_objs_range(buf, &ctx, &ranges[i]);
+		}
+		return;
+	}
+
+	ctx.chunks = calloc(chunk_cnt, sizeof(*ctx.chunks) + sizeof(*ctx.bufs));
+	if (!ctx.chunks) {
+		PWLOG(LOG_ERROR, "calloc() failed\n");
+		buf->oom = true;
+		return;
+	}
+	ctx.bufs = (void *)(ctx.chunks + chunk_cnt);
+
+	/* contiguous element ranges, each serialized into a separate buffer */
+	chunk_cnt = 0;
+	for (i = 0; i < range_cnt; i++) {
+		for (j = 0; j < ranges[i].cnt; j += SERIALIZE_CHUNK_SIZE) {
+			ctx.chunks[chunk_cnt].data = ranges[i].data + (size_t)ctx.plan->el_size * j;
+			ctx.chunks[chunk_cnt].cnt = MIN(SERIALIZE_CHUNK_SIZE, ranges[i].cnt - j);
+			ctx.bufs[chunk_cnt].null = buf->null;
+			chunk_cnt++;
+		}
+	}
+
+	pw_parallel_for(chunk_cnt, serialize_objs_chunk, &ctx);
+
+	/* every object is self-contained, so the chunks can be simply concatenated */
+	for (i = 0; i < chunk_cnt; i++) {
+		if (ctx.bufs[i].oom) {
+			buf->oom = true;
+		}
+		pw_buf_write(buf, ctx.bufs[i].data, ctx.bufs[i].len);
+		pw_buf_free(&ctx.bufs[i]);
+	}
+
+	free(ctx.chunks);
+}
+
+long
+serialize_parallel(struct pw_buf *buf, struct serializer *slzr_table, void *data, unsigned data_cnt)
+{
+	struct serializer_plan *plan = serializer_get_plan(slzr_table);
+	struct serialize_range range = { data, data_cnt };
+
+	if (!plan->is_obj || data_cnt == 0) {
+		return serialize(buf, slzr_table, data, data_cnt);
+	}
+
+	/* the same as serialize_plan() with !skip_empty_objs: {...},\n{...},\n{...} */
+	pw_buf_putc(buf, '[');
+	serialize_objs(buf, slzr_table, &range, 1, false, true, ",\n", 0);
+	pw_buf_rollback(buf, pw_buf_mark(buf) - 2);
+	pw_buf_putc(buf, ']');
+	return pw_buf_mark(buf);
+}
+
+/* the top-level object being deserialized on this thread, see struct serializer_change */
+static __thread struct serializer *t_des_root_slzr;
+static __thread void *t_des_root;
+static __thread deserialize_change_cb t_des_change_cb;
+static __thread void *t_des_change_ctx;
+
+void
+deserialize_set_change_cb(deserialize_change_cb cb, void *ctx)
+{
+	t_des_change_cb = cb;
+	t_des_change_ctx = ctx;
+}
+
+static size_t
+append_path(struct cjson *json, char *buf, size_t size)
+{
+	size_t len = 0;
+	int rc;
+
+	if (json->parent && json->parent->key) {
+		len = append_path(json->parent, buf, size);
+	}
+
+	rc = snprintf(buf + MIN(len, size), len < size ? size - len : 0, "%s%s",
+			len ? "->" : "", json->key);
+	return len + (rc > 0 ? rc : 0);
+}
+
+size_t
+serializer_change_path(const struct serializer_change *change, char *buf, size_t size)
+{
+	if (size) {
+		buf[0] = 0;
+	}
+
+	if (!change->field->key) {
+		return 0;
+	}
+
+	return append_path(change->field, buf, size);
 }
 
 void
 deserialize_log(struct cjson *json_f, void *data)
 {
-	char buf[2048] = {0};
-	char buf2[2048];
-	struct cjson *json = json_f;
+	struct serializer_change change;
+	char buf[2048];
 
-	while (json && json->key) {
-		memcpy(buf2, buf, sizeof(buf2));
-		snprintf(buf, sizeof(buf), "%s->%s", json->key, buf2);
-		json = json->parent;
+	if (!t_des_change_cb && LOG_INFO > g_pwlog_level) {
+		return;
 	}
-	buf[strlen(buf) - 2] = 0;
+
+	change.slzr_table = t_des_root_slzr;
+	change.obj = t_des_root;
+	change.id = 0;
+	change.field = json_f;
+	change.old = data;
+
+	if (t_des_root) {
+		struct serializer_op *op = plan_lookup(serializer_get_plan(t_des_root_slzr), "id");
+
+		if (op && (op->type == SERIALIZER_OP_INT32 || (op->type == SERIALIZER_OP_CUSTOM && op->len == 4))) {
+			change.id = *(uint32_t *)(t_des_root + op->off);
+		}
+	}
+
+	if (t_des_change_cb) {
+		t_des_change_cb(t_des_change_ctx, &change);
+	}
+
+	if (LOG_INFO > g_pwlog_level) {
+		return;
+	}
+
+	serializer_change_path(&change, buf, sizeof(buf));
 
 	switch (json_f->type) {
 		case CJSON_TYPE_INTEGER:
@@ -261,240 +648,147 @@ deserialize_log(struct cjson *json_f, void *data)
 	}
 }
 
-static int
-_serializer_get_offset(struct serializer **slzr_p, const char *name)
+int
+serializer_get_offset(struct serializer *slzr_table, const char *name)
 {
-	struct serializer *slzr = *slzr_p;
-	int offset = 0;
-	int rc;
-
-	while (true) {
-		if (name && strcmp(slzr->name, name) == 0) {
-			*slzr_p = slzr;
-			return offset;
-		}
-
-		if (slzr->type == _INT8) {
-			offset += 1;
-		} else if (slzr->type == _INT16) {
-			offset += 2;
-		} else if (slzr->type == _INT32) {
-			offset += 4;
-		} else if (slzr->type == _FLOAT) {
-			offset += 4;
-		} else if (slzr->type > _WSTRING(0) && slzr->type <= _WSTRING(0x1000)) {
-			unsigned len = slzr->type - _WSTRING(0);
-
-			offset += len * 2;
-		} else if (slzr->type > _STRING(0) && slzr->type <= _STRING(0x1000)) {
-			unsigned len = slzr->type - _STRING(0);
-
-			offset += len;
-		} else if (slzr->type > _ARRAY_START(0) && slzr->type <= _ARRAY_START(0x1000)) {
-			unsigned cnt = slzr->type - _ARRAY_START(0);
-
-			slzr++;
-			rc = serializer_get_offset(slzr, NULL);
-			offset += rc * cnt;
-			while (slzr->type != _ARRAY_END) {
-				slzr++;
-			}
-		} else if (slzr->type == _OBJECT_START) {
-			struct serializer *nested_slzr = slzr->ctx;
-
-			if (nested_slzr) {
-				rc = serializer_get_offset(nested_slzr, NULL);
-			} else {
-				slzr++;
-				rc = serializer_get_offset(slzr, NULL);
-				while (slzr->type != _OBJECT_END) {
-					slzr++;
-				}
-			}
+	struct serializer_plan *plan = serializer_get_plan(slzr_table);
+	struct serializer_op *op;
 
-			offset += rc;
-		} else if (slzr->type == _CUSTOM) {
-			offset += slzr->fn(g_nullfile, slzr, (void *)g_zeroes);
-		} else if (slzr->type == _ARRAY_END) {
-			break;
-		} else if (slzr->type == _OBJECT_END) {
-			break;
-		} else if (slzr->type == _TYPE_END) {
-			break;
-		}
-		slzr++;
+	if (!name) {
+		return plan->el_size;
 	}
 
-	*slzr_p = slzr;
-	if (name) {
-		return -1;
-	} else {
-		return offset;
-	}
-}
-
-int
-serializer_get_offset(struct serializer *slzr, const char *name)
-{
-	return _serializer_get_offset(&slzr, name);
+	op = plan_lookup(plan, name);
+	return op ? op->off : -1;
 }
 
 int
 serializer_get_size(struct serializer *slzr_table)
 {
-	return serializer_get_offset(slzr_table, NULL);
+	return serializer_get_plan(slzr_table)->el_size;
 }
 
 int
 serializer_get_offset_slzr(struct serializer *slzr_table, const char *name, struct serializer **slzr)
 {
-	int rc = _serializer_get_offset(&slzr_table, name);
+	struct serializer_plan *plan = serializer_get_plan(slzr_table);
+	struct serializer_op *op = plan_lookup(plan, name);
 
-	*slzr = slzr_table;
-	return rc;
+	if (!op) {
+		*slzr = plan->end;
+		return -1;
+	}
+
+	*slzr = op->slzr;
+	return op->off;
 }
 
 void *
-serializer_get_field(struct serializer *slzr, const char *name, void *data)
+serializer_get_field(struct serializer *slzr_table, const char *name, void *data)
 {
-	return data + serializer_get_offset(slzr, name);
+	return data + serializer_get_offset(slzr_table, name);
 }
 
-static void
-_deserialize(struct cjson *obj, struct serializer **slzr_table_p, void **data_p, bool is_root_obj)
+/* normalize the string (if needed at all) and trim trailing spaces, returns the new length */
+static size_t
+prepare_json_str(struct cjson *json)
 {
-	struct serializer *slzr = *slzr_table_p;
-	void *data = *data_p;
+	size_t len = cjson_str_normalize(json, true);
 
-	while (true) {
-		struct cjson *json_f;
+	while (len > 1 && json->s[len - 1] == ' ') {
+		json->s[--len] = 0;
+	}
 
-		if (slzr->type == _ARRAY_END) {
-			break;
-		} else if (slzr->type == _OBJECT_END) {
-			break;
-		} else if (slzr->type == _TYPE_END) {
-			break;
-		}
+	json->s_len = len;
+	return len;
+}
 
-		/* TODO make id fields _CUSTOM in all serializers */
-		if (is_root_obj && slzr->type == _INT32 && strcmp(slzr->name, "id") == 0 && slzr->ctx == NULL) {
-			data += 4;
-			slzr++;
-			continue;
-		}
+/* deserialize a single non-container field */
+static void
+deserialize_field(struct cjson *json_f, struct serializer_op *op, void *data)
+{
+	switch (op->type) {
+	case SERIALIZER_OP_INT8:
+		if (json_f->type != CJSON_TYPE_NONE) {
+			uint32_t _data = *(uint8_t *)data;
 
-		if (strlen(slzr->name) == 0) {
-			assert(obj->type != CJSON_TYPE_OBJECT);
-			json_f = obj;
-		} else {
-			json_f = cjson_obj(obj, slzr->name);
+			deserialize_log(json_f, &_data);
+			*(uint8_t *)data = json_f->i;
 		}
-
-		if (slzr->type == _INT8) {
-			if (json_f->type != CJSON_TYPE_NONE) {
-				uint32_t _data = *(uint8_t *)data;
-
-				deserialize_log(json_f, &_data);
-				*(uint8_t *)data = json_f->i;
+		break;
+	case SERIALIZER_OP_INT32:
+		if (json_f->type != CJSON_TYPE_NONE) {
+			deserialize_log(json_f, data);
+			*(uint32_t *)data = json_f->i;
+		}
+		break;
+	case SERIALIZER_OP_FLOAT:
+		if (json_f->type != CJSON_TYPE_NONE) {
+			deserialize_log(json_f, data);
+			if (json_f->type == CJSON_TYPE_FLOAT) {
+				*(float *)data = json_f->d;
+			} else {
+				*(float *)data = json_f->i;
 			}
-			data += 1;
-		} else if (slzr->type == _INT16) {
-			if (json_f->type != CJSON_TYPE_NONE) {
-				uint32_t _data = *(uint8_t *)data;
+		}
+		break;
+	case SERIALIZER_OP_WSTRING: {
+		unsigned len = op->len;
 
-				deserialize_log(json_f, &_data);
-				*(uint16_t *)data = json_f->i;
-			}
-			data += 2;
-		} else if (slzr->type == _INT32) {
-			if (json_f->type != CJSON_TYPE_NONE) {
-				deserialize_log(json_f, data);
-				*(uint32_t *)data = json_f->i;
-			}
-			data += 4;
-		} else if (slzr->type > _CONST_INT(0) && slzr->type <= _CONST_INT(0x1000)) {
-			/* nothing */
-		} else if (slzr->type == _FLOAT) {
-			if (json_f->type != CJSON_TYPE_NONE) {
-				deserialize_log(json_f, data);
-				if (json_f->type == CJSON_TYPE_FLOAT) {
-					*(float *)data = json_f->d;
-				} else {
-					*(float *)data = json_f->i;
-				}
-			}
-			data += 4;
-		} else if (slzr->type > _WSTRING(0) && slzr->type <= _WSTRING(0x1000)) {
-			unsigned len = slzr->type - _WSTRING(0);
-
-			char buf[2048] = {0};
-			struct cjson *json = json_f;
-			while (json && json->key) {
-				char buf2[2048];
-				memcpy(buf2, buf, sizeof(buf2));
-				snprintf(buf, sizeof(buf), "%s->%s", json->key, buf2);
-				json = json->parent;
-			}
-			if (strlen(buf) > 2) {
-				buf[strlen(buf) - 2] = 0;
-			}
+		if (json_f->type != CJSON_TYPE_NONE) {
+			size_t str_len = prepare_json_str(json_f);
 
-			if (json_f->type != CJSON_TYPE_NONE) {
-				normalize_json_string(json_f->s, true);
+			deserialize_log(json_f, data);
+			memset(data, 0, len * 2);
+			change_charset("UTF-8", "UTF-16LE", json_f->s, str_len, (char *)data, len * 2 - 2);
+		}
+		break;
+	}
+	case SERIALIZER_OP_STRING: {
+		unsigned len = op->len;
 
-				uint8_t *c = (uint8_t *)json_f->s + strlen(json_f->s) - 1;
-				while (c != (uint8_t *)json_f->s && *c == ' ') {
-					*c = 0;
-					c--;
-				}
+		if (json_f->type != CJSON_TYPE_NONE) {
+			size_t str_len = prepare_json_str(json_f);
 
-				deserialize_log(json_f, data);
-				memset(data, 0, len * 2);
-				change_charset("UTF-8", "UTF-16LE", json_f->s, strlen(json_f->s), (char *)data, len * 2 - 2);
-			}
-			data += len * 2;
-		} else if (slzr->type > _STRING(0) && slzr->type <= _STRING(0x1000)) {
-			unsigned len = slzr->type - _STRING(0);
-
-			char buf[2048] = {0};
-			struct cjson *json = json_f;
-			while (json && json->key) {
-				char buf2[2048];
-				memcpy(buf2, buf, sizeof(buf2));
-				snprintf(buf, sizeof(buf), "%s->%s", json->key, buf2);
-				json = json->parent;
-			}
-			if (strlen(buf) > 2) {
-				buf[strlen(buf) - 2] = 0;
-			}
+			deserialize_log(json_f, data);
+			memset(data, 0, len);
+			change_charset("UTF-8", "GB2312", json_f->s, str_len, (char *)data, len - 1);
+		}
+		break;
+	}
+	case SERIALIZER_OP_CUSTOM:
+		if (op->slzr->des_fn) {
+			op->slzr->des_fn(json_f, op->slzr, data);
+		}
+		break;
+	default:
+		break;
+	}
+}
 
-			if (json_f->type != CJSON_TYPE_NONE) {
-				normalize_json_string(json_f->s, true);
+static void
+deserialize_plan(struct cjson *obj, struct serializer_plan *plan, void *data, bool is_root_obj)
+{
+	struct serializer_op *op;
+	struct cjson *json_f;
 
-				uint8_t *c = (uint8_t *)json_f->s + strlen(json_f->s) - 1;
-				while (c != (uint8_t *)json_f->s && *c == ' ') {
-					*c = 0;
-					c--;
-				}
+	for (op = plan->ops; op < plan->ops + plan->op_cnt; op++) {
+		void *field = data + op->off;
 
-				deserialize_log(json_f, data);
-				memset(data, 0, len);
-				change_charset("UTF-8", "GB2312", json_f->s, strlen(json_f->s), (char *)data, len - 1);
-			}
-			data += len;
-		} else if (slzr->type > _ARRAY_START(0) && slzr->type <= _ARRAY_START(0x1000)) {
-			unsigned cnt = slzr->type - _ARRAY_START(0);
-			void *arr_data_end = data;
-			struct serializer *tmp_slzr = ++slzr;
-			size_t arr_el_size = 0;
-			struct cjson *json_el;
+		if (is_root_obj && op->root_id) {
+			continue;
+		}
 
-			/* serialize to /dev/null to get arr element's size */
-			_serialize(g_nullfile, &tmp_slzr, &arr_data_end, 1, true, false, false);
-			arr_el_size = (size_t)((uintptr_t)arr_data_end - (uintptr_t)data);
+		if (!op->key) {
+			assert(obj->type != CJSON_TYPE_OBJECT);
+			json_f = obj;
+		} else {
+			json_f = cjson_obj_h(obj, op->slzr->name, op->name_hash);
+		}
+
+		if (op->type == SERIALIZER_OP_ARRAY) {
+			struct cjson *json_el = json_f->a;
 
-			json_el = json_f->a;
 			while (json_el) {
 				char *end;
 				unsigned idx = strtod(json_el->key, &end);
@@ -505,46 +799,223 @@ _deserialize(struct cjson *obj, struct serializer **slzr_table_p, void **data_p,
 					continue;
 				}
 
-				if (idx >= cnt) {
-					json_el = json_el->next;
-					continue;
+				if (idx < op->len) {
+					deserialize_plan(json_el, op->nested,
+							field + (size_t)op->nested->el_size * idx, false);
 				}
-
-				void *arr_data_el = data + arr_el_size * idx;
-				tmp_slzr = slzr;
-
-				_deserialize(json_el, &tmp_slzr, &arr_data_el, false);
 				json_el = json_el->next;
 			}
+		} else if (op->type == SERIALIZER_OP_OBJECT) {
+			deserialize_plan(json_f, op->nested, field, false);
+		} else {
+			deserialize_field(json_f, op, field);
+		}
+	}
+}
 
-			data += arr_el_size * cnt;
-			slzr = tmp_slzr;
-		} else if (slzr->type == _OBJECT_START) {
-			struct serializer *nested_slzr = slzr->ctx;
-			if (nested_slzr) {
-				_deserialize(json_f, &nested_slzr, &data, false);
-			} else {
-				slzr++;
-				_deserialize(json_f, &slzr, &data, false);
-			}
-		} else if (slzr->type == _CUSTOM) {
-			if (slzr->des_fn) {
-				data += slzr->des_fn(json_f, slzr, data);
-			}
+void
+deserialize(struct cjson *obj, struct serializer *slzr_table, void *data)
+{
+	bool is_top = !t_des_root;
+
+	if (is_top) {
+		t_des_root_slzr = slzr_table;
+		t_des_root = data;
+	}
+
+	deserialize_plan(obj, serializer_get_plan(slzr_table), data, true);
+
+	if (is_top) {
+		t_des_root = NULL;
+	}
+}
+
+
+
+/* returns the data of an array element with the given key or NULL */
+static void *
+deserialize_sax_arr_el(struct deserialize_sax_frame *fr, const char *key)
+{
+	unsigned idx;
+	char *end;
+
+	if (key) {
+		/* arrays in patches are objects with numeric keys */
+		idx = strtoul(key, &end, 10);
+		if (end == key) {
+			/* non-numeric key in array */
+			assert(false);
+			return NULL;
 		}
+	} else {
+		idx = fr->next_idx;
+	}
+	fr->next_idx = idx + 1;
 
-		slzr++;
+	if (idx >= fr->cnt) {
+		return NULL;
 	}
 
-	*slzr_table_p = slzr;
-	*data_p = data;
+	return fr->data + (size_t)fr->plan->el_size * idx;
 }
 
+/**
+ * The same as deserialize(), but driven by cjson_sax_parse() events, so the
+ * fields are written as soon as they're parsed and no cjson tree is built.
+ * The fields are visited in the json order rather than the serializer order.
+ */
+static int
+deserialize_sax_open(void *ctx, struct cjson *obj)
+{
+	struct deserialize_sax_ctx *d = ctx;
+	struct deserialize_sax_frame *fr, *nf;
+	struct serializer_op *op;
+	void *base;
+
+	nf = &d->frames[d->depth];
+	memset(nf, 0, sizeof(*nf));
+
+	if (d->depth == 0) {
+		nf->plan = d->plan;
+		nf->data = d->data;
+		nf->is_root = true;
+		d->depth++;
+		return 0;
+	}
+
+	fr = &d->frames[d->depth - 1];
+	d->depth++;
+	if (!fr->plan) {
+		return 0;
+	}
+
+	if (fr->is_arr) {
+		base = deserialize_sax_arr_el(fr, obj->key);
+		if (!base) {
+			return 0;
+		}
+
+		/* a nameless field takes the entire element, e.g. nested arrays */
+		op = plan_lookup(fr->plan, "");
+		if (!op || (op->type != SERIALIZER_OP_OBJECT && op->type != SERIALIZER_OP_ARRAY)) {
+			nf->plan = fr->plan;
+			nf->data = base;
+			return 0;
+		}
+	} else {
+		op = plan_lookup(fr->plan, obj->key);
+		if (!op) {
+			return 0;
+		}
+		base = fr->data;
+	}
+
+	if (op->type == SERIALIZER_OP_ARRAY) {
+		nf->is_arr = true;
+		nf->plan = op->nested;
+		nf->data = base + op->off;
+		nf->cnt = op->len;
+	} else if (op->type == SERIALIZER_OP_OBJECT) {
+		nf->plan = op->nested;
+		nf->data = base + op->off;
+	} else if (op->type == SERIALIZER_OP_CUSTOM && op->slzr->des_fn) {
+		/* give it a regular cjson tree, it will come in deserialize_sax_value() */
+		d->depth--;
+		return CJSON_SAX_DOM;
+	}
+
+	return 0;
+}
+
+static int
+deserialize_sax_close(void *ctx, struct cjson *obj)
+{
+	struct deserialize_sax_ctx *d = ctx;
+
+	d->depth--;
+	return 0;
+}
+
+static int
+deserialize_sax_value(void *ctx, struct cjson *val)
+{
+	struct deserialize_sax_ctx *d = ctx;
+	struct deserialize_sax_frame *fr = &d->frames[d->depth - 1];
+	struct serializer_op *op;
+	void *data;
+
+	if (!fr->plan) {
+		return 0;
+	}
+
+	if (fr->is_arr) {
+		/* a scalar array element, only a nameless field can take it */
+		data = deserialize_sax_arr_el(fr, val->key);
+		if (!data) {
+			return 0;
+		}
+
+		op = plan_lookup(fr->plan, "");
+	} else {
+		data = fr->data;
+		op = plan_lookup(fr->plan, val->key);
+		if (op && fr->is_root && op->root_id) {
+			return 0;
+		}
+	}
+
+	if (!op || op->type == SERIALIZER_OP_OBJECT || op->type == SERIALIZER_OP_ARRAY) {
+		return 0;
+	}
+
+	deserialize_field(val, op, data + op->off);
+	return 0;
+}
+
+const struct cjson_sax_ops g_deserialize_sax_ops = {
+	.open = deserialize_sax_open,
+	.close = deserialize_sax_close,
+	.value = deserialize_sax_value,
+};
 
 void
-deserialize(struct cjson *obj, struct serializer *slzr_table, void *data)
+deserialize_sax_begin(struct deserialize_sax_ctx *ctx, struct serializer *slzr_table, void *data, unsigned depth)
 {
-	_deserialize(obj, &slzr_table, &data, true);
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->plan = serializer_get_plan(slzr_table);
+	ctx->data = data;
+	ctx->is_top = !t_des_root;
+
+	if (ctx->is_top) {
+		t_des_root_slzr = slzr_table;
+		t_des_root = data;
+	}
+
+	if (depth > 0) {
+		/* the root is already open, anything between it and depth is skipped */
+		ctx->frames[0].plan = ctx->plan;
+		ctx->frames[0].data = data;
+		ctx->frames[0].is_root = true;
+		ctx->depth = depth;
+	}
 }
 
+void
+deserialize_sax_end(struct deserialize_sax_ctx *ctx)
+{
+	if (ctx->is_top) {
+		t_des_root = NULL;
+	}
+}
+
+int
+deserialize_sax(char *str, struct serializer *slzr_table, void *data, struct cjson_index *idx)
+{
+	struct deserialize_sax_ctx ctx;
+	int rc;
 
+	deserialize_sax_begin(&ctx, slzr_table, data, 0);
+	rc = cjson_sax_parse(str, NULL, &g_deserialize_sax_ops, &ctx, idx);
+	deserialize_sax_end(&ctx);
+	return rc;
+}
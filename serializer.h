@@ -11,41 +11,129 @@
 #include <stdarg.h>
 #include <stdbool.h>
 
+#include "cjson.h"
+
 #define _TYPE_END 0
 #define _INT8 1
 #define _INT16 1
 #define _INT32 2
 #define _FLOAT 3
 #define _ARRAY_END 4
-#define _CUSTOM 5
 #define _OBJECT_END 6
 #define _WSTRING(n) (0x1000 + (n))
 #define _STRING(n) (0x2000 + (n))
 #define _ARRAY_START(n) (0x3000 + (n))
 #define _OBJECT_START 0x4001
 #define _CONST_INT(n) (0x4002 + (n))
+/* custom (de)serialized field of n bytes */
+#define _CUSTOM(n) (0x6000 + (n))
 
 struct cjson;
+struct cjson_index;
+struct pw_buf;
+struct serializer_plan;
 struct serializer {
 	const char *name;
 	unsigned type;
-	/* custom parser. returns number of bytes processed */
-	size_t (*fn)(FILE *fp, struct serializer *slzr, void *data);
+	/* custom parser. returns number of bytes processed, which must match
+	 * the size declared in _CUSTOM(n) */
+	size_t (*fn)(struct pw_buf *buf, struct serializer *slzr, void *data);
 	/* custom deserializer. returns number of bytes processed */
 	size_t (*des_fn)(struct cjson *f, struct serializer *slzr, void *data);
 	/* user context */
 	void *ctx;
+	/* compiled table starting at this entry, see serializer_get_plan() */
+	struct serializer_plan *plan;
 };
 
-long serialize(FILE *fp, struct serializer *slzr_table, void *data, unsigned data_cnt);
-long _serialize(FILE *fp, struct serializer **slzr_table_p, void **data_p,
+long serialize(struct pw_buf *buf, struct serializer *slzr_table, void *data, unsigned data_cnt);
+long _serialize(struct pw_buf *buf, struct serializer **slzr_table_p, void **data_p,
 		unsigned data_cnt, bool skip_empty_objs, bool newlines, bool force_object);
+
+struct serialize_range {
+	void *data;
+	unsigned cnt;
+};
+
+/**
+ * Serialize each element as a separate object, as _serialize(buf, .., 1,
+ * skip_empty_objs, newlines, true) would, and follow every object longer than
+ * min_len bytes with sep. Big inputs are split into chunks serialized on
+ * pw_parallel_for() workers and joined in order, the output stays the same.
+ */
+void serialize_objs(struct pw_buf *buf, struct serializer *slzr_table, struct serialize_range *ranges,
+		unsigned range_cnt, bool skip_empty_objs, bool newlines, const char *sep, size_t min_len);
+/* same as serialize(), but arrays of objects go through serialize_objs() */
+long serialize_parallel(struct pw_buf *buf, struct serializer *slzr_table, void *data, unsigned data_cnt);
+/**
+ * Compile the table into a flat list of fields with precomputed offsets and
+ * quoted keys. It's done once per table, then cached in slzr_table->plan.
+ * All the (de)serialize functions run on plans, so calling this is optional.
+ */
+struct serializer_plan *serializer_get_plan(struct serializer *slzr_table);
 int serializer_get_size(struct serializer *slzr_table);
 int serializer_get_offset(struct serializer *slzr_table, const char *name);
 void *serializer_get_field(struct serializer *slzr_table, const char *name, void *data);
 int serializer_get_offset_slzr(struct serializer *slzr_table, const char *name, struct serializer **slzr);
 
 void deserialize(struct cjson *obj, struct serializer *slzr_table, void *data);
+/* same as above, but straight from the json string, see cjson_sax_parse(). idx is optional */
+int deserialize_sax(char *str, struct serializer *slzr_table, void *data, struct cjson_index *idx);
+
+struct deserialize_sax_frame {
+	/* object fields or array element fields, NULL to skip the container */
+	struct serializer_plan *plan;
+	void *data;
+	bool is_root;
+	bool is_arr;
+	/* arrays only */
+	unsigned cnt;
+	unsigned next_idx;
+};
+
+struct deserialize_sax_ctx {
+	struct serializer_plan *plan;
+	void *data;
+	bool is_top;
+	unsigned depth;
+	struct deserialize_sax_frame frames[CJSON_SAX_MAX_DEPTH];
+};
+
+/**
+ * deserialize_sax() for callers with their own cjson_sax_ops, which can
+ * start forwarding the events to g_deserialize_sax_ops only once they know
+ * the target. depth is the number of containers open at that point, 0 if
+ * it's before the root.
+ */
+extern const struct cjson_sax_ops g_deserialize_sax_ops;
+void deserialize_sax_begin(struct deserialize_sax_ctx *ctx, struct serializer *slzr_table, void *data, unsigned depth);
+void deserialize_sax_end(struct deserialize_sax_ctx *ctx);
+
+/**
+ * A single field patched by deserialize(). The field path is made of the keys
+ * of json field and its parents, see serializer_change_path().
+ */
+struct serializer_change {
+	/* top-level table and object being patched, e.g. an element */
+	struct serializer *slzr_table;
+	void *obj;
+	/* its "id" field, or 0 */
+	int64_t id;
+	/* the new value */
+	struct cjson *field;
+	/* the previous value: uint32_t for integers, float for floats, char for
+	 * booleans, the raw field for strings */
+	const void *old;
+};
+
+typedef void (*deserialize_change_cb)(void *ctx, const struct serializer_change *change);
+/**
+ * Report every field patched on this thread to cb, NULL to stop. The change
+ * records are only built when there's a callback or INFO logging is enabled.
+ */
+void deserialize_set_change_cb(deserialize_change_cb cb, void *ctx);
+/* "key->key->key" of the changed field, returns its full length like snprintf() */
+size_t serializer_change_path(const struct serializer_change *change, char *buf, size_t size);
 void deserialize_log(struct cjson *json_f, void *data);
 
 #endif /* PW_SERIALIZER_H */
@@ -179,8 +179,10 @@ import_stream_cb(void *ctx, struct cjson *obj)
 		return;
 	}
 
-	const char *type = JSs(obj, "_db", "type");
-	long long id = JSi(obj, "id");
+	static struct cjson_path db_type_path = CJSON_PATH("_db.type");
+	static struct cjson_path id_path = CJSON_PATH("id");
+	const char *type = JPs(obj, &db_type_path);
+	long long id = JPi(obj, &id_path);
 	PWLOG(LOG_INFO, "type: %s, id: 0x%llx\n", type, id);
 
 	print_obj(obj->a, 1);
@@ -212,31 +214,85 @@ import_stream_cb(void *ctx, struct cjson *obj)
 	}
 }
 
+/* elements are patched straight from the json string, anything else needs a cjson tree */
 static int
-patch(const char *url)
+import_stream_el_cb(void *ctx, char *str, size_t len)
+{
+	struct cjson_index *idx = ctx;
+	int rc = pw_elements_patch_obj_str(g_elements, str, idx);
+
+	if (rc == -ENOENT) {
+		return 1;
+	}
+
+	return rc;
+}
+
+/* parse the whole patch in memory on multiple threads */
+static int
+patch_parallel(const char *url)
 {
 	char *buf;
-	char *b;
-	ssize_t num_bytes = 1;
+	size_t num_bytes;
 	int rc;
 
-	rc = download_mem(url, &buf, (size_t *)&num_bytes);
+	rc = download_mem(url, &buf, &num_bytes);
 	if (rc) {
 		PWLOG(LOG_ERROR, "download_mem(%s) failed: %d\n", url, rc);
 		return 1;
 	}
 
-	b = buf;
-	do {
-		rc = cjson_parse_arr_stream(b, import_stream_cb, NULL);
-		/* skip comma and newline */
-		b += rc;
-		while (*b && *b != '[') b++;
-	} while (rc > 0);
-
+	rc = cjson_parse_arr_parallel(buf, import_stream_cb, NULL);
 	free(buf);
 	if (rc < 0) {
-		PWLOG(LOG_ERROR, "cjson_parse_arr_stream() failed: %d\n", rc);
+		PWLOG(LOG_ERROR, "cjson_parse_arr_parallel() failed: %d\n", rc);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+patch_download_cb(void *ctx, const char *data, size_t len)
+{
+	return cjson_feed(ctx, data, len);
+}
+
+static int
+patch(const char *url)
+{
+	const char *parallel = getenv("PW_UPDATER_PARALLEL_PARSE");
+	struct cjson_index *idx;
+	struct cjson_feed *f;
+	int rc;
+
+	if (parallel && strlen(parallel) > 0) {
+		return patch_parallel(url);
+	}
+
+	/* the patch can be huge, parse it as it's downloaded */
+	idx = cjson_index_alloc();
+	f = cjson_feed_init(NULL, import_stream_cb, NULL);
+	if (!f) {
+		PWLOG(LOG_ERROR, "cjson_feed_init() failed\n");
+		cjson_index_free(idx);
+		return 1;
+	}
+
+	cjson_feed_set_el_cb(f, import_stream_el_cb, idx);
+	rc = download_cb(url, patch_download_cb, f);
+	if (rc) {
+		PWLOG(LOG_ERROR, "download_cb(%s) failed: %d\n", url, rc);
+		cjson_feed_free(f);
+		cjson_index_free(idx);
+		return 1;
+	}
+
+	rc = cjson_feed_finish(f);
+	cjson_feed_free(f);
+	cjson_index_free(idx);
+	if (rc < 0) {
+		PWLOG(LOG_ERROR, "cjson_feed_finish() failed: %d\n", rc);
 		return 1;
 	}
 